@@ -0,0 +1,229 @@
+//! Performance benchmarks for the frame path. Not part of the library.
+//!
+//! Run with `zig build bench`, optionally followed by `-- <filter>` to run
+//! only the benchmarks whose name contains `<filter>`.
+
+const std = @import("std");
+const gmz = @import("groovy_mister");
+
+const Geometry = struct {
+    name: []const u8,
+    width: usize,
+    height: usize,
+    bpp: usize,
+
+    fn bytes(self: Geometry) usize {
+        return self.width * self.height * self.bpp;
+    }
+};
+
+const geometries = [_]Geometry{
+    .{ .name = "640x480 bgr888", .width = 640, .height = 480, .bpp = 3 },
+    .{ .name = "720x576 bgra8888", .width = 720, .height = 576, .bpp = 4 },
+};
+
+/// Frames timed per configuration.
+const iterations = 300;
+
+/// Largest thread count tried by the scaling benchmark.
+const max_threads = 8;
+
+pub fn main() !void {
+    const allocator = std.heap.page_allocator;
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const filter = if (args.len > 1) args[1] else "";
+
+    if (matches("delta-bands", filter)) try benchDeltaBands(allocator);
+    if (matches("kernels", filter)) try benchKernels(allocator);
+    if (matches("ingest", filter)) try benchIngest(allocator);
+    if (matches("scale", filter)) try benchScale(allocator);
+}
+
+fn matches(name: []const u8, filter: []const u8) bool {
+    return std.mem.indexOf(u8, name, filter) != null;
+}
+
+/// Banded delta pass (subtract + reference update) by thread count.
+fn benchDeltaBands(allocator: std.mem.Allocator) !void {
+    const cpus = std.Thread.getCpuCount() catch 1;
+    std.debug.print("delta-bands: subtract + reference update, {d} CPUs\n", .{cpus});
+
+    for (geometries) |g| {
+        const len = g.bytes();
+        const src = try allocator.alloc(u8, len);
+        defer allocator.free(src);
+        const prev = try allocator.alloc(u8, len);
+        defer allocator.free(prev);
+        const out = try allocator.alloc(u8, len);
+        defer allocator.free(out);
+
+        var prng = std.Random.DefaultPrng.init(0x6d7a);
+        prng.random().bytes(src);
+        prng.random().bytes(prev);
+
+        std.debug.print("  {s} ({d} KiB)\n", .{ g.name, len / 1024 });
+        var serial_ns: f64 = 0;
+        var threads: usize = 1;
+        while (threads <= @min(cpus, max_threads)) : (threads += 1) {
+            var pool: std.Thread.Pool = undefined;
+            if (threads > 1) try pool.init(.{ .allocator = allocator, .n_jobs = threads - 1 });
+            defer if (threads > 1) pool.deinit();
+            const p: ?*std.Thread.Pool = if (threads > 1) &pool else null;
+
+            // Warm caches and wake the workers
+            gmz.delta.subtractBands(p, threads, gmz.isa.generic(), out, src, prev);
+
+            var timer = try std.time.Timer.start();
+            for (0..iterations) |i| {
+                src[(i * 4099) % len] +%= 1;
+                gmz.delta.subtractBands(p, threads, gmz.isa.generic(), out, src, prev);
+            }
+            const ns: f64 = @as(f64, @floatFromInt(timer.read())) / iterations;
+            if (threads == 1) serial_ns = ns;
+
+            // Each pass reads src and prev and writes delta and prev
+            const gbps = @as(f64, @floatFromInt(4 * len)) / ns;
+            std.debug.print("    threads {d}: {d:>8.1} us/frame  {d:>6.2} GB/s  x{d:.2}\n", .{
+                threads, ns / std.time.ns_per_us, gbps, serial_ns / ns,
+            });
+        }
+    }
+}
+
+/// Specialised delta kernels against the generic kernel, single-threaded,
+/// for every ISA variant the host CPU supports.
+fn benchKernels(allocator: std.mem.Allocator) !void {
+    std.debug.print("kernels: specialised vs generic subtract + reference update\n", .{});
+    defer gmz.isa.force(null);
+    for (std.enums.values(gmz.isa.Variant)) |variant| {
+        if (!gmz.isa.supported(variant)) continue;
+        gmz.isa.force(variant);
+        std.debug.print("  isa {s}\n", .{@tagName(variant)});
+        try benchKernelSet(allocator);
+    }
+}
+
+fn benchKernelSet(allocator: std.mem.Allocator) !void {
+    const modes = [_]gmz.protocol.RgbMode{ .bgr888, .bgra8888, .rgb565 };
+    for (gmz.kernels.geometries) |g| {
+        for (modes) |mode| {
+            const kernel = gmz.isa.select(g.width, g.rows, mode);
+            const len = kernel.frame_bytes;
+            const src = try allocator.alloc(u8, len);
+            defer allocator.free(src);
+            const prev = try allocator.alloc(u8, len);
+            defer allocator.free(prev);
+            const out = try allocator.alloc(u8, len);
+            defer allocator.free(out);
+
+            var prng = std.Random.DefaultPrng.init(0x6b72);
+            prng.random().bytes(src);
+            prng.random().bytes(prev);
+
+            const generic_ns = try timeKernel(gmz.isa.generic(), out, src, prev);
+            const special_ns = try timeKernel(kernel, out, src, prev);
+            std.debug.print("    {s:<20} generic {d:>8.1} us  specialised {d:>8.1} us  x{d:.2}\n", .{
+                kernel.name, generic_ns / std.time.ns_per_us, special_ns / std.time.ns_per_us, generic_ns / special_ns,
+            });
+        }
+    }
+}
+
+fn timeKernel(kernel: gmz.kernels.Kernel, out: []u8, src: []u8, prev: []u8) !f64 {
+    kernel.subtractUpdate(out, src, prev);
+    var timer = try std.time.Timer.start();
+    for (0..iterations) |i| {
+        src[(i * 4099) % src.len] +%= 1;
+        kernel.subtractUpdate(out, src, prev);
+    }
+    return @as(f64, @floatFromInt(timer.read())) / iterations;
+}
+
+/// Host pixel format conversion before the delta pass: a separate convert
+/// pass against conversion fused into the delta pass, single-threaded.
+fn benchIngest(allocator: std.mem.Allocator) !void {
+    std.debug.print("ingest: convert then delta vs fused, 640x480, every format pair\n", .{});
+    const width = 640;
+    const height = 480;
+    // Sized for the widest formats, shared by every pair
+    const max_len = width * height * 4;
+    const data = try allocator.alloc(u8, max_len);
+    defer allocator.free(data);
+    const converted = try allocator.alloc(u8, max_len);
+    defer allocator.free(converted);
+    const prev = try allocator.alloc(u8, max_len);
+    defer allocator.free(prev);
+    const out = try allocator.alloc(u8, max_len);
+    defer allocator.free(out);
+
+    for (std.enums.values(gmz.ingest.PixelFormat)) |from| {
+        for (std.enums.values(gmz.protocol.RgbMode)) |to| {
+            for ([_]bool{ false, true }) |dither| {
+                const in_len = width * height * from.bytesPerPixel();
+                const len = width * height * to.bytesPerPixel();
+                var prng = std.Random.DefaultPrng.init(0x696e);
+                prng.random().bytes(data[0..in_len]);
+                prng.random().bytes(prev[0..len]);
+                var source = gmz.ingest.Source.init(data[0..in_len], from, width, to).?;
+                source.dither = dither;
+                const kernel = gmz.isa.select(width, height, to);
+
+                // Two passes: convert the whole frame, then subtract it
+                source.read(0, converted[0..len]);
+                var timer = try std.time.Timer.start();
+                for (0..iterations) |i| {
+                    data[(i * 4099) % in_len] +%= 1;
+                    source.read(0, converted[0..len]);
+                    kernel.subtractUpdate(out[0..len], converted[0..len], prev[0..len]);
+                }
+                const separate_ns = @as(f64, @floatFromInt(timer.read())) / iterations;
+
+                gmz.delta.subtractSource(null, 1, kernel, &source, out[0..len], prev[0..len]);
+                timer.reset();
+                for (0..iterations) |i| {
+                    data[(i * 4099) % in_len] +%= 1;
+                    gmz.delta.subtractSource(null, 1, kernel, &source, out[0..len], prev[0..len]);
+                }
+                const fused_ns = @as(f64, @floatFromInt(timer.read())) / iterations;
+
+                // Dither only changes RGB565 output; other rows time the flag's overhead
+                std.debug.print("    {s:>9} -> {s:<9}{s:<7} separate {d:>8.1} us  fused {d:>8.1} us  x{d:.2}\n", .{
+                    @tagName(from), @tagName(to), if (dither) " dither" else "", separate_ns / std.time.ns_per_us, fused_ns / std.time.ns_per_us, separate_ns / fused_ns,
+                });
+            }
+        }
+    }
+}
+
+/// Scaled reads per filter and size: conversion included, no delta.
+fn benchScale(allocator: std.mem.Allocator) !void {
+    std.debug.print("scale: scaled + converted read, rgba8888 -> bgr888\n", .{});
+    const Size = struct { w: usize, h: usize };
+    const cases = [_]struct { from: Size, to: Size }{
+        .{ .from = .{ .w = 256, .h = 224 }, .to = .{ .w = 320, .h = 240 } },
+        .{ .from = .{ .w = 640, .h = 480 }, .to = .{ .w = 320, .h = 240 } },
+        .{ .from = .{ .w = 1280, .h = 960 }, .to = .{ .w = 640, .h = 480 } },
+        .{ .from = .{ .w = 320, .h = 240 }, .to = .{ .w = 640, .h = 480 } },
+    };
+    for (cases) |case| {
+        const data = try allocator.alloc(u8, case.from.w * case.from.h * 4);
+        defer allocator.free(data);
+        const out = try allocator.alloc(u8, case.to.w * case.to.h * 3);
+        defer allocator.free(out);
+        var prng = std.Random.DefaultPrng.init(0x7363);
+        prng.random().bytes(data);
+
+        std.debug.print("  {d}x{d} -> {d}x{d}\n", .{ case.from.w, case.from.h, case.to.w, case.to.h });
+        for (std.enums.values(gmz.ingest.Filter)) |f| {
+            var source = gmz.ingest.Source.init(data, .rgba8888, case.from.w, .bgr888).?;
+            source.scale = .{ .width = case.to.w, .height = case.to.h, .filter = f };
+            source.read(0, out);
+            var timer = try std.time.Timer.start();
+            for (0..iterations) |_| source.read(0, out);
+            const ns = @as(f64, @floatFromInt(timer.read())) / iterations;
+            const mpx = @as(f64, @floatFromInt(case.to.w * case.to.h)) / ns * 1000;
+            std.debug.print("    {s:<8} {d:>8.1} us/frame  {d:>7.1} Mpx/s\n", .{ @tagName(f), ns / std.time.ns_per_us, mpx });
+        }
+    }
+}
@@ -21,6 +21,7 @@ pub fn build(b: *std.Build) void {
     });
     mod.addImport("lz4", lz4_dep.module("lz4"));
     mod.addOptions("build_options", options);
+    addIsaVariants(b, mod, target, optimize);
 
     // Static library
     const lib = b.addLibrary(.{
@@ -39,6 +40,7 @@ pub fn build(b: *std.Build) void {
     });
     shared_mod.addImport("lz4", lz4_dep.module("lz4"));
     shared_mod.addOptions("build_options", options);
+    addIsaVariants(b, shared_mod, target, optimize);
     const shared_lib = b.addLibrary(.{
         .name = "groovy-mister-zig-shared",
         .linkage = .dynamic,
@@ -64,6 +66,47 @@ pub fn build(b: *std.Build) void {
     const test_step = b.step("test", "Run unit tests");
     test_step.dependOn(&run_tests.step);
 
+    // Benchmarks: always ReleaseFast so the numbers mean something
+    const bench_lz4 = b.dependency("lz4", .{ .target = target, .optimize = .ReleaseFast });
+    const bench_lib_mod = b.createModule(.{
+        .root_source_file = b.path("src/root.zig"),
+        .target = target,
+        .optimize = .ReleaseFast,
+        .stack_check = false,
+    });
+    bench_lib_mod.addImport("lz4", bench_lz4.module("lz4"));
+    bench_lib_mod.addOptions("build_options", options);
+    addIsaVariants(b, bench_lib_mod, target, .ReleaseFast);
+    const bench_exe = b.addExecutable(.{
+        .name = "gmz-bench",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("bench/bench.zig"),
+            .target = target,
+            .optimize = .ReleaseFast,
+            .imports = &.{.{ .name = "groovy_mister", .module = bench_lib_mod }},
+        }),
+    });
+    const run_bench = b.addRunArtifact(bench_exe);
+    if (b.args) |args| run_bench.addArgs(args);
+    const bench_step = b.step("bench", "Run performance benchmarks (ReleaseFast)");
+    bench_step.dependOn(&run_bench.step);
+
+    // Shared-memory ingest daemon (Linux only: memfd, eventfd, SCM_RIGHTS)
+    const daemon_exe = b.addExecutable(.{
+        .name = "gmz-daemon",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("daemon/main.zig"),
+            .target = target,
+            .optimize = optimize,
+            .imports = &.{.{ .name = "groovy_mister", .module = mod }},
+        }),
+    });
+    if (target.result.os.tag == .linux) b.installArtifact(daemon_exe);
+    const run_daemon = b.addRunArtifact(daemon_exe);
+    if (b.args) |args| run_daemon.addArgs(args);
+    const daemon_step = b.step("daemon", "Run the shared-memory ingest daemon (Linux)");
+    daemon_step.dependOn(&run_daemon.step);
+
     // Cross-compilation targets
     const cross_targets = [_]std.Target.Query{
         .{ .cpu_arch = .x86_64, .os_tag = .linux, .abi = .gnu },
@@ -101,6 +144,7 @@ pub fn build(b: *std.Build) void {
         });
         cross_mod.addImport("lz4", cross_lz4.module("lz4"));
         cross_mod.addOptions("build_options", options);
+        addIsaVariants(b, cross_mod, cross_target, optimize);
         const cross_static = b.addLibrary(.{
             .name = "groovy-mister-zig",
             .linkage = .static,
@@ -121,6 +165,7 @@ pub fn build(b: *std.Build) void {
         });
         cross_shared_mod.addImport("lz4", cross_lz4.module("lz4"));
         cross_shared_mod.addOptions("build_options", options);
+        addIsaVariants(b, cross_shared_mod, cross_target, optimize);
         const cross_shared = b.addLibrary(.{
             .name = "groovy-mister-zig-shared",
             .linkage = .dynamic,
@@ -142,3 +187,48 @@ pub fn build(b: *std.Build) void {
         cross_step.dependOn(&install_shared.step);
     }
 }
+
+/// CPU models the hot kernels are additionally compiled for on x86_64.
+/// `src/isa.zig` picks the widest one the host supports at runtime, so one
+/// baseline binary still gets AVX2 / AVX-512 code paths.
+const isa_variants = [_]struct { name: []const u8, model: *const std.Target.Cpu.Model }{
+    .{ .name = "x86_64_v3", .model = &std.Target.x86.cpu.x86_64_v3 },
+    .{ .name = "x86_64_v4", .model = &std.Target.x86.cpu.x86_64_v4 },
+};
+
+/// Link the ISA variant objects into `m` (x86_64 only) and tell `isa.zig`
+/// whether they are present.
+fn addIsaVariants(b: *std.Build, m: *std.Build.Module, target: std.Build.ResolvedTarget, optimize: std.builtin.OptimizeMode) void {
+    const is_x86_64 = target.result.cpu.arch == .x86_64;
+    const isa_options = b.addOptions();
+    isa_options.addOption(bool, "x86_variants", is_x86_64);
+    m.addOptions("isa_build", isa_options);
+    if (!is_x86_64) return;
+
+    // The variants' kernels reach `isa.zig` through `ingest.zig`; inside a
+    // variant object every dispatch resolves to the variant itself.
+    const variant_isa_options = b.addOptions();
+    variant_isa_options.addOption(bool, "x86_variants", false);
+
+    for (isa_variants) |variant| {
+        var query = target.query;
+        query.cpu_model = .{ .explicit = variant.model };
+        query.cpu_features_add = .empty;
+        query.cpu_features_sub = .empty;
+        const variant_options = b.addOptions();
+        variant_options.addOption([]const u8, "name", variant.name);
+        const variant_mod = b.createModule(.{
+            .root_source_file = b.path("src/isa_variant.zig"),
+            .target = b.resolveTargetQuery(query),
+            .optimize = optimize,
+            .stack_check = false,
+            .pic = true,
+        });
+        variant_mod.addOptions("isa_variant", variant_options);
+        variant_mod.addOptions("isa_build", variant_isa_options);
+        m.addObject(b.addObject(.{
+            .name = b.fmt("gmz-kernels-{s}", .{variant.name}),
+            .root_module = variant_mod,
+        }));
+    }
+}
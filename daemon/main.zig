@@ -0,0 +1,162 @@
+//! gmz-daemon: shared-memory ingest for multi-process hosts. Not part of
+//! the library.
+//!
+//! Run with `zig build daemon -- [socket-path]` (default
+//! /tmp/gmz-daemon.sock). Each host process attaches with `gmz_shm_open`,
+//! which hands over a shared-memory ring and an eventfd; the daemon opens
+//! the connection to the MiSTer and runs one pacing/convert/compress/send
+//! thread per stream, so the host's render loop never blocks on the network.
+
+const std = @import("std");
+const gmz = @import("groovy_mister");
+
+const posix = std.posix;
+const c_api = gmz.c_api;
+const ShmRing = gmz.ShmRing;
+
+comptime {
+    if (!ShmRing.supported) @compileError("gmz-daemon needs Linux (memfd, eventfd, SCM_RIGHTS)");
+}
+
+/// Largest audio chunk handed to `gmz_submit_audio` at once.
+const audio_chunk = 4096;
+
+/// How long an idle stream sleeps before checking the socket again.
+const idle_poll_ms = 100;
+
+pub fn main() !void {
+    var args = std.process.args();
+    _ = args.skip();
+    const path = args.next() orelse ShmRing.default_socket_path;
+
+    posix.unlink(path) catch {};
+    const listener = try posix.socket(posix.AF.UNIX, posix.SOCK.STREAM | posix.SOCK.CLOEXEC, 0);
+    defer posix.close(listener);
+    const addr = try std.net.Address.initUnix(path);
+    try posix.bind(listener, &addr.any, addr.getOsSockLen());
+    try posix.listen(listener, 16);
+    std.log.info("listening on {s}", .{path});
+
+    while (true) {
+        const sock = posix.accept(listener, null, null, posix.SOCK.CLOEXEC) catch |err| {
+            std.log.warn("accept: {s}", .{@errorName(err)});
+            continue;
+        };
+        const thread = std.Thread.spawn(.{}, serve, .{sock}) catch |err| {
+            std.log.warn("spawn: {s}", .{@errorName(err)});
+            posix.close(sock);
+            continue;
+        };
+        thread.detach();
+    }
+}
+
+/// Run one host stream until the host hangs up.
+fn serve(sock: posix.socket_t) void {
+    defer posix.close(sock);
+    const fds = ShmRing.recvFds(sock) catch |err| {
+        std.log.warn("handshake: {s}", .{@errorName(err)});
+        return;
+    };
+    defer posix.close(fds[1]);
+    var ring = ShmRing.open(fds[0]) catch |err| {
+        std.log.warn("ring: {s}", .{@errorName(err)});
+        posix.close(fds[0]);
+        return;
+    };
+    defer ring.deinit();
+
+    var stream = Stream.init(&ring, sock, fds[1]) catch |err| {
+        std.log.warn("connect: {s}", .{@errorName(err)});
+        return;
+    };
+    defer stream.deinit();
+    stream.run();
+}
+
+const Stream = struct {
+    ring: *ShmRing,
+    sock: posix.socket_t,
+    efd: posix.fd_t,
+    conn: *c_api.ConnHandle,
+    format: u8,
+    /// Slot the daemon holds (the triple buffer's front).
+    front: u32 = 2,
+    mode_seq: u32 = 0,
+    /// Set once a modeline is applied; frames before that are dropped.
+    paced: bool = false,
+
+    fn init(ring: *ShmRing, sock: posix.socket_t, efd: posix.fd_t) !Stream {
+        // The header is writable by the host: work from the copy `open` took.
+        const config = ring.config;
+        const host_len = std.mem.indexOfScalar(u8, &config.host, 0) orelse return error.BadHost;
+        var host: [config.host.len:0]u8 = undefined;
+        @memcpy(host[0..host_len], config.host[0..host_len]);
+        host[host_len] = 0;
+        _ = std.meta.intToEnum(gmz.ingest.PixelFormat, config.format) catch return error.BadFormat;
+        const conn = c_api.gmz_connect_ex(&host, config.mtu, config.rgb_mode, config.sound_rate, config.sound_channels, config.lz4_mode) orelse return error.ConnectFailed;
+        return .{ .ring = ring, .sock = sock, .efd = efd, .conn = conn, .format = config.format };
+    }
+
+    fn deinit(self: *Stream) void {
+        c_api.gmz_disconnect(self.conn);
+    }
+
+    fn run(self: *Stream) void {
+        while (true) {
+            if (self.ring.modeChanged(&self.mode_seq)) |mode| self.applyMode(mode);
+            self.drainAudio();
+            if (self.ring.pending()) {
+                if (self.paced and c_api.gmz_begin_frame(self.conn) == 2) continue;
+                self.sendNewest();
+                continue;
+            }
+            if (!self.wait()) return;
+        }
+    }
+
+    fn applyMode(self: *Stream, mode: ShmRing.Mode) void {
+        var m = c_api.gmz_modeline_t{};
+        inline for (std.meta.fields(c_api.gmz_modeline_t)) |f| {
+            if (comptime !std.mem.eql(u8, f.name, "_pad")) @field(m, f.name) = @field(mode, f.name);
+        }
+        self.paced = c_api.gmz_set_modeline(self.conn, &m) == 0;
+    }
+
+    fn drainAudio(self: *Stream) void {
+        while (true) {
+            const pieces = self.ring.readableAudio();
+            const chunk = pieces[0][0..@min(pieces[0].len, audio_chunk)];
+            if (chunk.len == 0) return;
+            _ = c_api.gmz_submit_audio(self.conn, chunk.ptr, chunk.len);
+            self.ring.consumeAudio(chunk.len);
+        }
+    }
+
+    /// Take the newest published frame (older ones were overwritten) and send it.
+    fn sendNewest(self: *Stream) void {
+        const slot_index = self.ring.take(self.front) orelse return;
+        self.front = slot_index;
+        if (!self.paced) return;
+        const info = self.ring.header.slots[slot_index];
+        const slot = self.ring.slot(slot_index);
+        if (info.len > slot.len) return;
+        _ = c_api.gmz_submit_format(self.conn, slot.ptr, info.len, self.format, info.frame, info.field, info.vsync_line, 0);
+    }
+
+    /// Sleep until the host signals; false once it has hung up.
+    fn wait(self: *Stream) bool {
+        var fds = [_]posix.pollfd{
+            .{ .fd = self.efd, .events = posix.POLL.IN, .revents = 0 },
+            .{ .fd = self.sock, .events = posix.POLL.IN, .revents = 0 },
+        };
+        _ = posix.poll(&fds, idle_poll_ms) catch return false;
+        // The host never writes to the socket: any activity is the hangup.
+        if (fds[1].revents != 0) return false;
+        if (fds[0].revents & posix.POLL.IN != 0) {
+            var counter: u64 = undefined;
+            _ = posix.read(self.efd, std.mem.asBytes(&counter)) catch {};
+        }
+        return true;
+    }
+};
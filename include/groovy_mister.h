@@ -63,6 +63,62 @@ typedef struct {
     uint64_t dropped_frames;     ///< Monotonic counter of real frame-level drops from the pacer.
 } gmz_state_t;
 
+/// Delta compressor counters returned by gmz_compress_stats.
+typedef struct {
+    uint64_t keyframes;          ///< Full (non-delta) frames sent.
+    uint64_t delta_frames;       ///< Delta frames sent.
+    uint64_t scene_cuts;         ///< Keyframes forced by the scene-cut estimator.
+    uint64_t dual_keyframe_wins; ///< Dual-candidate frames sent as keyframes because they were smaller.
+    uint64_t forced_keyframes;   ///< Keyframes forced by loss detection or gmz_force_keyframe.
+    uint64_t lost_frames;        ///< Frames detected as not applied (echo gap, frameskip, echo timeout).
+    uint64_t near_lossless_frames; ///< Delta frames coded with the near-lossless threshold.
+    uint64_t exact_refreshes;    ///< Near-lossless delta frames coded exactly on schedule.
+    uint64_t cache_hits;         ///< Keyframes resent from the frame cache without compression.
+    uint64_t cache_misses;       ///< Frame cache lookups that found nothing.
+    uint64_t cache_bytes_saved;  ///< Frame bytes whose compression was skipped by cache hits.
+} gmz_compress_stats_t;
+
+/// Embedder memory hook for gmz_set_allocator. alloc returns at least size
+/// bytes aligned to alignment (or NULL); free receives the pointer and the
+/// size passed to alloc.
+typedef struct {
+    void *ctx;
+    void *(*alloc)(void *ctx, size_t size, size_t alignment);
+    void (*free)(void *ctx, void *ptr, size_t size);
+} gmz_allocator_t;
+
+/// Pipeline stage timings returned by gmz_pipeline_stats (moving averages).
+typedef struct {
+    uint64_t frames;          ///< Frames sent through the pipeline.
+    double   avg_compress_us; ///< Worker time to compress one frame.
+    double   avg_send_us;     ///< Time to send one frame's packets.
+    double   avg_stall_us;    ///< Time gmz_submit waited for the worker.
+    uint8_t  depth;           ///< Frames in flight (0 = pipelining disabled).
+    uint8_t  _pad[7];
+} gmz_pipeline_stats_t;
+
+/// Audio buffer levels and latency returned by gmz_audio_stats. Durations
+/// are estimates: downstream audio is bytes sent minus what the FPGA has
+/// played at the session rate while reporting audio_active.
+typedef struct {
+    double   latency_ms;    ///< Queued + downstream, at the last frame boundary.
+    double   ring_ms;       ///< Queued in the library's ring, not yet sent.
+    double   fpga_ms;       ///< Sent, not yet played (in flight + HPS buffer), at the last frame boundary.
+    uint64_t bytes_sent;    ///< PCM bytes sent this session.
+    uint64_t underruns;     ///< Times the FPGA ran out of audio while playing.
+    uint64_t overruns;      ///< gmz_audio_write* calls cut short by a full ring.
+    uint32_t histogram[16]; ///< Latency samples in 10 ms buckets (last: 150 ms+).
+} gmz_audio_stats_t;
+
+/// RGB mode transition reported by gmz_poll_format_event.
+typedef struct {
+    uint32_t frame;     ///< Pacer frame count when the transition happened.
+    uint8_t  rgb_mode;  ///< RGB mode now on the wire.
+    uint8_t  fallback;  ///< 1 = fell back from the host's mode, 0 = restored.
+    uint8_t  failed;    ///< 1 = the switch failed; rgb_mode is still in effect.
+    uint8_t  _pad;
+} gmz_format_event_t;
+
 /// Connect to FPGA and send CMD_INIT. Returns handle or NULL on failure.
 /// sound_rate: 0=off, 1=22050, 2=44100, 3=48000
 /// sound_channels: 0=off, 1=mono, 2=stereo
@@ -70,8 +126,8 @@ gmz_conn_t gmz_connect(const char *host, uint16_t mtu, uint8_t rgb_mode,
                         uint8_t sound_rate, uint8_t sound_channels);
 
 /// Connect to FPGA with optional LZ4 compression and send CMD_INIT.
-/// When lz4_mode > 0, allocates a compression buffer internally.
-/// Returns handle or NULL on failure.
+/// When lz4_mode > 0, compression buffers are allocated internally, sized
+/// from the modeline by gmz_set_modeline. Returns handle or NULL on failure.
 gmz_conn_t gmz_connect_ex(const char *host, uint16_t mtu, uint8_t rgb_mode,
                            uint8_t sound_rate, uint8_t sound_channels,
                            uint8_t lz4_mode);
@@ -82,19 +138,226 @@ void gmz_disconnect(gmz_conn_t conn);
 /// Poll for ACKs, record vram_ready, and return combined FPGA status + health.
 gmz_state_t gmz_tick(gmz_conn_t conn);
 
-/// Send CMD_SWITCHRES with the given modeline. Returns 0 on success, -1 on error.
+/// Send CMD_SWITCHRES with the given modeline. On compressed connections this
+/// also sizes the frame buffers for the mode (one field when interlaced);
+/// larger frames are then rejected by gmz_submit. Returns 0 on success, -1 on error.
 int gmz_set_modeline(gmz_conn_t conn, const gmz_modeline_t *modeline);
 
+/// Supply the memory for the connection's frame buffer slab (compress output,
+/// delta references, pipeline slots), or pass NULL to use OS pages (2MB huge
+/// pages where available). Buffers are re-carved immediately; delta references
+/// carry over. The hook must stay valid until gmz_disconnect. On allocation
+/// failure the previous buffers and hook stay in use.
+/// Returns 0 on success, -1 on error.
+int gmz_set_allocator(gmz_conn_t conn, const gmz_allocator_t *allocator);
+
+/// Configure delta keyframe scheduling (delta modes only).
+/// interval: preferred frames between keyframes (0 = no periodic keyframes).
+/// max_interval: upper bound for deferring a due keyframe through static content.
+/// scene_cut_ratio: sampled fraction of changed bytes (0.0-1.0) that forces an
+/// immediate keyframe; 0 disables scene-cut detection.
+/// Defaults: 300, 900, 0.5. Returns 0 on success, -1 on error.
+int gmz_set_keyframe_policy(gmz_conn_t conn, uint32_t interval,
+                            uint32_t max_interval, float scene_cut_ratio);
+
+/// Enable (1) or disable (0) dual-candidate encoding (delta modes only).
+/// Each delta frame is also compressed as a keyframe on a second worker thread
+/// and the smaller encoding is sent. budget_us pauses dual encoding while the
+/// last dual encode took longer than this (0 = no limit).
+/// Returns 0 on success, -1 on error.
+int gmz_set_dual_encode(gmz_conn_t conn, uint8_t enable, uint32_t budget_us);
+
+/// Near-lossless delta coding for noisy sources (delta modes only). Pixel
+/// channels that moved by less than threshold (8-bit units) since the FPGA's
+/// last reconstruction are sent unchanged, so the error stays below threshold
+/// and never accumulates. Every exact_interval delta frames per field are
+/// coded exactly (0 = only keyframes). threshold 0 restores exact coding.
+/// Returns 0 on success, -1 on error.
+int gmz_set_near_lossless(gmz_conn_t conn, uint8_t threshold, uint32_t exact_interval);
+
+/// Cache compressed keyframes of recurring screens (menus, pause screens,
+/// attract loops) in up to budget_bytes, least recently used evicted first.
+/// A frame due as a keyframe that matches a cached screen is resent as that
+/// keyframe without compressing. 0 disables and frees the cache (delta modes only).
+/// Returns 0 on success, -1 on error.
+int gmz_set_frame_cache(gmz_conn_t conn, size_t budget_bytes);
+
+/// Set the number of threads (including the caller) that split the delta pass
+/// into scanline bands. 0 picks a default from the CPU count, 1 runs serially.
+/// Worker threads are shared with dual encoding.
+/// Returns 0 on success, -1 on error (null handle or non-delta connection).
+int gmz_set_workers(gmz_conn_t conn, uint8_t threads);
+
+/// Make the next frame for field (0 or 1) a keyframe; field < 0 means both.
+/// The library already does this when ACK feedback shows a lost frame.
+/// Returns 0 on success, -1 on error (null handle or non-delta connection).
+int gmz_force_keyframe(gmz_conn_t conn, int field);
+
+/// Read delta compressor counters. Null-safe (returns zeroed stats).
+gmz_compress_stats_t gmz_compress_stats(gmz_conn_t conn);
+
+/// Enable pipelined compression with depth frames in flight (2-4), or disable
+/// it with 0. gmz_submit then copies the frame, compresses it on a worker
+/// thread, and sends the previously compressed frame, adding up to depth-1
+/// frames of latency. Requires a compressed connection (gmz_connect_ex).
+/// Returns 0 on success, -1 on error.
+int gmz_set_pipeline(gmz_conn_t conn, uint8_t depth);
+
+/// Read pipeline stage timings. Null-safe (returns zeroed stats).
+gmz_pipeline_stats_t gmz_pipeline_stats(gmz_conn_t conn);
+
 /// Send frame data to FPGA and record sync timing. Returns 0 on success, -1 on error.
 int gmz_submit(gmz_conn_t conn, const uint8_t *data, size_t len,
                uint32_t frame, uint8_t field, uint16_t vsync_line,
                double sync_wait_ms);
 
+/// Host pixel formats accepted by gmz_submit_format (byte order in memory).
+#define GMZ_PIXEL_BGR888   0
+#define GMZ_PIXEL_BGRA8888 1
+#define GMZ_PIXEL_RGB565   2
+#define GMZ_PIXEL_RGB888   3
+#define GMZ_PIXEL_RGBA8888 4
+#define GMZ_PIXEL_ARGB8888 5
+#define GMZ_PIXEL_ABGR8888 6
+
+/// Send a frame in host pixel format (GMZ_PIXEL_*), converted to the
+/// connection's RGB mode as it is read instead of in a separate pass. Rows
+/// are the modeline's h_active wide. Returns 0 on success, -1 on error
+/// (null handle, unknown format, partial rows, or send failure).
+int gmz_submit_format(gmz_conn_t conn, const uint8_t *data, size_t len,
+                      uint8_t format, uint32_t frame, uint8_t field,
+                      uint16_t vsync_line, double sync_wait_ms);
+
+/// Send the w x h rectangle at column x, row y of a framebuffer at base whose
+/// rows are pitch bytes apart, in host pixel format (GMZ_PIXEL_*), without
+/// repacking it first. Raw frames in the connection's RGB mode are gathered
+/// from the rows into datagrams without a copy. Returns 0 on success, -1 on
+/// error (null handle, unknown format, rectangle wider than pitch, or send
+/// failure).
+int gmz_submit_strided(gmz_conn_t conn, const uint8_t *base, size_t pitch,
+                       uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                       uint8_t format, uint32_t frame, uint8_t field,
+                       uint16_t vsync_line, double sync_wait_ms);
+
+/// One buffer of a gmz_submit_iov frame (laid out like struct iovec).
+typedef struct {
+    const uint8_t *base;
+    size_t len;
+} gmz_iovec_t;
+
+/// Send a frame held in iovcnt (at most 64) buffers, in order, as if they
+/// were one contiguous gmz_submit frame. Raw frames are gathered from the
+/// buffers into datagrams without a copy; compressed frames are gathered
+/// once. Returns 0 on success, -1 on error (null handle, too many buffers,
+/// null base with a length, or send failure).
+int gmz_submit_iov(gmz_conn_t conn, const gmz_iovec_t *iov, size_t iovcnt,
+                   uint32_t frame, uint8_t field, uint16_t vsync_line,
+                   double sync_wait_ms);
+
+/// Get a library-owned, cache-aligned buffer to render the next frame into,
+/// in the connection's RGB mode: *ptr is its first byte, *pitch the bytes per
+/// row. Acquiring again before gmz_commit_frame returns the same buffer.
+/// gmz_set_modeline, gmz_set_pipeline, gmz_set_allocator and an RGB mode
+/// fallback invalidate it. Returns 0 on success, -1 on error (null handle or
+/// pointer, no modeline, or allocation failure).
+int gmz_acquire_frame(gmz_conn_t conn, uint8_t **ptr, size_t *pitch);
+
+/// Send the frame rendered into the acquired buffer without copying it; in
+/// delta modes it becomes the reference in place. The buffer must not be
+/// touched afterwards. Returns 0 on success, -1 on error (null handle, no
+/// acquired buffer, or send failure).
+int gmz_commit_frame(gmz_conn_t conn, uint32_t frame, uint8_t field,
+                     uint16_t vsync_line);
+
+/// Enable (1) or disable (0) the bandwidth fallback. When sends, sync round
+/// trips or backpressure skips observed by gmz_begin_frame show the link
+/// cannot carry the session's RGB mode, the session re-INITs with RGB565 and
+/// submitted frames are converted and dithered. It steps back up after
+/// stable_frames clean frames (0 = 600), twice as long after each restore
+/// that quickly falls back again. Disabling while fallen back restores the
+/// host's mode. Returns 0 on success, -1 on error (null handle or an RGB565
+/// connection).
+int gmz_set_format_policy(gmz_conn_t conn, uint8_t enabled, uint32_t stable_frames);
+
+/// Pop the oldest unread RGB mode transition. Returns 1 when *out was
+/// filled, 0 when there is none, -1 on error.
+int gmz_poll_format_event(gmz_conn_t conn, gmz_format_event_t *out);
+
+/// Scaling filters for gmz_set_scaler.
+#define GMZ_SCALE_NONE    0
+#define GMZ_SCALE_NEAREST 1
+#define GMZ_SCALE_INTEGER 2  ///< Whole-number ratio, centred on black.
+#define GMZ_SCALE_BOX     3
+
+/// Scale gmz_submit_strided rectangles whose size differs from the
+/// modeline's active area (one field when interlaced) to fit it, during
+/// conversion, with a GMZ_SCALE_* filter. Returns 0 on success, -1 on error.
+int gmz_set_scaler(gmz_conn_t conn, uint8_t filter);
+
+/// Enable (1) or disable (0) 4x4 ordered dithering when gmz_submit_format
+/// converts 8-bit channels to RGB565. The pattern is fixed to screen position,
+/// so static content stays static for delta compression. Returns 0 on
+/// success, -1 on null handle.
+int gmz_set_dither(gmz_conn_t conn, uint8_t enabled);
+
 /// Send raw PCM audio data to FPGA. Returns 0 on success, -1 on error.
 /// data: raw 16-bit signed PCM (interleaved if stereo).
 /// len: total byte count of PCM data.
 int gmz_submit_audio(gmz_conn_t conn, const uint8_t *data, size_t len);
 
+/// Queue 16-bit PCM (interleaved if stereo) of any length. gmz_begin_frame
+/// and gmz_tick send it, paced to the session's sound rate and split into
+/// CMD_AUDIO packets. Lock-free and never blocks, so an audio thread may
+/// call it while another thread streams frames; what doesn't fit in the
+/// ring (about 250 ms) is dropped. Returns the bytes queued (whole sample
+/// frames); 0 on null handle or a session without audio.
+size_t gmz_audio_write(gmz_conn_t conn, const uint8_t *pcm, size_t len);
+
+/// Bytes queued by gmz_audio_write and not yet sent. capacity (optional)
+/// receives the ring size. Returns 0 on null handle or no audio.
+size_t gmz_audio_fill(gmz_conn_t conn, size_t *capacity);
+
+/// Host audio sample formats for gmz_audio_write_format (little-endian;
+/// floats are full scale at +-1.0).
+#define GMZ_SAMPLE_S16 0
+#define GMZ_SAMPLE_S32 1
+#define GMZ_SAMPLE_F32 2
+
+/// Like gmz_audio_write for audio in another sample format (GMZ_SAMPLE_*)
+/// or channel count (1 or 2): frames interleaved frames are converted with
+/// SIMD and saturation straight into the ring. Mono is duplicated to stereo
+/// sessions, stereo averaged to mono ones. Returns the frames queued; 0 on
+/// error (null handle, bad format or channel count, no audio).
+size_t gmz_audio_write_format(gmz_conn_t conn, const uint8_t *data,
+                              size_t frames, uint8_t format, uint8_t channels);
+
+/// gmz_audio_write_format for planar audio: planes[c] holds channel c's
+/// frames samples. Returns the frames queued.
+size_t gmz_audio_write_planar(gmz_conn_t conn, const uint8_t *const *planes,
+                              uint8_t channels, size_t frames, uint8_t format);
+
+/// Enable (1) or disable (0) TPDF dither when s32/f32 audio is reduced to
+/// 16 bits. Returns 0 on success, -1 on null handle.
+int gmz_set_audio_dither(gmz_conn_t conn, uint8_t enabled);
+
+/// Read audio buffer levels, the latency estimate, underrun/overrun counts
+/// and the latency histogram (sampled by gmz_begin_frame and gmz_tick).
+/// Safe from any thread: returns a consistent snapshot from the last frame
+/// boundary, plus the live ring level. Null-safe (returns zeroed stats).
+gmz_audio_stats_t gmz_audio_stats(gmz_conn_t conn);
+
+/// Enable (1) or disable (0) audio drift compensation: gmz_audio_write
+/// resamples by a ratio within 0.5% of 1, steered once per frame
+/// (gmz_begin_frame, gmz_tick) so the audio written but not yet played by the
+/// FPGA stays target_ms (0 = 30 ms) beyond the send lead. Call before audio
+/// starts. Returns 0 on success, -1 on error (null handle, no audio, or
+/// allocation failure).
+int gmz_set_audio_resample(gmz_conn_t conn, uint8_t enabled, uint32_t target_ms);
+
+/// Current drift compensation ratio (input frames per queued frame; above 1
+/// when the host produces faster than the FPGA plays). 1.0 when disabled.
+double gmz_audio_ratio(gmz_conn_t conn);
+
 /// Block until ACK received or timeout. Returns 0=ACK, 1=timeout, -1=null handle.
 int gmz_wait_sync(gmz_conn_t conn, int timeout_ms);
 
@@ -115,6 +378,11 @@ uint32_t gmz_version_minor(void);
 /// Return the library patch version number.
 uint32_t gmz_version_patch(void);
 
+/// Return the ISA variant the delta kernels run on: "baseline",
+/// "x86_64_v3" (AVX2) or "x86_64_v4" (AVX-512). Chosen from the host CPU
+/// on first use.
+const char *gmz_kernel_variant(void);
+
 /// Get raster time offset in nanoseconds for the given submitted frame.
 /// Positive = FPGA is behind (need to wait), negative = running late.
 /// Calls poll() internally to get latest ACK. Returns 0 if no modeline set.
@@ -131,6 +399,58 @@ uint16_t gmz_calc_vsync(gmz_conn_t conn, uint32_t margin_ns,
 /// Get frame period in nanoseconds from current modeline. 0 if no modeline set.
 uint64_t gmz_frame_time_ns(gmz_conn_t conn);
 
+/* --- Shared-memory client (gmz-daemon, Linux only) --- */
+
+/// Opaque handle to a gmz-daemon stream.
+typedef struct gmz_shm *gmz_shm_t;
+
+/// Stream settings for gmz_shm_open. host..lz4_mode are the connection
+/// gmz-daemon opens (as gmz_connect_ex); format is the GMZ_PIXEL_* format
+/// frames are written in; max_width x max_height sizes the frame slots;
+/// audio_bytes sizes the audio ring (a power of two, 0 = no audio).
+typedef struct {
+    const char *host;
+    uint16_t mtu;
+    uint8_t rgb_mode;
+    uint8_t sound_rate;
+    uint8_t sound_channels;
+    uint8_t lz4_mode;
+    uint8_t format;
+    uint8_t _pad;
+    uint16_t max_width;
+    uint16_t max_height;
+    uint32_t audio_bytes;
+} gmz_shm_config_t;
+
+/// Attach to gmz-daemon at socket_path (NULL = /tmp/gmz-daemon.sock) and
+/// hand it a shared-memory ring; the daemon paces, converts, compresses and
+/// sends what this process writes. Returns handle or NULL (bad settings, no
+/// daemon, or not Linux).
+gmz_shm_t gmz_shm_open(const char *socket_path, const gmz_shm_config_t *cfg);
+
+/// Detach from the daemon (it disconnects the stream) and free the handle.
+/// Null-safe.
+void gmz_shm_close(gmz_shm_t client);
+
+/// Set the stream's modeline. Returns 0 on success, -1 on error (null handle
+/// or a frame larger than max_width x max_height).
+int gmz_shm_set_modeline(gmz_shm_t client, const gmz_modeline_t *m);
+
+/// Get the shared slot to render the next frame into: *ptr is its first
+/// byte, *pitch the bytes per row. Returns 0 on success, -1 on error (null
+/// handle or pointer, or no modeline).
+int gmz_shm_acquire_frame(gmz_shm_t client, uint8_t **ptr, size_t *pitch);
+
+/// Publish the acquired slot and wake the daemon. Never blocks; a frame the
+/// daemon had no time for is replaced by the next. Returns 0 on success, -1
+/// on error (null handle or no acquired slot).
+int gmz_shm_commit_frame(gmz_shm_t client, uint32_t frame, uint8_t field,
+                         uint16_t vsync_line);
+
+/// Queue 16-bit PCM for the daemon. Never blocks; what doesn't fit in the
+/// audio ring is dropped. Returns the bytes queued.
+size_t gmz_shm_write_audio(gmz_shm_t client, const uint8_t *data, size_t len);
+
 /* --- Input (FPGA joystick/keyboard/mouse on UDP port 32101) --- */
 
 /// Opaque input handle.
@@ -181,6 +501,23 @@ typedef struct {
     uint8_t keys[32];     ///< 256-bit SDL scancode bitfield.
 } gmz_ps2_state_t;
 
+/// Input transition kinds (gmz_input_event_t.kind).
+#define GMZ_INPUT_JOY_DOWN   1  ///< Joystick button pressed (code = GMZ_JOY_* bit).
+#define GMZ_INPUT_JOY_UP     2  ///< Joystick button released.
+#define GMZ_INPUT_KEY_DOWN   3  ///< Key pressed (code = SDL scancode).
+#define GMZ_INPUT_KEY_UP     4  ///< Key released.
+#define GMZ_INPUT_MOUSE_DOWN 5  ///< Mouse button pressed (code: 0 left, 1 right, 2 middle).
+#define GMZ_INPUT_MOUSE_UP   6  ///< Mouse button released.
+
+/// One input transition, stamped with the host time its packet was received.
+typedef struct {
+    uint64_t time_ns;     ///< Host monotonic receive time.
+    uint32_t frame;       ///< FPGA frame counter of the packet.
+    uint8_t kind;         ///< GMZ_INPUT_*.
+    uint8_t player;       ///< Joystick events: player 0 or 1.
+    uint16_t code;        ///< Button bit, scancode, or mouse button.
+} gmz_input_event_t;
+
 /// Connect to FPGA input stream (joystick/keyboard/mouse on UDP port 32101).
 /// Sends a 1-byte hello to start receiving input state. Returns handle or NULL.
 gmz_input_t gmz_input_bind(const char *host);
@@ -188,15 +525,35 @@ gmz_input_t gmz_input_bind(const char *host);
 /// Close the input connection and free the handle. Null-safe.
 void gmz_input_close(gmz_input_t input);
 
+/// Start a background thread that receives input packets as they arrive and
+/// stamps each on arrival. gmz_input_joy/gmz_input_ps2 then return current
+/// state from any thread without polling; gmz_input_poll only reports whether
+/// anything new arrived. Stopped by gmz_input_close.
+/// Returns 0 on success (or already running), -1 on failure.
+int gmz_input_start_thread(gmz_input_t input);
+
 /// Poll for pending input packets. Returns 1 if new data received, 0 if none.
 int gmz_input_poll(gmz_input_t input);
 
-/// Read the latest joystick state. Null-safe (returns zeroed state).
+/// Read the latest joystick state. Lock-free from any thread (a read that
+/// overlaps an update retries).
+/// Null-safe (returns zeroed state).
 gmz_joy_state_t gmz_input_joy(gmz_input_t input);
 
-/// Read the latest PS/2 keyboard + mouse state. Null-safe (returns zeroed state).
+/// Read the latest PS/2 keyboard + mouse state. Lock-free from any thread
+/// (a read that overlaps an update retries).
+/// Null-safe (returns zeroed state).
 gmz_ps2_state_t gmz_input_ps2(gmz_input_t input);
 
+/// Drain up to `max` queued input transitions into `buf`, oldest first.
+/// Transitions are recorded as packets are polled, so presses shorter than
+/// the poll interval are not lost. Returns the count written. Null-safe.
+size_t gmz_input_events(gmz_input_t input, gmz_input_event_t *buf, size_t max);
+
+/// Count of transitions lost because the event queue (1024 entries) was full.
+/// Nonzero means gmz_input_events is not drained often enough. Null-safe.
+uint32_t gmz_input_events_dropped(gmz_input_t input);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,140 @@
+//! Audio buffer-level estimation. The FPGA only reports whether it is
+//! playing (`audio_active`), so the audio buffered past the socket (in
+//! flight and in the HPS buffer) is modelled: bytes sent, minus what the
+//! FPGA has played at the session's byte rate while `audio_active` was set.
+//!
+//! The estimate bottoms out at zero. Reaching zero while playing, or
+//! `audio_active` dropping with audio still expected, is an underrun.
+//! `sample` records the end-to-end latency (library ring plus downstream)
+//! into a histogram once per frame.
+
+const std = @import("std");
+const protocol = @import("protocol.zig");
+
+const AudioMeter = @This();
+
+/// Histogram buckets of `bucket_ms` each; the last holds everything above.
+pub const buckets = 16;
+pub const bucket_ms = 10;
+
+/// Bytes the FPGA plays per second (0 = no audio: everything is a no-op).
+byte_rate: u64 = 0,
+/// Bytes sent over the session.
+sent: u64 = 0,
+/// Bytes the FPGA is estimated to have played, as of `clock_ns`.
+played: u64 = 0,
+clock_ns: u64 = 0,
+/// `audio_active` from the last ACK.
+active: bool = false,
+/// The downstream buffer is empty: underrun already counted.
+dry: bool = true,
+
+/// Times the downstream buffer ran dry while playing.
+underruns: u64 = 0,
+/// Latency of the last `sample`, and the distribution of all samples.
+latency_ms: f64 = 0,
+histogram: [buckets]u32 = .{0} ** buckets,
+
+pub fn init(rate: protocol.SoundRate, channels: protocol.SoundChannels) AudioMeter {
+    return .{ .byte_rate = protocol.audioByteRate(rate, channels) };
+}
+
+/// Bytes played in `ns` nanoseconds.
+fn bytesIn(self: *const AudioMeter, ns: u64) u64 {
+    return @intCast(@as(u128, ns) * self.byte_rate / std.time.ns_per_s);
+}
+
+/// Bring `played` up to `now_ns`, noting an underrun if it passes `sent`.
+fn advance(self: *AudioMeter, now_ns: u64) void {
+    if (self.active) self.played += self.bytesIn(now_ns -| self.clock_ns);
+    self.clock_ns = @max(self.clock_ns, now_ns);
+    if (self.played >= self.sent) {
+        if (self.active and !self.dry) self.underruns += 1;
+        self.dry = true;
+        self.played = self.sent;
+    }
+}
+
+/// Record `n` bytes of PCM sent.
+pub fn onSent(self: *AudioMeter, n: usize, now_ns: u64) void {
+    if (self.byte_rate == 0 or n == 0) return;
+    self.advance(now_ns);
+    self.sent += n;
+    self.dry = false;
+}
+
+/// Track `audio_active` from an ACK.
+pub fn onAck(self: *AudioMeter, status: protocol.FpgaStatus, now_ns: u64) void {
+    if (self.byte_rate == 0) return;
+    self.advance(now_ns);
+    if (self.active and !status.audio_active) {
+        // The FPGA stopped: whatever the model holds was not there
+        if (!self.dry) self.underruns += 1;
+        self.dry = true;
+        self.played = self.sent;
+    }
+    self.active = status.audio_active;
+}
+
+/// Estimated bytes sent but not yet played.
+pub fn downstreamBytes(self: *const AudioMeter, now_ns: u64) u64 {
+    const playing = if (self.active) self.bytesIn(now_ns -| self.clock_ns) else 0;
+    return self.sent -| (self.played + playing);
+}
+
+pub fn bytesToMs(self: *const AudioMeter, bytes: u64) f64 {
+    if (self.byte_rate == 0) return 0;
+    return @as(f64, @floatFromInt(bytes)) * std.time.ms_per_s / @as(f64, @floatFromInt(self.byte_rate));
+}
+
+/// Record the latency of audio entering now: `queued` bytes not yet sent,
+/// plus the downstream estimate.
+pub fn sample(self: *AudioMeter, queued: usize, now_ns: u64) void {
+    if (self.byte_rate == 0) return;
+    self.latency_ms = self.bytesToMs(queued + self.downstreamBytes(now_ns));
+    const bucket: usize = @intFromFloat(@min(self.latency_ms / bucket_ms, buckets - 1));
+    self.histogram[bucket] +|= 1;
+}
+
+// --- Tests ---
+
+const ms = std.time.ns_per_ms;
+
+test "downstream estimate drains only while the FPGA plays" {
+    var m = AudioMeter.init(.rate_48000, .stereo);
+    m.onSent(19200, 0); // 100 ms
+    try std.testing.expectEqual(@as(u64, 19200), m.downstreamBytes(50 * ms));
+    m.onAck(.{ .audio_active = true }, 10 * ms);
+    try std.testing.expectEqual(@as(u64, 19200 - 7680), m.downstreamBytes(50 * ms));
+    try std.testing.expectApproxEqAbs(@as(f64, 60), m.bytesToMs(m.downstreamBytes(50 * ms)), 0.001);
+    try std.testing.expectEqual(@as(u64, 0), m.underruns);
+}
+
+test "running dry while playing counts one underrun" {
+    var m = AudioMeter.init(.rate_48000, .stereo);
+    m.onSent(1920, 0); // 10 ms
+    m.onAck(.{ .audio_active = true }, 0);
+    m.onAck(.{ .audio_active = true }, 20 * ms);
+    m.onAck(.{ .audio_active = true }, 30 * ms);
+    try std.testing.expectEqual(@as(u64, 1), m.underruns);
+    try std.testing.expectEqual(@as(u64, 0), m.downstreamBytes(30 * ms));
+    // Refilled, then the FPGA reports it stopped
+    m.onSent(19200, 31 * ms);
+    m.onAck(.{ .audio_active = false }, 32 * ms);
+    try std.testing.expectEqual(@as(u64, 2), m.underruns);
+}
+
+test "sample fills the latency histogram" {
+    var m = AudioMeter.init(.rate_48000, .mono);
+    m.onSent(960, 0); // 10 ms downstream
+    m.sample(2400, 0); // + 25 ms queued
+    try std.testing.expectApproxEqAbs(@as(f64, 35), m.latency_ms, 0.001);
+    try std.testing.expectEqual(@as(u32, 1), m.histogram[3]);
+    m.sample(1_000_000, 0);
+    try std.testing.expectEqual(@as(u32, 1), m.histogram[buckets - 1]);
+
+    var off = AudioMeter.init(.off, .off);
+    off.onSent(100, 0);
+    off.sample(100, 0);
+    try std.testing.expectEqual(@as(u64, 0), off.sent);
+}
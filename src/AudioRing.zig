@@ -0,0 +1,246 @@
+//! Library-owned PCM ring between the host's audio thread and the frame
+//! thread. The host appends with `write` whenever it has samples; the frame
+//! path calls `drain` at each frame boundary, which sends what the FPGA will
+//! have played by then plus a small lead, as CMD_AUDIO packets no larger
+//! than the u16 length field allows.
+//!
+//! Single producer, single consumer, no locks: `head` is only written by the
+//! producer and `tail` only by the consumer. Sending stays on the consumer
+//! (the thread that sends frames), so audio datagrams never land inside a
+//! frame's datagrams.
+
+const std = @import("std");
+const protocol = @import("protocol.zig");
+
+const AudioRing = @This();
+
+/// How far ahead of the playback clock audio is sent, absorbing frame
+/// thread jitter.
+pub const lead_ms = 40;
+
+/// Ring size in milliseconds of audio (rounded up to a power of two bytes).
+pub const capacity_ms = 250;
+
+buf: []u8,
+/// Total bytes written (producer) and sent (consumer); wrap at 2^32.
+head: u32 = 0,
+tail: u32 = 0,
+/// Bytes per sample frame (2 per channel).
+frame_bytes: u32,
+/// Bytes the FPGA plays per second.
+byte_rate: u64,
+/// Consumer-side playback clock: when sending (re)started and how much has
+/// been sent since.
+clock_start_ns: u64 = 0,
+clock_sent: u64 = 0,
+/// The last drain had less queued than was due: the host, not the frame
+/// thread, is behind.
+starved: bool = true,
+/// Writes that did not fit and were cut short (producer side, atomic).
+overruns: u32 = 0,
+
+/// Create a ring for `rate`/`channels`, or null when the session has no audio.
+pub fn init(allocator: std.mem.Allocator, rate: protocol.SoundRate, channels: protocol.SoundChannels) !?AudioRing {
+    const byte_rate = protocol.audioByteRate(rate, channels);
+    if (byte_rate == 0) return null;
+    const frame_bytes: u32 = 2 * @as(u32, @intFromEnum(channels));
+    const capacity = std.math.ceilPowerOfTwoAssert(usize, byte_rate * capacity_ms / std.time.ms_per_s);
+    return .{
+        .buf = try allocator.alloc(u8, capacity),
+        .frame_bytes = frame_bytes,
+        .byte_rate = byte_rate,
+    };
+}
+
+pub fn deinit(self: *AudioRing, allocator: std.mem.Allocator) void {
+    allocator.free(self.buf);
+}
+
+/// Bytes queued and not yet sent.
+pub fn fill(self: *const AudioRing) usize {
+    return @atomicLoad(u32, &self.head, .acquire) -% @atomicLoad(u32, &self.tail, .acquire);
+}
+
+// --- Producer ---
+
+/// Append whole sample frames of `pcm`; what doesn't fit is dropped.
+/// Returns the bytes queued.
+pub fn write(self: *AudioRing, pcm: []const u8) usize {
+    const pieces = self.reserve();
+    const n = @min(pcm.len, pieces[0].len + pieces[1].len) / self.frame_bytes * self.frame_bytes;
+    const first = @min(n, pieces[0].len);
+    @memcpy(pieces[0][0..first], pcm[0..first]);
+    @memcpy(pieces[1][0 .. n - first], pcm[first..n]);
+    self.commit(n);
+    if (n < pcm.len / self.frame_bytes * self.frame_bytes) self.countOverrun();
+    return n;
+}
+
+/// Record a write that was cut short.
+pub fn countOverrun(self: *AudioRing) void {
+    _ = @atomicRmw(u32, &self.overruns, .Add, 1, .monotonic);
+}
+
+/// The free space, in ring order, for writing in place (a converter filling
+/// it directly); both pieces are whole sample frames. Publish with `commit`.
+pub fn reserve(self: *AudioRing) [2][]u8 {
+    const head = @atomicLoad(u32, &self.head, .monotonic);
+    const tail = @atomicLoad(u32, &self.tail, .acquire);
+    const free = self.buf.len - (head -% tail);
+    const start = head & (self.buf.len - 1);
+    const first = @min(free, self.buf.len - start);
+    return .{ self.buf[start..][0..first], self.buf[0 .. free - first] };
+}
+
+/// Publish `n` bytes written at the start of the reserved space.
+pub fn commit(self: *AudioRing, n: usize) void {
+    const head = @atomicLoad(u32, &self.head, .monotonic);
+    @atomicStore(u32, &self.head, head +% @as(u32, @intCast(n)), .release);
+}
+
+// --- Consumer ---
+
+/// Largest CMD_AUDIO payload: the u16 length field, in whole sample frames.
+fn maxChunk(self: *const AudioRing) usize {
+    return std.math.maxInt(u16) / self.frame_bytes * self.frame_bytes;
+}
+
+/// Bytes that may be sent at `now_ns`: what the FPGA has played since the
+/// clock started, plus the lead, minus what was already sent. A late drain
+/// catches up; but when the FPGA ran dry because the host starved the ring,
+/// the clock restarts, so the samples that arrive late are not sent as a
+/// burst. Never more than the ring holds.
+pub fn due(self: *AudioRing, now_ns: u64) usize {
+    const played = self.bytesIn(now_ns -| self.clock_start_ns);
+    if (self.clock_sent < played and self.starved) {
+        self.clock_start_ns = now_ns;
+        self.clock_sent = 0;
+    }
+    const played_now = self.bytesIn(now_ns -| self.clock_start_ns);
+    const budget = @min((played_now + self.byte_rate * lead_ms / std.time.ms_per_s) -| self.clock_sent, self.buf.len);
+    return @intCast(budget / self.frame_bytes * self.frame_bytes);
+}
+
+/// Bytes played in `ns` nanoseconds.
+fn bytesIn(self: *const AudioRing, ns: u64) u64 {
+    return @intCast(@as(u128, ns) * self.byte_rate / std.time.ns_per_s);
+}
+
+/// Send the audio due at `now_ns` through `sink.sendAudio`, in chunks the
+/// CMD_AUDIO header can describe.
+pub fn drain(self: *AudioRing, now_ns: u64, sink: anytype) !void {
+    const queued = self.fill();
+    const allowed = self.due(now_ns);
+    self.starved = queued < allowed;
+    var budget = @min(allowed, queued);
+    const mask = self.buf.len - 1;
+    while (budget > 0) {
+        const tail = @atomicLoad(u32, &self.tail, .monotonic);
+        const start = tail & mask;
+        const n = @min(budget, self.buf.len - start, self.maxChunk());
+        try sink.sendAudio(self.buf[start..][0..n]);
+        @atomicStore(u32, &self.tail, tail +% @as(u32, @intCast(n)), .release);
+        self.clock_sent += n;
+        budget -= n;
+    }
+}
+
+// --- Tests ---
+
+const TestSink = struct {
+    chunks: [16]usize = undefined,
+    count: usize = 0,
+    total: usize = 0,
+
+    fn sendAudio(self: *TestSink, pcm: []const u8) !void {
+        self.chunks[self.count] = pcm.len;
+        self.count += 1;
+        self.total += pcm.len;
+    }
+};
+
+test "init sizes the ring from the session format" {
+    try std.testing.expectEqual(@as(?AudioRing, null), try AudioRing.init(std.testing.allocator, .off, .stereo));
+    var ring = (try AudioRing.init(std.testing.allocator, .rate_48000, .stereo)).?;
+    defer ring.deinit(std.testing.allocator);
+    // 250 ms of 48 kHz stereo is 48000 bytes
+    try std.testing.expectEqual(@as(usize, 65536), ring.buf.len);
+    try std.testing.expectEqual(@as(u32, 4), ring.frame_bytes);
+}
+
+test "write keeps whole sample frames and drops the overflow" {
+    var ring = (try AudioRing.init(std.testing.allocator, .rate_22050, .mono)).?;
+    defer ring.deinit(std.testing.allocator);
+    var pcm = [_]u8{0x11} ** 5;
+    try std.testing.expectEqual(@as(usize, 4), ring.write(&pcm));
+    const big = try std.testing.allocator.alloc(u8, ring.buf.len);
+    defer std.testing.allocator.free(big);
+    try std.testing.expectEqual(ring.buf.len - 4, ring.write(big));
+    try std.testing.expectEqual(@as(usize, 0), ring.write(&pcm));
+    try std.testing.expectEqual(ring.buf.len, ring.fill());
+    try std.testing.expectEqual(@as(u32, 2), ring.overruns);
+}
+
+test "drain paces to the playback clock" {
+    var ring = (try AudioRing.init(std.testing.allocator, .rate_48000, .stereo)).?;
+    defer ring.deinit(std.testing.allocator);
+    var pcm = [_]u8{0} ** 20000;
+    _ = ring.write(&pcm);
+
+    // First drain: only the lead (40 ms = 7680 bytes) goes out
+    var sink = TestSink{};
+    const t0: u64 = 1_000_000_000;
+    try ring.drain(t0, &sink);
+    try std.testing.expectEqual(@as(usize, 7680), sink.total);
+
+    // 16 ms later: 16 ms more
+    sink = .{};
+    try ring.drain(t0 + 16 * std.time.ns_per_ms, &sink);
+    try std.testing.expectEqual(@as(usize, 3072), sink.total);
+
+    // A late drain catches up with what is queued, emptying the ring
+    sink = .{};
+    try ring.drain(t0 + 100 * std.time.ns_per_ms, &sink);
+    try std.testing.expectEqual(@as(usize, 20000 - 7680 - 3072), sink.total);
+    try std.testing.expectEqual(@as(usize, 0), ring.fill());
+
+    // The FPGA ran dry: late samples restart the clock instead of bursting
+    _ = ring.write(&pcm);
+    sink = .{};
+    try ring.drain(t0 + 2 * std.time.ns_per_s, &sink);
+    try std.testing.expectEqual(@as(usize, 7680), sink.total);
+}
+
+test "drain splits what is due at the u16 length limit" {
+    var ring = (try AudioRing.init(std.testing.allocator, .rate_48000, .stereo)).?;
+    defer ring.deinit(std.testing.allocator);
+    const pcm = try std.testing.allocator.alloc(u8, ring.buf.len);
+    defer std.testing.allocator.free(pcm);
+    _ = ring.write(pcm);
+    ring.starved = false;
+
+    // Due: a whole ring's worth of playback plus the lead
+    var sink = TestSink{};
+    try ring.drain(std.time.ns_per_s, &sink);
+    try std.testing.expectEqual(ring.buf.len, sink.total);
+    try std.testing.expect(sink.count >= 2);
+    for (sink.chunks[0..sink.count]) |n| try std.testing.expect(n <= std.math.maxInt(u16) and n % 4 == 0);
+    try std.testing.expectEqual(@as(usize, 0), ring.fill());
+}
+
+test "due keeps pacing in long sessions and tolerates an earlier now" {
+    var ring = (try AudioRing.init(std.testing.allocator, .rate_48000, .stereo)).?;
+    defer ring.deinit(std.testing.allocator);
+    ring.starved = false;
+
+    // Seven hours in, past 2^32 bytes: everything played so far was sent,
+    // so 10 ms of playback plus the lead is due
+    const t: u64 = 7 * std.time.ns_per_hour;
+    ring.clock_sent = 192000 * 7 * 3600;
+    try std.testing.expectEqual(@as(usize, 1920 + 7680), ring.due(t + 10 * std.time.ns_per_ms));
+
+    // A timestamp before the clock start saturates rather than overflowing
+    ring.clock_start_ns = t;
+    ring.clock_sent = 0;
+    try std.testing.expectEqual(@as(usize, 7680), ring.due(t - std.time.ns_per_s));
+}
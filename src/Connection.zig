@@ -1,7 +1,12 @@
 const std = @import("std");
+const builtin = @import("builtin");
 const posix = std.posix;
 const protocol = @import("protocol.zig");
 const Health = @import("Health.zig");
+const LossDetector = @import("LossDetector.zig");
+const AudioMeter = @import("AudioMeter.zig");
+const ingest = @import("ingest.zig");
+const clock = @import("clock.zig");
 
 const Connection = @This();
 
@@ -28,10 +33,23 @@ pub const Compressor = struct {
     ctx: ?*anyopaque,
     buf: []u8,
     compressFn: *const fn (ctx: ?*anyopaque, src: []const u8, dst: []u8, field: u8) ?CompressResult,
+    /// Optional: compress a frame straight from a converting source, without
+    /// a converted copy. Compressors without it get the frame converted first.
+    compressSourceFn: ?*const fn (ctx: ?*anyopaque, source: *const ingest.Source, dst: []u8, field: u8) ?CompressResult = null,
+    /// Optional: compress a library-owned frame and keep it as the reference,
+    /// handing back the buffer it replaces in `frame`. Compressors without
+    /// it compress the frame like any other.
+    compressOwnedFn: ?*const fn (ctx: ?*anyopaque, frame: *[]u8, dst: []u8, field: u8) ?CompressResult = null,
+    /// Optional: make the next frame for `field` a keyframe (stateful compressors only).
+    requestKeyframeFn: ?*const fn (ctx: ?*anyopaque, field: u8) void = null,
 
     pub fn compress(self: Compressor, src: []const u8, field: u8) ?CompressResult {
         return self.compressFn(self.ctx, src, self.buf, field);
     }
+
+    pub fn requestKeyframe(self: Compressor, field: u8) void {
+        if (self.requestKeyframeFn) |f| f(self.ctx, field);
+    }
 };
 
 /// Per-frame metadata sent with CMD_BLIT.
@@ -49,6 +67,7 @@ pub const Error = error{
     SetSendBufFailed,
     AudioTooLarge,
     CompressFailed,
+    FrameTooLarge,
 };
 
 // --- State ---
@@ -57,6 +76,8 @@ dest_addr: std.net.Address,
 config: Config,
 status: protocol.FpgaStatus = .{},
 health: Health = .{},
+loss: LossDetector = .{},
+audio: AudioMeter = .{},
 recv_buf: [64]u8 = undefined, // ACK is 13 bytes, generous buffer
 mtu: u16,
 
@@ -80,6 +101,7 @@ pub fn open(config: Config) Error!Connection {
         .sock = sock,
         .dest_addr = addr,
         .config = config,
+        .audio = AudioMeter.init(config.sound_rate, config.sound_channels),
         .mtu = config.mtu - 28, // subtract UDP/IP header overhead
     };
 }
@@ -104,6 +126,8 @@ pub fn poll(self: *Connection) void {
         };
         if (result >= protocol.ack_size) {
             self.status = protocol.parseAck(self.recv_buf[0..protocol.ack_size]);
+            self.loss.onAck(self.status, clock.nowNs());
+            self.audio.onAck(self.status, clock.nowNs());
         }
     }
 }
@@ -126,30 +150,14 @@ pub fn switchRes(self: *Connection, modeline: protocol.Modeline) Error!void {
 /// the frame and sends a 12-byte LZ4 header; otherwise sends the raw
 /// 8-byte header. Frame data is chunked into MTU-sized UDP packets.
 /// Caller retains ownership of `frame` -- data is read synchronously.
+/// When ACK feedback shows a compressed frame for this field was lost,
+/// the compressor is asked for a keyframe first.
 pub fn sendFrame(self: *Connection, frame: []const u8, opts: FrameOpts) Error!void {
     if (self.config.compressor) |comp| {
         // Compressed path
+        if (self.loss.takeResync(opts.field)) comp.requestKeyframe(opts.field);
         const result = comp.compress(frame, opts.field) orelse return Error.CompressFailed;
-
-        if (result.is_delta) {
-            // Delta frame: 13-byte header with compressed size + delta flag
-            var header: [13]u8 = undefined;
-            protocol.buildBlitHeaderLz4Delta(&header, opts.frame_num, opts.field, opts.vsync_line, @intCast(result.data.len));
-            try self.sendRaw(&header);
-        } else {
-            // Non-delta frame: 12-byte header with compressed size
-            var header: [12]u8 = undefined;
-            protocol.buildBlitHeaderLz4(&header, opts.frame_num, opts.field, opts.vsync_line, @intCast(result.data.len));
-            try self.sendRaw(&header);
-        }
-
-        // Chunk compressed data
-        var offset: usize = 0;
-        while (offset < result.data.len) {
-            const end = @min(offset + self.mtu, result.data.len);
-            try self.sendRaw(result.data[offset..end]);
-            offset = end;
-        }
+        try self.sendCompressed(result, opts);
     } else {
         // Uncompressed path: 8-byte header
         var header: [8]u8 = undefined;
@@ -166,6 +174,186 @@ pub fn sendFrame(self: *Connection, frame: []const u8, opts: FrameOpts) Error!vo
     }
 }
 
+/// `sendFrame` for a library-owned buffer the compressor may adopt as its
+/// reference instead of copying it. On return `frame` is free for reuse:
+/// the same buffer, or the one the compressor gave up.
+pub fn sendOwned(self: *Connection, frame: *[]u8, opts: FrameOpts) Error!void {
+    if (self.config.compressor) |comp| if (comp.compressOwnedFn) |f| {
+        if (self.loss.takeResync(opts.field)) comp.requestKeyframe(opts.field);
+        const result = f(comp.ctx, frame, comp.buf, opts.field) orelse return Error.CompressFailed;
+        return self.sendCompressed(result, opts);
+    };
+    return self.sendFrame(frame.*, opts);
+}
+
+/// Send a frame in a host pixel format, converted to the session's format as
+/// it is read. Raw frames are converted one datagram at a time, or, when no
+/// conversion is needed, gathered from their rows without a copy; compressors
+/// with `compressSourceFn` read the source directly. Other compressors get
+/// the frame converted into `scratch` (at least `source.frameBytes()`)
+/// first. Frames already in the session format go through `sendFrame`.
+pub fn sendSource(self: *Connection, source: *const ingest.Source, scratch: []u8, opts: FrameOpts) Error!void {
+    if (source.contiguous()) |frame| return self.sendFrame(frame, opts);
+    const len = source.frameBytes();
+    if (self.config.compressor) |comp| {
+        if (self.loss.takeResync(opts.field)) comp.requestKeyframe(opts.field);
+        const result = if (comp.compressSourceFn) |f| f(comp.ctx, source, comp.buf, opts.field) else blk: {
+            if (scratch.len < len) return Error.FrameTooLarge;
+            source.read(0, scratch[0..len]);
+            break :blk comp.compress(scratch[0..len], opts.field);
+        };
+        try self.sendCompressed(result orelse return Error.CompressFailed, opts);
+    } else {
+        var header: [8]u8 = undefined;
+        protocol.buildBlitHeader(&header, opts.frame_num, opts.field, opts.vsync_line);
+        try self.sendRaw(&header);
+        if (source.passthrough()) {
+            var rows = RowPieces{ .source = source };
+            return self.sendPieces(&rows);
+        }
+
+        var packet: [max_packet]u8 = undefined;
+        const chunk = @min(self.mtu, packet.len);
+        var offset: usize = 0;
+        while (offset < len) {
+            const end = @min(offset + chunk, len);
+            source.read(offset, packet[0 .. end - offset]);
+            try self.sendRaw(packet[0 .. end - offset]);
+            offset = end;
+        }
+    }
+}
+
+/// Largest datagram payload staged on the stack by `sendSource`.
+const max_packet = 9000;
+
+/// Send a frame held in several buffers, in order. Raw frames go out as
+/// MTU-sized datagrams gathered straight from `parts`, split and joined
+/// across buffer boundaries. Compressors get the parts gathered once into
+/// `scratch` (at least the total length).
+pub fn sendGather(self: *Connection, parts: []const []const u8, scratch: []u8, opts: FrameOpts) Error!void {
+    if (self.config.compressor != null) {
+        const len = gatherLen(parts);
+        if (scratch.len < len) return Error.FrameTooLarge;
+        gatherInto(parts, scratch[0..len]);
+        return self.sendFrame(scratch[0..len], opts);
+    }
+    var header: [8]u8 = undefined;
+    protocol.buildBlitHeader(&header, opts.frame_num, opts.field, opts.vsync_line);
+    try self.sendRaw(&header);
+    var pieces = SlicePieces{ .parts = parts };
+    try self.sendPieces(&pieces);
+}
+
+/// Total bytes in `parts`.
+pub fn gatherLen(parts: []const []const u8) usize {
+    var len: usize = 0;
+    for (parts) |p| len += p.len;
+    return len;
+}
+
+/// Concatenate `parts` into `out` (exactly their total length).
+pub fn gatherInto(parts: []const []const u8, out: []u8) void {
+    var o: usize = 0;
+    for (parts) |p| {
+        @memcpy(out[o..][0..p.len], p);
+        o += p.len;
+    }
+    std.debug.assert(o == out.len);
+}
+
+/// Whether datagrams can be gathered from several buffers (`sendmsg`).
+const gather = builtin.os.tag != .windows;
+
+/// Pieces gathered into one datagram at most.
+const max_iov = 64;
+
+/// The buffers of a scatter-gather frame, in order.
+const SlicePieces = struct {
+    parts: []const []const u8,
+    i: usize = 0,
+
+    fn next(self: *SlicePieces) ?[]const u8 {
+        if (self.i == self.parts.len) return null;
+        defer self.i += 1;
+        return self.parts[self.i];
+    }
+};
+
+/// The rows of an unconverted source.
+const RowPieces = struct {
+    source: *const ingest.Source,
+    y: usize = 0,
+
+    fn next(self: *RowPieces) ?[]const u8 {
+        if (self.y == self.source.height) return null;
+        defer self.y += 1;
+        return self.source.row(self.y);
+    }
+};
+
+/// Send the bytes `pieces` yields (`next() ?[]const u8`) as MTU-sized
+/// datagrams that span piece boundaries, gathered straight from the pieces.
+/// Without `sendmsg` each datagram is staged on the stack instead.
+fn sendPieces(self: *Connection, pieces: anytype) Error!void {
+    const chunk = @min(self.mtu, max_packet);
+    var iov: [max_iov]posix.iovec_const = undefined;
+    var cur: []const u8 = &.{};
+    while (true) {
+        var n: usize = 0;
+        var size: usize = 0;
+        while (size < chunk and n < iov.len) {
+            if (cur.len == 0) {
+                cur = pieces.next() orelse break;
+                continue;
+            }
+            const take = @min(cur.len, chunk - size);
+            iov[n] = .{ .base = cur.ptr, .len = take };
+            n += 1;
+            size += take;
+            cur = cur[take..];
+        }
+        if (n == 0) return;
+        if (gather) {
+            try self.sendRawVec(iov[0..n]);
+        } else {
+            var packet: [max_packet]u8 = undefined;
+            var o: usize = 0;
+            for (iov[0..n]) |v| {
+                @memcpy(packet[o..][0..v.len], v.base[0..v.len]);
+                o += v.len;
+            }
+            try self.sendRaw(packet[0..o]);
+        }
+    }
+}
+
+/// Send an already-compressed frame: 12-byte LZ4 header (13-byte with the
+/// delta flag) followed by the data in MTU-sized chunks. Records the frame
+/// for loss detection.
+pub fn sendCompressed(self: *Connection, result: CompressResult, opts: FrameOpts) Error!void {
+    if (result.is_delta) {
+        // Delta frame: 13-byte header with compressed size + delta flag
+        var header: [13]u8 = undefined;
+        protocol.buildBlitHeaderLz4Delta(&header, opts.frame_num, opts.field, opts.vsync_line, @intCast(result.data.len));
+        try self.sendRaw(&header);
+    } else {
+        // Non-delta frame: 12-byte header with compressed size
+        var header: [12]u8 = undefined;
+        protocol.buildBlitHeaderLz4(&header, opts.frame_num, opts.field, opts.vsync_line, @intCast(result.data.len));
+        try self.sendRaw(&header);
+    }
+
+    // Chunk compressed data
+    var offset: usize = 0;
+    while (offset < result.data.len) {
+        const end = @min(offset + self.mtu, result.data.len);
+        try self.sendRaw(result.data[offset..end]);
+        offset = end;
+    }
+    self.loss.recordSubmit(opts.frame_num, opts.field, clock.nowNs());
+}
+
 /// Send CMD_AUDIO header + PCM data in MTU-sized chunks.
 /// `pcm` contains raw 16-bit signed PCM data (interleaved if stereo).
 /// Maximum 65535 bytes per call (uint16 header field limit).
@@ -187,6 +375,7 @@ pub fn sendAudio(self: *Connection, pcm: []const u8) Error!void {
         try self.sendRaw(pcm[offset..end]);
         offset = end;
     }
+    self.audio.onSent(pcm.len, clock.nowNs());
 }
 
 /// Read the latest FPGA status (updated by poll).
@@ -212,7 +401,11 @@ pub fn getHealth(self: *const Connection) Health {
 ///   1. Bootstrap: no ACKs arrive until we send something
 ///   2. Backpressure: vram_ready=0 prevents frame submission, but we
 ///      still need ACKs to detect recovery
+///
+/// ACKs already queued are drained first, so the wait ends on a reply that
+/// arrived after the request and its length is a real round trip.
 pub fn waitSync(self: *Connection, timeout_ms: i32) bool {
+    self.poll();
     // Request status — gives FPGA a reason to send an ACK
     self.sendGetStatus();
 
@@ -247,6 +440,19 @@ fn sendRaw(self: *Connection, data: []const u8) Error!void {
     ) catch return Error.SendFailed;
 }
 
+fn sendRawVec(self: *Connection, iov: []const posix.iovec_const) Error!void {
+    const msg = posix.msghdr_const{
+        .name = &self.dest_addr.any,
+        .namelen = self.dest_addr.getOsSockLen(),
+        .iov = iov.ptr,
+        .iovlen = @intCast(iov.len),
+        .control = null,
+        .controllen = 0,
+        .flags = 0,
+    };
+    _ = posix.sendmsg(self.sock, &msg, 0) catch return Error.SendFailed;
+}
+
 // --- Tests ---
 
 test "Connection open and close without crash" {
@@ -298,6 +504,102 @@ test "Connection sendFrame chunks correctly" {
 
 // --- Comprehensive edge-case tests ---
 
+test "Connection sendSource converts raw frames one datagram at a time" {
+    const rx = try posix.socket(posix.AF.INET, posix.SOCK.DGRAM, posix.IPPROTO.UDP);
+    defer posix.close(rx);
+    var addr = try std.net.Address.parseIp4("127.0.0.1", 0);
+    try posix.bind(rx, &addr.any, addr.getOsSockLen());
+    var addr_len = addr.getOsSockLen();
+    try posix.getsockname(rx, &addr.any, &addr_len);
+
+    var conn = try Connection.open(.{ .host = "127.0.0.1", .port = addr.getPort(), .mtu = 128 });
+    defer conn.close();
+
+    var frame: [40 * 5 * 4]u8 = undefined;
+    for (&frame, 0..) |*b, i| b.* = @truncate(i * 11);
+    const source = ingest.Source.init(&frame, .rgba8888, 40, .bgr888).?;
+    try conn.sendSource(&source, &.{}, .{ .frame_num = 1 });
+
+    var want: [40 * 5 * 3]u8 = undefined;
+    ingest.convert(.rgba8888, .bgr888, &frame, &want);
+    var got: [want.len]u8 = undefined;
+    var buf: [256]u8 = undefined;
+    try std.testing.expectEqual(@as(usize, 8), try posix.recv(rx, &buf, 0));
+    var n: usize = 0;
+    while (n < got.len) {
+        const r = try posix.recv(rx, &buf, 0);
+        // Datagrams split pixels at the MTU, not at pixel boundaries
+        try std.testing.expect(r <= conn.mtu);
+        @memcpy(got[n..][0..r], buf[0..r]);
+        n += r;
+    }
+    try std.testing.expectEqualSlices(u8, &want, &got);
+}
+
+test "Connection sendSource gathers strided rows without conversion" {
+    const rx = try posix.socket(posix.AF.INET, posix.SOCK.DGRAM, posix.IPPROTO.UDP);
+    defer posix.close(rx);
+    var addr = try std.net.Address.parseIp4("127.0.0.1", 0);
+    try posix.bind(rx, &addr.any, addr.getOsSockLen());
+    var addr_len = addr.getOsSockLen();
+    try posix.getsockname(rx, &addr.any, &addr_len);
+
+    var conn = try Connection.open(.{ .host = "127.0.0.1", .port = addr.getPort(), .mtu = 100 });
+    defer conn.close();
+
+    // 30x6 bgr888 crop from a 40-pixel-wide framebuffer with padded rows
+    const pitch = 40 * 3 + 16;
+    var fb: [8 * pitch]u8 = undefined;
+    for (&fb, 0..) |*b, i| b.* = @truncate(i * 7);
+    const source = ingest.Source.initStrided(&fb, pitch, 5, 1, 30, 6, .bgr888, .bgr888).?;
+    try conn.sendSource(&source, &.{}, .{ .frame_num = 1 });
+
+    var want: [30 * 6 * 3]u8 = undefined;
+    source.read(0, &want);
+    var got: [want.len]u8 = undefined;
+    var buf: [256]u8 = undefined;
+    try std.testing.expectEqual(@as(usize, 8), try posix.recv(rx, &buf, 0));
+    var n: usize = 0;
+    while (n < got.len) {
+        const r = try posix.recv(rx, &buf, 0);
+        // Full datagrams across row boundaries
+        if (n + r < got.len) try std.testing.expectEqual(@as(usize, conn.mtu), r);
+        @memcpy(got[n..][0..r], buf[0..r]);
+        n += r;
+    }
+    try std.testing.expectEqualSlices(u8, &want, &got);
+}
+
+test "Connection sendGather joins parts into full datagrams" {
+    const rx = try posix.socket(posix.AF.INET, posix.SOCK.DGRAM, posix.IPPROTO.UDP);
+    defer posix.close(rx);
+    var addr = try std.net.Address.parseIp4("127.0.0.1", 0);
+    try posix.bind(rx, &addr.any, addr.getOsSockLen());
+    var addr_len = addr.getOsSockLen();
+    try posix.getsockname(rx, &addr.any, &addr_len);
+
+    var conn = try Connection.open(.{ .host = "127.0.0.1", .port = addr.getPort(), .mtu = 100 });
+    defer conn.close();
+
+    // Odd-sized parts, one empty, one spanning several datagrams
+    var frame: [301]u8 = undefined;
+    for (&frame, 0..) |*b, i| b.* = @truncate(i * 13);
+    const parts = [_][]const u8{ frame[0..5], frame[5..5], frame[5..180], frame[180..181], frame[181..] };
+    try conn.sendGather(&parts, &.{}, .{ .frame_num = 1 });
+
+    var got: [frame.len]u8 = undefined;
+    var buf: [256]u8 = undefined;
+    try std.testing.expectEqual(@as(usize, 8), try posix.recv(rx, &buf, 0));
+    var n: usize = 0;
+    while (n < got.len) {
+        const r = try posix.recv(rx, &buf, 0);
+        if (n + r < got.len) try std.testing.expectEqual(@as(usize, conn.mtu), r);
+        @memcpy(got[n..][0..r], buf[0..r]);
+        n += r;
+    }
+    try std.testing.expectEqualSlices(u8, &frame, &got);
+}
+
 test "Connection open with invalid host returns error" {
     const result = Connection.open(.{ .host = "not.a.valid.ip" });
     try std.testing.expectError(Error.ResolveFailed, result);
@@ -490,3 +792,35 @@ test "Connection sendInit signals lz4 when lz4_mode set" {
     defer conn.close();
     try conn.sendInit();
 }
+
+var mock_keyframe_requests: u32 = 0;
+
+fn mockRequestKeyframe(_: ?*anyopaque, _: u8) void {
+    mock_keyframe_requests += 1;
+}
+
+test "Connection sendFrame requests a keyframe after a detected loss" {
+    var compress_buf: [4096]u8 = undefined;
+    var conn = try Connection.open(.{
+        .host = "127.0.0.1",
+        .port = 9999,
+        .compressor = .{
+            .ctx = null,
+            .buf = &compress_buf,
+            .compressFn = &mockCompress,
+            .requestKeyframeFn = &mockRequestKeyframe,
+        },
+    });
+    defer conn.close();
+    mock_keyframe_requests = 0;
+    const frame = [_]u8{0xAB} ** 100;
+
+    try conn.sendFrame(&frame, .{ .frame_num = 1 });
+    try conn.sendFrame(&frame, .{ .frame_num = 2 });
+    try std.testing.expectEqual(@as(u32, 0), mock_keyframe_requests);
+
+    // ACK echoes frame 2 without ever reporting frame 1
+    conn.loss.onAck(.{ .frame_echo = 2 }, clock.nowNs());
+    try conn.sendFrame(&frame, .{ .frame_num = 3 });
+    try std.testing.expectEqual(@as(u32, 1), mock_keyframe_requests);
+}
@@ -0,0 +1,175 @@
+//! Bandwidth-driven pixel format fallback. Watches per-frame signs that the
+//! link cannot carry the session's RGB mode (sends taking most of the frame
+//! period, sync round trips well above their baseline, backpressure skips)
+//! and decides when to drop to RGB565 and when to step back up.
+//!
+//! Falling back needs a whole window of frames with a high share under
+//! pressure, so one slow frame does nothing. Stepping back up needs a run of
+//! clean frames; when a restore falls back again before it has lasted that
+//! long, the required run doubles (up to a cap), so a marginal link does not
+//! flap between formats.
+
+const std = @import("std");
+
+const FormatPolicy = @This();
+
+/// Frames per pressure window.
+pub const window = 60;
+
+pub const Level = enum {
+    /// The session's configured RGB mode.
+    full,
+    /// RGB565.
+    reduced,
+};
+
+/// One frame's observations.
+pub const Sample = struct {
+    /// Sync round trip (ms).
+    rtt_ms: f64,
+    /// Time spent sending the frame (ms).
+    send_ms: f64,
+    /// Frame period (ms; one field when interlaced).
+    period_ms: f64,
+    /// Backpressure: the frame was skipped.
+    skipped: bool,
+};
+
+// --- Configuration ---
+/// Share of a window's frames under pressure that triggers the fallback.
+trigger_ratio: f64 = 0.25,
+/// Round trips above this multiple of the baseline count as pressure...
+rtt_factor: f64 = 2.0,
+/// ...when they also exceed it by this share of the frame period, so jitter
+/// on a fast link does not.
+rtt_excess_ratio: f64 = 0.25,
+/// Weight of each unpressured round trip in the baseline average.
+baseline_alpha: f64 = 1.0 / 32.0,
+/// Sends above this share of the frame period count as pressure.
+send_ratio: f64 = 0.8,
+/// Clean frames required before stepping back up (about 10s at 60Hz).
+stable_frames: u32 = 600,
+/// Cap for the required clean run after repeated failed restores.
+max_stable_frames: u32 = 600 * 8,
+
+// --- State ---
+level: Level = .full,
+/// Smoothed unpressured round trip (0 = none yet).
+baseline_rtt_ms: f64 = 0,
+window_frames: u32 = 0,
+window_pressured: u32 = 0,
+clean_run: u32 = 0,
+/// Clean run currently required to step up.
+hold: u32 = 0,
+frames_since_change: u32 = std.math.maxInt(u32),
+
+/// Feed one frame. Returns the new level when the policy changes it.
+pub fn observe(self: *FormatPolicy, s: Sample) ?Level {
+    if (self.hold == 0) self.hold = self.stable_frames;
+    const pressured = s.skipped or
+        (s.period_ms > 0 and s.send_ms > s.period_ms * self.send_ratio) or
+        (self.baseline_rtt_ms > 0 and s.rtt_ms > self.baseline_rtt_ms * self.rtt_factor and
+            s.rtt_ms - self.baseline_rtt_ms > s.period_ms * self.rtt_excess_ratio);
+
+    if (!pressured and s.rtt_ms > 0) {
+        // An average, not a minimum: one unusually fast round trip must not
+        // drag the baseline down and turn ordinary jitter into pressure
+        self.baseline_rtt_ms = if (self.baseline_rtt_ms == 0)
+            s.rtt_ms
+        else
+            self.baseline_rtt_ms + (s.rtt_ms - self.baseline_rtt_ms) * self.baseline_alpha;
+    }
+
+    self.window_frames += 1;
+    if (pressured) self.window_pressured += 1;
+    self.clean_run = if (pressured) 0 else self.clean_run +| 1;
+    self.frames_since_change +|= 1;
+
+    switch (self.level) {
+        .full => if (self.window_frames >= window) {
+            const hot = @as(f64, @floatFromInt(self.window_pressured)) >= self.trigger_ratio * window;
+            self.resetWindow();
+            if (hot) {
+                // Falling back before the restore proved itself: wait longer next time
+                self.hold = if (self.frames_since_change < self.hold)
+                    @min(self.hold *| 2, self.max_stable_frames)
+                else
+                    self.stable_frames;
+                return self.change(.reduced);
+            }
+        },
+        .reduced => {
+            if (self.window_frames >= window) self.resetWindow();
+            if (self.clean_run >= self.hold) return self.change(.full);
+        },
+    }
+    return null;
+}
+
+fn change(self: *FormatPolicy, level: Level) Level {
+    self.level = level;
+    self.resetWindow();
+    self.clean_run = 0;
+    self.frames_since_change = 0;
+    return level;
+}
+
+fn resetWindow(self: *FormatPolicy) void {
+    self.window_frames = 0;
+    self.window_pressured = 0;
+}
+
+// --- Tests ---
+
+const calm = Sample{ .rtt_ms = 1.0, .send_ms = 2.0, .period_ms = 16.7, .skipped = false };
+
+test "isolated slow frames do not trigger the fallback" {
+    var p = FormatPolicy{};
+    for (0..10 * window) |i| {
+        var s = calm;
+        if (i % 10 == 0) s.send_ms = 16.0;
+        try std.testing.expectEqual(@as(?Level, null), p.observe(s));
+    }
+    try std.testing.expectEqual(Level.full, p.level);
+}
+
+test "sustained pressure falls back within a window" {
+    var p = FormatPolicy{};
+    for (0..window) |_| _ = p.observe(calm);
+    var changed: ?Level = null;
+    var frames: usize = 0;
+    while (changed == null and frames < 2 * window) : (frames += 1) {
+        var s = calm;
+        s.rtt_ms = 8.0; // 8x the 1ms baseline, and half a frame above it
+        changed = p.observe(s);
+    }
+    try std.testing.expectEqual(@as(?Level, .reduced), changed);
+    try std.testing.expect(frames <= window);
+}
+
+test "fast outliers and jitter do not count as pressure" {
+    var p = FormatPolicy{};
+    for (0..10 * window) |i| {
+        var s = calm;
+        // Near-zero round trips (a queued ACK) mixed with 3x jitter
+        s.rtt_ms = if (i % 4 == 0) 0.01 else if (i % 4 == 1) 3.0 else 1.0;
+        try std.testing.expectEqual(@as(?Level, null), p.observe(s));
+    }
+    try std.testing.expect(p.baseline_rtt_ms > 0.5);
+}
+
+test "restores after a clean run and backs off after a quick relapse" {
+    var p = FormatPolicy{ .stable_frames = 100 };
+    const skip = Sample{ .rtt_ms = 1.0, .send_ms = 2.0, .period_ms = 16.7, .skipped = true };
+    while (p.observe(skip) == null) {}
+    try std.testing.expectEqual(Level.reduced, p.level);
+
+    var clean: u32 = 0;
+    while (p.observe(calm) == null) clean += 1;
+    try std.testing.expectEqual(@as(u32, 99), clean);
+    try std.testing.expectEqual(Level.full, p.level);
+
+    // Relapse right away: the next restore needs twice the clean run
+    while (p.observe(skip) == null) {}
+    try std.testing.expectEqual(@as(u32, 200), p.hold);
+}
@@ -0,0 +1,139 @@
+//! LRU cache of compressed keyframes, keyed by a BLAKE3 digest of the full
+//! frame. Menus, pause screens and attract loops cycle through a handful of
+//! identical screens; when one reappears its keyframe is resent from here
+//! instead of being compressed again.
+//!
+//! Bounded by a byte budget over the cached data; the least recently used
+//! entries are evicted to make room. Not thread-safe: owned by the
+//! compressor, which runs on one thread at a time.
+
+const std = @import("std");
+
+const FrameCache = @This();
+
+/// Cache key: BLAKE3 digest of the uncompressed frame.
+pub const Digest = [32]u8;
+
+const Entry = struct {
+    key: Digest,
+    data: []u8,
+    last_used: u64,
+};
+
+// --- State ---
+allocator: std.mem.Allocator,
+/// Upper bound on the summed size of cached data.
+budget: usize,
+used: usize = 0,
+entries: std.ArrayList(Entry) = .empty,
+/// Use counter driving LRU order.
+tick: u64 = 0,
+
+pub fn init(allocator: std.mem.Allocator, budget: usize) FrameCache {
+    return .{ .allocator = allocator, .budget = budget };
+}
+
+pub fn deinit(self: *FrameCache) void {
+    self.clear();
+    self.entries.deinit(self.allocator);
+    self.* = undefined;
+}
+
+/// Drop every entry.
+pub fn clear(self: *FrameCache) void {
+    for (self.entries.items) |e| self.allocator.free(e.data);
+    self.entries.clearRetainingCapacity();
+    self.used = 0;
+}
+
+/// Digest of `frame` for `get` / `put`.
+pub fn digest(frame: []const u8) Digest {
+    var out: Digest = undefined;
+    std.crypto.hash.Blake3.hash(frame, &out, .{});
+    return out;
+}
+
+/// Cached data for `key`, marked most recently used. Valid until the next `put`.
+pub fn get(self: *FrameCache, key: Digest) ?[]const u8 {
+    for (self.entries.items) |*e| {
+        if (std.mem.eql(u8, &e.key, &key)) {
+            self.tick += 1;
+            e.last_used = self.tick;
+            return e.data;
+        }
+    }
+    return null;
+}
+
+/// Cache a copy of `data` under `key`, evicting least recently used entries
+/// to stay within the budget. Best effort: data larger than the budget, or
+/// an allocation failure, leaves the cache without it.
+pub fn put(self: *FrameCache, key: Digest, data: []const u8) void {
+    if (data.len > self.budget or self.get(key) != null) return;
+    while (self.used + data.len > self.budget) self.evictOldest();
+
+    const copy = self.allocator.dupe(u8, data) catch return;
+    self.tick += 1;
+    self.entries.append(self.allocator, .{ .key = key, .data = copy, .last_used = self.tick }) catch {
+        self.allocator.free(copy);
+        return;
+    };
+    self.used += data.len;
+}
+
+/// Number of cached frames.
+pub fn count(self: *const FrameCache) usize {
+    return self.entries.items.len;
+}
+
+fn evictOldest(self: *FrameCache) void {
+    var oldest: usize = 0;
+    for (self.entries.items, 0..) |e, i| {
+        if (e.last_used < self.entries.items[oldest].last_used) oldest = i;
+    }
+    const e = self.entries.swapRemove(oldest);
+    self.used -= e.data.len;
+    self.allocator.free(e.data);
+}
+
+// --- Tests ---
+
+test "put then get returns the cached bytes" {
+    var cache = FrameCache.init(std.testing.allocator, 1024);
+    defer cache.deinit();
+    const frame = [_]u8{0x11} ** 300;
+    const key = digest(&frame);
+    try std.testing.expect(cache.get(key) == null);
+    cache.put(key, "compressed");
+    try std.testing.expectEqualStrings("compressed", cache.get(key).?);
+    // Different content, different key
+    try std.testing.expect(cache.get(digest(frame[0..299])) == null);
+}
+
+test "least recently used entry is evicted to stay within budget" {
+    var cache = FrameCache.init(std.testing.allocator, 30);
+    defer cache.deinit();
+    const a = digest("a");
+    const b = digest("b");
+    const c = digest("c");
+    cache.put(a, &([_]u8{1} ** 10));
+    cache.put(b, &([_]u8{2} ** 10));
+    cache.put(c, &([_]u8{3} ** 10));
+    _ = cache.get(a);
+
+    // b is now the oldest and makes room for d
+    const d = digest("d");
+    cache.put(d, &([_]u8{4} ** 10));
+    try std.testing.expect(cache.get(b) == null);
+    try std.testing.expect(cache.get(a) != null);
+    try std.testing.expect(cache.get(c) != null);
+    try std.testing.expect(cache.get(d) != null);
+    try std.testing.expectEqual(@as(usize, 30), cache.used);
+}
+
+test "data larger than the budget is not cached" {
+    var cache = FrameCache.init(std.testing.allocator, 8);
+    defer cache.deinit();
+    cache.put(digest("x"), "123456789");
+    try std.testing.expectEqual(@as(usize, 0), cache.count());
+}
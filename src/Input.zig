@@ -1,4 +1,5 @@
 const std = @import("std");
+const clock = @import("clock.zig");
 const posix = std.posix;
 
 const Input = @This();
@@ -50,6 +51,107 @@ pub const Ps2State = struct {
     mouse_z: u8 = 0,
 };
 
+/// Input transitions, in packet order.
+pub const EventKind = enum(u8) {
+    /// Joystick button pressed/released: `player` 0 or 1, `code` the
+    /// `JoyButton` bit.
+    joy_down = 1,
+    joy_up = 2,
+    /// Key pressed/released: `code` the SDL scancode.
+    key_down = 3,
+    key_up = 4,
+    /// Mouse button pressed/released: `code` 0 = left, 1 = right, 2 = middle.
+    mouse_down = 5,
+    mouse_up = 6,
+};
+
+/// One transition, stamped with the host time the packet was received.
+pub const Event = struct {
+    time_ns: u64,
+    /// FPGA frame counter of the packet.
+    frame: u32,
+    kind: EventKind,
+    player: u8 = 0,
+    code: u16,
+};
+
+/// Fixed-size event ring between the thread receiving packets and the one
+/// reading events: single producer, single consumer, no locks. When full,
+/// new events are dropped and counted, so the queued ones stay consistent.
+pub const EventQueue = struct {
+    pub const capacity = 1024;
+
+    buf: [capacity]Event = undefined,
+    /// Events pushed (producer) and taken (consumer); wrap at 2^32.
+    head: u32 = 0,
+    tail: u32 = 0,
+    dropped: u32 = 0,
+
+    pub fn push(self: *EventQueue, event: Event) void {
+        const head = @atomicLoad(u32, &self.head, .monotonic);
+        if (head -% @atomicLoad(u32, &self.tail, .acquire) >= capacity) {
+            _ = @atomicRmw(u32, &self.dropped, .Add, 1, .monotonic);
+            return;
+        }
+        self.buf[head % capacity] = event;
+        @atomicStore(u32, &self.head, head +% 1, .release);
+    }
+
+    /// Move up to `out.len` events, oldest first, into `out`.
+    pub fn take(self: *EventQueue, out: []Event) usize {
+        const tail = @atomicLoad(u32, &self.tail, .monotonic);
+        const n = @min(out.len, @atomicLoad(u32, &self.head, .acquire) -% tail);
+        for (out[0..n], 0..) |*e, i| e.* = self.buf[(tail +% @as(u32, @intCast(i))) % capacity];
+        @atomicStore(u32, &self.tail, tail +% @as(u32, @intCast(n)), .release);
+        return n;
+    }
+};
+
+/// Single-writer snapshot of `T` that any thread can copy without locking:
+/// the writer holds `seq` odd while it updates `data`, and a reader retries
+/// if `seq` was odd or changed across its copy. The data is held as atomic
+/// words, so a torn copy is discarded rather than undefined. Zeroed words
+/// read as `T`'s zero state.
+pub fn Seqlock(comptime T: type) type {
+    return struct {
+        const Self = @This();
+        const words = (@sizeOf(T) + 3) / 4;
+
+        seq: u32 = 0,
+        data: [words]u32 = .{0} ** words,
+
+        /// Publish `value`. One writer at a time.
+        pub fn store(self: *Self, value: T) void {
+            var buf: [words]u32 = .{0} ** words;
+            @memcpy(std.mem.asBytes(&buf)[0..@sizeOf(T)], std.mem.asBytes(&value));
+            const seq = @atomicRmw(u32, &self.seq, .Add, 1, .acq_rel);
+            for (&self.data, buf) |*w, v| @atomicStore(u32, w, v, .monotonic);
+            @atomicStore(u32, &self.seq, seq +% 2, .release);
+        }
+
+        /// Copy the last published value. Lock-free, not wait-free: the copy
+        /// is retried when a store overlaps it. Stores are infrequent (one per
+        /// input packet or frame) and take nanoseconds, so a retry is rare and
+        /// one suffices.
+        pub fn load(self: *const Self) T {
+            var buf: [words]u32 = undefined;
+            while (true) {
+                const seq = @atomicLoad(u32, &self.seq, .acquire);
+                for (&buf, &self.data) |*v, *w| v.* = @atomicLoad(u32, w, .acquire);
+                if (seq & 1 == 0 and @atomicLoad(u32, &self.seq, .monotonic) == seq) break;
+                std.atomic.spinLoopHint();
+            }
+            var value: T = undefined;
+            @memcpy(std.mem.asBytes(&value), std.mem.asBytes(&buf)[0..@sizeOf(T)]);
+            return value;
+        }
+    };
+}
+
+/// How often the receiver thread wakes from an idle socket to check
+/// whether it should stop.
+pub const receiver_wake_ms = 50;
+
 /// Errors that can occur during input socket operations.
 pub const Error = error{
     SocketCreateFailed,
@@ -63,6 +165,16 @@ sock: posix.socket_t,
 recv_buf: [64]u8 = undefined,
 joy: JoystickState = .{},
 ps2: Ps2State = .{},
+events: EventQueue = .{},
+/// `joy` and `ps2` as last published, for readers on any thread.
+joy_snapshot: Seqlock(JoystickState) = .{},
+ps2_snapshot: Seqlock(Ps2State) = .{},
+/// Packets accepted (atomic), and the count `poll` last reported.
+accepted: u32 = 0,
+polled: u32 = 0,
+/// Receiver thread, and the flag that keeps it running.
+receiver: ?std.Thread = null,
+running: bool = false,
 
 // --- Pure parsing functions ---
 
@@ -125,6 +237,57 @@ pub fn isKeyPressed(keys: *const [32]u8, scancode: u8) bool {
     return (keys[scancode / 8] >> @intCast(scancode % 8)) & 1 != 0;
 }
 
+/// Queue an event per joystick button that changed between `old` and `new`.
+pub fn joyEdges(queue: *EventQueue, old: JoystickState, new: JoystickState, time_ns: u64) void {
+    for ([_][2]u16{ .{ old.joy1, new.joy1 }, .{ old.joy2, new.joy2 } }, 0..) |pair, player| {
+        var changed = pair[0] ^ pair[1];
+        while (changed != 0) : (changed &= changed - 1) {
+            const bit = changed & (~changed +% 1);
+            queue.push(.{
+                .time_ns = time_ns,
+                .frame = new.frame,
+                .kind = if (pair[1] & bit != 0) .joy_down else .joy_up,
+                .player = @intCast(player),
+                .code = bit,
+            });
+        }
+    }
+}
+
+/// Queue an event per key and mouse button that changed between `old` and
+/// `new`. The 256-bit key fields are compared in one vector XOR; only bytes
+/// that differ are walked.
+pub fn ps2Edges(queue: *EventQueue, old: *const Ps2State, new: *const Ps2State, time_ns: u64) void {
+    const Keys = @Vector(32, u8);
+    const old_keys: Keys = old.keys;
+    const new_keys: Keys = new.keys;
+    const diff: [32]u8 = old_keys ^ new_keys;
+    var bytes: u32 = @bitCast(@as(Keys, diff) != @as(Keys, @splat(0)));
+    while (bytes != 0) : (bytes &= bytes - 1) {
+        const i: u8 = @intCast(@ctz(bytes));
+        var bits = diff[i];
+        while (bits != 0) : (bits &= bits - 1) {
+            const b: u3 = @intCast(@ctz(bits));
+            queue.push(.{
+                .time_ns = time_ns,
+                .frame = new.frame,
+                .kind = if ((new.keys[i] >> b) & 1 != 0) .key_down else .key_up,
+                .code = @as(u16, i) * 8 + b,
+            });
+        }
+    }
+    var buttons = (old.mouse_btns ^ new.mouse_btns) & 0x07;
+    while (buttons != 0) : (buttons &= buttons - 1) {
+        const b: u3 = @intCast(@ctz(buttons));
+        queue.push(.{
+            .time_ns = time_ns,
+            .frame = new.frame,
+            .kind = if ((new.mouse_btns >> b) & 1 != 0) .mouse_down else .mouse_up,
+            .code = b,
+        });
+    }
+}
+
 /// Check if a new packet is newer than stored state (for dedup).
 /// Accept if new_frame > stored_frame, or same frame with new_order > stored_order.
 pub fn isNewer(stored_frame: u32, stored_order: u8, new_frame: u32, new_order: u8) bool {
@@ -159,63 +322,105 @@ pub fn bind(host: []const u8) Error!Input {
     return .{ .sock = sock };
 }
 
-/// Close the input socket.
+/// Stop the receiver thread, if started, and close the input socket.
 pub fn close(self: *Input) void {
+    if (self.receiver) |thread| {
+        @atomicStore(bool, &self.running, false, .release);
+        thread.join();
+    }
     posix.close(self.sock);
     self.* = undefined;
 }
 
 /// Drain all pending input packets. Returns true if any new data was accepted.
-/// Dispatches by packet length and deduplicates by frame+order.
+/// Dispatches by packet length and deduplicates by frame+order. With the
+/// receiver thread running, only reports whether it accepted anything since
+/// the last call.
 pub fn poll(self: *Input) bool {
+    if (self.receiver != null) {
+        const accepted = @atomicLoad(u32, &self.accepted, .acquire);
+        defer self.polled = accepted;
+        return accepted != self.polled;
+    }
     var got_data = false;
     while (true) {
         const n = posix.recvfrom(self.sock, &self.recv_buf, 0, null, null) catch |err| switch (err) {
             error.WouldBlock => return got_data,
             else => return got_data,
         };
-        switch (n) {
-            9 => {
-                const state = parseJoyDigital(self.recv_buf[0..9]);
-                if (isNewer(self.joy.frame, self.joy.order, state.frame, state.order)) {
-                    self.joy = state;
-                    got_data = true;
-                }
-            },
-            17 => {
-                const state = parseJoyAnalog(self.recv_buf[0..17]);
-                if (isNewer(self.joy.frame, self.joy.order, state.frame, state.order)) {
-                    self.joy = state;
-                    got_data = true;
-                }
-            },
-            37 => {
-                const state = parsePs2Keyboard(self.recv_buf[0..37]);
-                if (isNewer(self.ps2.frame, self.ps2.order, state.frame, state.order)) {
-                    self.ps2 = state;
-                    got_data = true;
-                }
-            },
-            41 => {
-                const state = parsePs2Mouse(self.recv_buf[0..41]);
-                if (isNewer(self.ps2.frame, self.ps2.order, state.frame, state.order)) {
-                    self.ps2 = state;
-                    got_data = true;
-                }
-            },
-            else => {}, // Unknown packet size, ignore
-        }
+        if (self.accept(self.recv_buf[0..n], clock.nowNs())) got_data = true;
     }
 }
 
-/// Read the latest joystick state.
+/// Apply one received packet, queueing its transitions stamped `time_ns`.
+/// Returns true if it was newer than the stored state.
+pub fn accept(self: *Input, packet: []const u8, time_ns: u64) bool {
+    switch (packet.len) {
+        9, 17 => {
+            const state = if (packet.len == 9) parseJoyDigital(packet[0..9]) else parseJoyAnalog(packet[0..17]);
+            if (!isNewer(self.joy.frame, self.joy.order, state.frame, state.order)) return false;
+            joyEdges(&self.events, self.joy, state, time_ns);
+            self.joy = state;
+            self.joy_snapshot.store(state);
+            _ = @atomicRmw(u32, &self.accepted, .Add, 1, .release);
+            return true;
+        },
+        37, 41 => {
+            const state = if (packet.len == 37) parsePs2Keyboard(packet[0..37]) else parsePs2Mouse(packet[0..41]);
+            if (!isNewer(self.ps2.frame, self.ps2.order, state.frame, state.order)) return false;
+            ps2Edges(&self.events, &self.ps2, &state, time_ns);
+            self.ps2 = state;
+            self.ps2_snapshot.store(state);
+            _ = @atomicRmw(u32, &self.accepted, .Add, 1, .release);
+            return true;
+        },
+        else => return false, // Unknown packet size, ignore
+    }
+}
+
+/// Move up to `out.len` queued transitions, oldest first, into `out`.
+pub fn takeEvents(self: *Input, out: []Event) usize {
+    return self.events.take(out);
+}
+
+/// Transitions lost because the event queue was full when they happened.
+pub fn droppedEvents(self: *const Input) u32 {
+    return @atomicLoad(u32, &self.events.dropped, .monotonic);
+}
+
+/// Read the latest joystick state. Safe from any thread.
 pub fn joyState(self: *const Input) JoystickState {
-    return self.joy;
+    return self.joy_snapshot.load();
 }
 
-/// Read the latest PS/2 keyboard + mouse state.
+/// Read the latest PS/2 keyboard + mouse state. Safe from any thread.
 pub fn ps2State(self: *const Input) Ps2State {
-    return self.ps2;
+    return self.ps2_snapshot.load();
+}
+
+// --- Receiver thread ---
+
+/// Start a thread that blocks on the socket and accepts each packet the
+/// moment it arrives, so state is current whenever it is read and events
+/// carry arrival times. The thread becomes the only reader of the socket;
+/// `poll` then just reports new data. `self` must not move until `close`.
+pub fn startReceiver(self: *Input) !void {
+    if (self.receiver != null) return;
+    @atomicStore(bool, &self.running, true, .release);
+    errdefer @atomicStore(bool, &self.running, false, .release);
+    self.receiver = try std.Thread.spawn(.{}, receive, .{self});
+}
+
+fn receive(self: *Input) void {
+    var fds = [_]posix.pollfd{.{ .fd = self.sock, .events = posix.POLL.IN, .revents = 0 }};
+    while (@atomicLoad(bool, &self.running, .acquire)) {
+        const ready = posix.poll(&fds, receiver_wake_ms) catch return;
+        if (ready == 0) continue;
+        while (true) {
+            const n = posix.recvfrom(self.sock, &self.recv_buf, 0, null, null) catch break;
+            _ = self.accept(self.recv_buf[0..n], clock.nowNs());
+        }
+    }
 }
 
 // --- Tests ---
@@ -438,3 +643,100 @@ test "invalid host returns ResolveFailed" {
     const result = Input.bind("not.a.valid.ip");
     try std.testing.expectError(Error.ResolveFailed, result);
 }
+
+test "joystick edges: a tap between polls yields down and up" {
+    var input = Input{ .sock = undefined };
+    var pkt = [9]u8{ 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    std.mem.writeInt(u16, pkt[5..7], JoyButton.b1 | JoyButton.up, .little);
+    try std.testing.expect(input.accept(&pkt, 100));
+    pkt[4] = 1;
+    std.mem.writeInt(u16, pkt[5..7], JoyButton.up, .little);
+    try std.testing.expect(input.accept(&pkt, 200));
+    // Duplicate: no state change, no events
+    try std.testing.expect(!input.accept(&pkt, 300));
+
+    var out: [8]Event = undefined;
+    try std.testing.expectEqual(@as(usize, 3), input.takeEvents(&out));
+    try std.testing.expectEqual(EventKind.joy_down, out[0].kind);
+    try std.testing.expectEqual(JoyButton.up, out[0].code);
+    try std.testing.expectEqual(EventKind.joy_down, out[1].kind);
+    try std.testing.expectEqual(JoyButton.b1, out[1].code);
+    try std.testing.expectEqual(EventKind.joy_up, out[2].kind);
+    try std.testing.expectEqual(JoyButton.b1, out[2].code);
+    try std.testing.expectEqual(@as(u64, 200), out[2].time_ns);
+    try std.testing.expectEqual(@as(usize, 0), input.takeEvents(&out));
+}
+
+test "key edges: vector diff of the scancode bitfield" {
+    var input = Input{ .sock = undefined };
+    var pkt = [_]u8{0} ** 41;
+    pkt[0] = 1;
+    pkt[5 + 0] = 0x01; // scancode 0
+    pkt[5 + 31] = 0x80; // scancode 255
+    pkt[37] = 0x01; // left mouse button
+    try std.testing.expect(input.accept(&pkt, 1));
+    pkt[0] = 2;
+    pkt[5 + 31] = 0;
+    pkt[5 + 4] = 0x04; // scancode 34
+    pkt[37] = 0;
+    try std.testing.expect(input.accept(&pkt, 2));
+
+    var out: [8]Event = undefined;
+    try std.testing.expectEqual(@as(usize, 6), input.takeEvents(&out));
+    const want = [_]struct { EventKind, u16 }{
+        .{ .key_down, 0 },   .{ .key_down, 255 }, .{ .mouse_down, 0 },
+        .{ .key_down, 34 },  .{ .key_up, 255 },   .{ .mouse_up, 0 },
+    };
+    for (want, out[0..6]) |w, e| {
+        try std.testing.expectEqual(w[0], e.kind);
+        try std.testing.expectEqual(w[1], e.code);
+    }
+}
+
+test "event queue drops new events when full" {
+    var queue = EventQueue{};
+    for (0..EventQueue.capacity + 5) |i| queue.push(.{ .time_ns = i, .frame = 0, .kind = .key_down, .code = 0 });
+    try std.testing.expectEqual(@as(u32, 5), queue.dropped);
+    var out: [4]Event = undefined;
+    try std.testing.expectEqual(@as(usize, 4), queue.take(&out));
+    try std.testing.expectEqual(@as(u64, 0), out[0].time_ns);
+}
+
+test "seqlock round-trips a snapshot" {
+    var lock = Seqlock(Ps2State){};
+    try std.testing.expectEqual(@as(u32, 0), lock.load().frame);
+    var state = Ps2State{ .frame = 7, .order = 2, .mouse_btns = 5 };
+    state.keys[31] = 0x80;
+    lock.store(state);
+    const got = lock.load();
+    try std.testing.expectEqual(@as(u32, 7), got.frame);
+    try std.testing.expectEqual(@as(u8, 5), got.mouse_btns);
+    try std.testing.expectEqual(@as(u8, 0x80), got.keys[31]);
+    try std.testing.expectEqual(@as(u32, 2), lock.seq);
+}
+
+test "receiver thread accepts packets as they arrive" {
+    var input = try Input.bind("127.0.0.1");
+    defer input.close();
+    try input.startReceiver();
+
+    // Send a joystick packet to the input socket from a second socket
+    var addr: posix.sockaddr.in = undefined;
+    var addr_len: posix.socklen_t = @sizeOf(posix.sockaddr.in);
+    try posix.getsockname(input.sock, @ptrCast(&addr), &addr_len);
+    addr.addr = std.mem.nativeToBig(u32, 0x7F000001);
+    const sender = try posix.socket(posix.AF.INET, posix.SOCK.DGRAM, posix.IPPROTO.UDP);
+    defer posix.close(sender);
+    var pkt = [9]u8{ 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    std.mem.writeInt(u16, pkt[5..7], JoyButton.b2, .little);
+    _ = try posix.sendto(sender, &pkt, 0, @ptrCast(&addr), addr_len);
+
+    var tries: usize = 0;
+    while (input.joyState().frame != 1 and tries < 200) : (tries += 1) std.Thread.sleep(std.time.ns_per_ms);
+    try std.testing.expectEqual(JoyButton.b2, input.joyState().joy1);
+    try std.testing.expect(input.poll());
+    try std.testing.expect(!input.poll());
+    var out: [2]Event = undefined;
+    try std.testing.expectEqual(@as(usize, 1), input.takeEvents(&out));
+    try std.testing.expectEqual(EventKind.joy_down, out[0].kind);
+}
@@ -0,0 +1,182 @@
+//! Loss detection for delta streams. Watches ACK feedback for evidence that
+//! a submitted frame was never applied by the FPGA (echo gaps, frameskip,
+//! a missing echo past a timeout) and flags the affected field so the next
+//! frame on it goes out as a keyframe instead of waiting for the periodic one.
+
+const std = @import("std");
+const protocol = @import("protocol.zig");
+
+const LossDetector = @This();
+
+/// Pending-frame ring capacity (~1 second at 60 Hz).
+pub const capacity = 64;
+
+const Pending = struct {
+    frame: u32,
+    field: u1,
+    epoch: u32,
+    sent_ns: u64,
+};
+
+// --- Submitted frames awaiting an echo ---
+pending: [capacity]Pending = undefined,
+head: usize = 0,
+len: usize = 0,
+
+/// An ACK that arrives this long after a frame was sent, without echoing it
+/// or a later frame, counts as a loss.
+timeout_ns: u64 = 100 * std.time.ns_per_ms,
+
+/// Fields flagged for a resync keyframe (bit 0 = field 0, bit 1 = field 1).
+resync_mask: u2 = 0,
+/// Bumped per field when a resync is taken. Losses of frames sent before
+/// the resync keyframe are already repaired by it and are not re-flagged.
+epoch: [2]u32 = .{ 0, 0 },
+/// Fields that have had frames submitted.
+seen_fields: u2 = 0,
+last_frameskip: bool = false,
+
+/// Monotonic count of frames detected as not applied.
+lost_frames: u64 = 0,
+
+/// Record a frame that was fully sent.
+pub fn recordSubmit(self: *LossDetector, frame: u32, field: u8, now_ns: u64) void {
+    const f: u1 = @intCast(@min(field, 1));
+    if (self.len == capacity) self.pop();
+    self.pending[(self.head + self.len) % capacity] = .{
+        .frame = frame,
+        .field = f,
+        .epoch = self.epoch[f],
+        .sent_ns = now_ns,
+    };
+    self.len += 1;
+    self.seen_fields |= fieldBit(f);
+}
+
+/// Process one ACK. Frames older than `frame_echo` that were never echoed
+/// are lost (echo gap); frames still unechoed after `timeout_ns` are lost;
+/// a rising `vga_frameskip` flags every active field.
+pub fn onAck(self: *LossDetector, status: protocol.FpgaStatus, now_ns: u64) void {
+    if (status.vga_frameskip and !self.last_frameskip and self.seen_fields != 0) {
+        self.resync_mask |= self.seen_fields;
+        self.lost_frames += 1;
+    }
+    self.last_frameskip = status.vga_frameskip;
+
+    while (self.len > 0) {
+        const p = self.pending[self.head];
+        // Wrapping distance so frame counter rollover is handled
+        const ahead: i32 = @bitCast(p.frame -% status.frame_echo);
+        if (ahead > 0) {
+            // Not echoed yet. Later entries were sent later, so stop at the first live one.
+            if (now_ns -| p.sent_ns <= self.timeout_ns) break;
+            self.lose(p);
+        } else if (ahead < 0) {
+            // The echo moved past this frame without ever reporting it
+            self.lose(p);
+        }
+        self.pop();
+    }
+}
+
+/// Return whether `field` needs a resync keyframe, clearing the flag.
+/// Call right before compressing a frame for that field.
+pub fn takeResync(self: *LossDetector, field: u8) bool {
+    const f: u1 = @intCast(@min(field, 1));
+    if (self.resync_mask & fieldBit(f) == 0) return false;
+    self.resync_mask &= ~fieldBit(f);
+    self.epoch[f] +%= 1;
+    return true;
+}
+
+fn lose(self: *LossDetector, p: Pending) void {
+    if (p.epoch != self.epoch[p.field]) return;
+    self.resync_mask |= fieldBit(p.field);
+    self.lost_frames += 1;
+}
+
+fn pop(self: *LossDetector) void {
+    self.head = (self.head + 1) % capacity;
+    self.len -= 1;
+}
+
+fn fieldBit(f: u1) u2 {
+    return @as(u2, 1) << f;
+}
+
+// --- Tests ---
+
+test "echoed frames are retired without loss" {
+    var d = LossDetector{};
+    d.recordSubmit(1, 0, 0);
+    d.recordSubmit(2, 0, 0);
+    d.onAck(.{ .frame_echo = 1 }, 1000);
+    try std.testing.expectEqual(@as(usize, 1), d.len);
+    d.onAck(.{ .frame_echo = 2 }, 2000);
+    try std.testing.expectEqual(@as(usize, 0), d.len);
+    try std.testing.expectEqual(@as(u64, 0), d.lost_frames);
+    try std.testing.expect(!d.takeResync(0));
+}
+
+test "echo gap flags the skipped frame's field" {
+    var d = LossDetector{};
+    d.recordSubmit(10, 1, 0);
+    d.recordSubmit(11, 0, 0);
+    d.recordSubmit(12, 1, 0);
+    // Echo jumps from nothing to 11: frame 10 (field 1) was never reported
+    d.onAck(.{ .frame_echo = 11 }, 1000);
+    try std.testing.expectEqual(@as(u64, 1), d.lost_frames);
+    try std.testing.expect(!d.takeResync(0));
+    try std.testing.expect(d.takeResync(1));
+    // Flag is cleared once taken
+    try std.testing.expect(!d.takeResync(1));
+}
+
+test "missing echo past timeout counts as a loss" {
+    var d = LossDetector{ .timeout_ns = 100 };
+    d.recordSubmit(5, 0, 0);
+    d.onAck(.{ .frame_echo = 4 }, 50);
+    try std.testing.expect(!d.takeResync(0));
+    d.onAck(.{ .frame_echo = 4 }, 200);
+    try std.testing.expect(d.takeResync(0));
+    try std.testing.expectEqual(@as(usize, 0), d.len);
+}
+
+test "frameskip rising edge flags active fields once" {
+    var d = LossDetector{};
+    d.recordSubmit(1, 0, 0);
+    d.onAck(.{ .frame_echo = 1, .vga_frameskip = true }, 10);
+    d.onAck(.{ .frame_echo = 1, .vga_frameskip = true }, 20);
+    try std.testing.expectEqual(@as(u64, 1), d.lost_frames);
+    try std.testing.expect(d.takeResync(0));
+    try std.testing.expect(!d.takeResync(1));
+}
+
+test "losses before a resync keyframe are not re-flagged" {
+    var d = LossDetector{};
+    d.recordSubmit(1, 0, 0);
+    d.recordSubmit(2, 0, 0);
+    d.recordSubmit(3, 0, 0);
+    d.onAck(.{ .frame_echo = 2 }, 10); // frame 1 lost
+    try std.testing.expect(d.takeResync(0));
+    d.recordSubmit(4, 0, 20); // the resync keyframe
+    d.onAck(.{ .frame_echo = 4 }, 30); // frame 3 also lost, but predates the keyframe
+    try std.testing.expect(!d.takeResync(0));
+    try std.testing.expectEqual(@as(u64, 1), d.lost_frames);
+}
+
+test "frame counter wraparound" {
+    var d = LossDetector{};
+    d.recordSubmit(std.math.maxInt(u32), 0, 0);
+    d.recordSubmit(0, 0, 0);
+    d.onAck(.{ .frame_echo = 0 }, 10);
+    try std.testing.expect(d.takeResync(0));
+    try std.testing.expectEqual(@as(usize, 0), d.len);
+}
+
+test "full ring drops the oldest entry" {
+    var d = LossDetector{};
+    for (0..capacity + 5) |i| d.recordSubmit(@intCast(i), 0, 0);
+    try std.testing.expectEqual(@as(usize, capacity), d.len);
+    try std.testing.expectEqual(@as(u32, 5), d.pending[d.head].frame);
+}
@@ -0,0 +1,324 @@
+//! Two-stage frame pipeline for compressed streams. A worker thread
+//! compresses each frame into its own slot buffer while the caller's thread
+//! sends the previously compressed frame, so frame cost drops from
+//! compress + send to roughly max(compress, send).
+//!
+//! Frames are compressed and sent strictly in submission order, so delta
+//! references stay consistent per field. `submit` returns with at most
+//! `depth - 1` frames in flight, which bounds the added latency.
+
+const std = @import("std");
+const Connection = @import("Connection.zig");
+const ingest = @import("ingest.zig");
+const clock = @import("clock.zig");
+
+const Pipeline = @This();
+
+/// Maximum supported pipeline depth (frames in flight).
+pub const max_depth = 4;
+
+const Slot = struct {
+    input: []u8,
+    output: []u8,
+    len: usize = 0,
+    opts: Connection.FrameOpts = .{ .frame_num = 0 },
+    result: ?Connection.CompressResult = null,
+};
+
+/// Per-stage timings, exponentially averaged over recent frames.
+pub const Stats = struct {
+    /// Frames sent through the pipeline.
+    frames: u64 = 0,
+    /// Worker time spent compressing one frame.
+    avg_compress_ns: f64 = 0,
+    /// Caller time spent sending one frame's packets.
+    avg_send_ns: f64 = 0,
+    /// Caller time spent waiting for the worker before a send (pipeline stall).
+    avg_stall_ns: f64 = 0,
+};
+
+/// Smoothing factor for the per-stage averages.
+const ema_alpha = 0.1;
+
+// --- State ---
+allocator: std.mem.Allocator,
+comp: Connection.Compressor,
+depth: usize,
+slots: [max_depth]Slot = undefined,
+thread: std.Thread = undefined,
+mutex: std.Thread.Mutex = .{},
+cond: std.Thread.Condition = .{},
+/// Frame counters: sent <= compressed <= submitted <= sent + depth.
+submitted: u64 = 0,
+compressed: u64 = 0,
+sent: u64 = 0,
+stopping: bool = false,
+stats: Stats = .{},
+/// Slot memory allocated by `create` (null when the caller supplied it).
+owned: ?[]u8 = null,
+
+/// Bytes of slot memory needed for `depth` slots.
+pub fn bufferBytes(depth: usize, frame_capacity: usize, output_capacity: usize) usize {
+    return depth * (std.mem.alignForward(usize, frame_capacity, 64) + std.mem.alignForward(usize, output_capacity, 64));
+}
+
+/// Set up `depth` slots and start the compression worker. Slots are carved
+/// from `slot_memory` (at least `bufferBytes` long) when given, otherwise
+/// allocated. `frame_capacity` bounds submitted frame size; `output_capacity`
+/// must be at least `lz4.compressBound(frame_capacity)`.
+pub fn create(allocator: std.mem.Allocator, comp: Connection.Compressor, depth: usize, frame_capacity: usize, output_capacity: usize, slot_memory: ?[]u8) !*Pipeline {
+    std.debug.assert(depth >= 2 and depth <= max_depth);
+    const self = try allocator.create(Pipeline);
+    errdefer allocator.destroy(self);
+    self.* = .{ .allocator = allocator, .comp = comp, .depth = depth };
+
+    const total = bufferBytes(depth, frame_capacity, output_capacity);
+    const memory = slot_memory orelse blk: {
+        self.owned = try allocator.alloc(u8, total);
+        break :blk self.owned.?;
+    };
+    errdefer if (self.owned) |m| allocator.free(m);
+    std.debug.assert(memory.len >= total);
+
+    var off: usize = 0;
+    for (self.slots[0..depth]) |*slot| {
+        const input = memory[off..][0..frame_capacity];
+        off += std.mem.alignForward(usize, frame_capacity, 64);
+        const output = memory[off..][0..output_capacity];
+        off += std.mem.alignForward(usize, output_capacity, 64);
+        slot.* = .{ .input = input, .output = output };
+    }
+
+    self.thread = try std.Thread.spawn(.{}, worker, .{self});
+    return self;
+}
+
+/// Stop the worker and free the pipeline. Frames not yet sent are dropped;
+/// call `flush` first to send them.
+pub fn destroy(self: *Pipeline) void {
+    self.mutex.lock();
+    self.stopping = true;
+    self.cond.broadcast();
+    self.mutex.unlock();
+    self.thread.join();
+
+    if (self.owned) |m| self.allocator.free(m);
+    self.allocator.destroy(self);
+}
+
+/// Queue `frame` for compression, then send the frames ahead of it until at
+/// most `depth - 1` remain in flight. `frame` is copied; the caller keeps
+/// ownership. Not thread-safe: call from one sending thread.
+pub fn submit(self: *Pipeline, conn: *Connection, frame: []const u8, opts: Connection.FrameOpts) Connection.Error!void {
+    const slot = try self.claim(conn, frame.len, opts);
+    @memcpy(slot.input[0..frame.len], frame);
+    try self.publish(conn);
+}
+
+/// `submit` for a frame in a host pixel format: it is converted straight
+/// into the slot, in place of the copy `submit` makes.
+pub fn submitSource(self: *Pipeline, conn: *Connection, source: *const ingest.Source, opts: Connection.FrameOpts) Connection.Error!void {
+    const len = source.frameBytes();
+    const slot = try self.claim(conn, len, opts);
+    source.read(0, slot.input[0..len]);
+    try self.publish(conn);
+}
+
+/// `submit` for a frame held in several buffers: they are gathered straight
+/// into the slot.
+pub fn submitGather(self: *Pipeline, conn: *Connection, parts: []const []const u8, opts: Connection.FrameOpts) Connection.Error!void {
+    const len = Connection.gatherLen(parts);
+    const slot = try self.claim(conn, len, opts);
+    Connection.gatherInto(parts, slot.input[0..len]);
+    try self.publish(conn);
+}
+
+/// Take the next free slot for a frame of `len` bytes.
+fn claim(self: *Pipeline, conn: *Connection, len: usize, opts: Connection.FrameOpts) Connection.Error!*Slot {
+    if (len > self.slots[0].input.len) return Connection.Error.FrameTooLarge;
+    std.debug.assert(self.submitted - self.sent < self.depth);
+
+    // A keyframe request must reach the compressor before this frame does
+    if (conn.loss.takeResync(opts.field)) self.comp.requestKeyframe(opts.field);
+
+    // The slot's previous frame has been sent, so the worker is done with it
+    const slot = &self.slots[self.submitted % self.depth];
+    slot.len = len;
+    slot.opts = opts;
+    return slot;
+}
+
+/// Hand the claimed slot to the worker and send until at most `depth - 1`
+/// frames remain in flight.
+fn publish(self: *Pipeline, conn: *Connection) Connection.Error!void {
+    self.mutex.lock();
+    self.submitted += 1;
+    self.cond.broadcast();
+    self.mutex.unlock();
+
+    while (self.submitted - self.sent > self.depth - 1) try self.sendNext(conn);
+}
+
+/// Send every queued frame, waiting for the worker as needed.
+pub fn flush(self: *Pipeline, conn: *Connection) Connection.Error!void {
+    while (self.sent < self.submitted) try self.sendNext(conn);
+}
+
+/// Snapshot of the per-stage timings.
+pub fn getStats(self: *Pipeline) Stats {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    return self.stats;
+}
+
+/// Wait for the oldest unsent frame to finish compressing and send it.
+/// The frame is consumed even if compression or sending fails.
+fn sendNext(self: *Pipeline, conn: *Connection) Connection.Error!void {
+    const wait_start = clock.nowNs();
+    self.mutex.lock();
+    while (self.compressed == self.sent) self.cond.wait(&self.mutex);
+    self.mutex.unlock();
+
+    const send_start = clock.nowNs();
+    const slot = &self.slots[self.sent % self.depth];
+    self.sent += 1;
+    const result = slot.result orelse return Connection.Error.CompressFailed;
+    try conn.sendCompressed(result, slot.opts);
+    const send_end = clock.nowNs();
+
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    self.stats.frames += 1;
+    self.stats.avg_stall_ns = ema(self.stats.avg_stall_ns, send_start -| wait_start);
+    self.stats.avg_send_ns = ema(self.stats.avg_send_ns, send_end -| send_start);
+}
+
+fn worker(self: *Pipeline) void {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    while (true) {
+        while (self.compressed == self.submitted and !self.stopping) self.cond.wait(&self.mutex);
+        if (self.stopping) return;
+        const slot = &self.slots[self.compressed % self.depth];
+        self.mutex.unlock();
+
+        const start = clock.nowNs();
+        var result = self.comp.compressFn(self.comp.ctx, slot.input[0..slot.len], slot.output, slot.opts.field);
+        // Compressors may return data in their own buffers (e.g. a keyframe
+        // candidate); move it into the slot so the next frame can't overwrite it.
+        if (result) |*r| if (!within(slot.output, r.data)) {
+            @memcpy(slot.output[0..r.data.len], r.data);
+            r.data = slot.output[0..r.data.len];
+        };
+        slot.result = result;
+        const elapsed = clock.nowNs() -| start;
+
+        self.mutex.lock();
+        self.stats.avg_compress_ns = ema(self.stats.avg_compress_ns, elapsed);
+        self.compressed += 1;
+        self.cond.broadcast();
+    }
+}
+
+fn within(buf: []const u8, data: []const u8) bool {
+    const lo = @intFromPtr(buf.ptr);
+    const p = @intFromPtr(data.ptr);
+    return p >= lo and p + data.len <= lo + buf.len;
+}
+
+fn ema(avg: f64, sample_ns: u64) f64 {
+    const x: f64 = @floatFromInt(sample_ns);
+    return if (avg == 0) x else avg + ema_alpha * (x - avg);
+}
+
+// --- Tests ---
+
+/// Records the first byte of every frame in compression order.
+const OrderLog = struct {
+    seen: [64]u8 = undefined,
+    n: usize = 0,
+};
+
+fn loggingCompress(ctx: ?*anyopaque, src: []const u8, dst: []u8, _: u8) ?Connection.CompressResult {
+    const log: *OrderLog = @ptrCast(@alignCast(ctx.?));
+    log.seen[log.n] = src[0];
+    log.n += 1;
+    @memcpy(dst[0..src.len], src);
+    return .{ .data = dst[0..src.len], .is_delta = false };
+}
+
+var foreign_buf: [16]u8 = undefined;
+
+fn foreignCompress(_: ?*anyopaque, src: []const u8, _: []u8, _: u8) ?Connection.CompressResult {
+    @memcpy(foreign_buf[0..src.len], src);
+    return .{ .data = foreign_buf[0..src.len], .is_delta = false };
+}
+
+test "Pipeline compresses and sends frames in submission order" {
+    var log = OrderLog{};
+    const comp = Connection.Compressor{ .ctx = &log, .buf = &.{}, .compressFn = &loggingCompress };
+    var conn = try Connection.open(.{ .host = "127.0.0.1", .port = 9999 });
+    defer conn.close();
+
+    const p = try Pipeline.create(std.testing.allocator, comp, 2, 64, 128, null);
+    defer p.destroy();
+
+    for (0..20) |i| {
+        const frame = [_]u8{@intCast(i)} ** 32;
+        try p.submit(&conn, &frame, .{ .frame_num = @intCast(i) });
+        // Latency bound: at most depth - 1 frames left in flight
+        try std.testing.expect(p.submitted - p.sent <= 1);
+    }
+    try p.flush(&conn);
+    try std.testing.expectEqual(p.submitted, p.sent);
+    try std.testing.expectEqual(@as(usize, 20), log.n);
+    for (log.seen[0..20], 0..) |b, i| try std.testing.expectEqual(@as(u8, @intCast(i)), b);
+    try std.testing.expectEqual(@as(u64, 20), p.getStats().frames);
+}
+
+test "Pipeline copies results returned outside the slot buffer" {
+    const comp = Connection.Compressor{ .ctx = null, .buf = &.{}, .compressFn = &foreignCompress };
+    var conn = try Connection.open(.{ .host = "127.0.0.1", .port = 9999 });
+    defer conn.close();
+
+    const p = try Pipeline.create(std.testing.allocator, comp, 3, 16, 16, null);
+    defer p.destroy();
+
+    const frame = [_]u8{0x5A} ** 16;
+    try p.submit(&conn, &frame, .{ .frame_num = 1 });
+    p.mutex.lock();
+    while (p.compressed == 0) p.cond.wait(&p.mutex);
+    p.mutex.unlock();
+    const r = p.slots[0].result.?;
+    try std.testing.expect(within(p.slots[0].output, r.data));
+    try std.testing.expectEqualSlices(u8, &frame, r.data);
+    try p.flush(&conn);
+}
+
+test "Pipeline rejects frames larger than the slot capacity" {
+    const comp = Connection.Compressor{ .ctx = null, .buf = &.{}, .compressFn = &foreignCompress };
+    var conn = try Connection.open(.{ .host = "127.0.0.1", .port = 9999 });
+    defer conn.close();
+
+    const p = try Pipeline.create(std.testing.allocator, comp, 2, 16, 16, null);
+    defer p.destroy();
+
+    const frame = [_]u8{0} ** 17;
+    try std.testing.expectError(Connection.Error.FrameTooLarge, p.submit(&conn, &frame, .{ .frame_num = 1 }));
+}
+
+test "Pipeline carves slots from caller-supplied memory" {
+    const comp = Connection.Compressor{ .ctx = null, .buf = &.{}, .compressFn = &foreignCompress };
+    var conn = try Connection.open(.{ .host = "127.0.0.1", .port = 9999 });
+    defer conn.close();
+
+    var memory: [bufferBytes(2, 16, 16)]u8 align(64) = undefined;
+    const p = try Pipeline.create(std.testing.allocator, comp, 2, 16, 16, &memory);
+    defer p.destroy();
+    try std.testing.expect(p.owned == null);
+    try std.testing.expect(within(&memory, p.slots[1].output));
+
+    const frame = [_]u8{0x33} ** 16;
+    try p.submit(&conn, &frame, .{ .frame_num = 1 });
+    try p.flush(&conn);
+}
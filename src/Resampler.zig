@@ -0,0 +1,227 @@
+//! Fractional-ratio resampler for 16-bit PCM, and the controller that keeps
+//! the audio buffered ahead of the FPGA at a target depth with it.
+//!
+//! Hosts paced to the FPGA generate audio at a rate tied to the FPGA's video
+//! clock, while the FPGA plays at the nominal sound rate. The two drift
+//! apart by a few hundred ppm at most, so the buffered audio slowly grows
+//! (the ring overruns, dropping samples) or runs dry (gaps). `Control`
+//! watches the audio written but not yet played, sampled once per frame,
+//! and steers `ratio` a tiny fraction away from 1 so the depth stays put.
+//!
+//! Interpolation is a 16-tap Blackman-windowed sinc: 256 phases tabulated at
+//! comptime, linearly blended between adjacent phases, and applied as one
+//! vector dot product per output sample and channel.
+
+const std = @import("std");
+
+const Resampler = @This();
+
+pub const taps = 16;
+pub const phases = 256;
+/// Input frames buffered per refill.
+pub const block = 512;
+pub const max_channels = 2;
+
+const Taps = @Vector(taps, f32);
+
+/// Filter coefficients for each fractional delay `p / phases`, plus one
+/// extra row (delay 1) to blend against. Each row sums to 1.
+const table: [phases + 1]Taps = blk: {
+    @setEvalBranchQuota(100_000);
+    var rows: [phases + 1]Taps = undefined;
+    for (&rows, 0..) |*row, p| {
+        const frac = @as(f64, @floatFromInt(p)) / phases;
+        var k: [taps]f64 = undefined;
+        var sum: f64 = 0;
+        for (&k, 0..) |*c, j| {
+            const d = @as(f64, @floatFromInt(j)) - (taps / 2 - 1) - frac;
+            const sinc = if (@abs(d) < 1e-9) 1.0 else @sin(std.math.pi * d) / (std.math.pi * d);
+            // Blackman window over [-taps/2, taps/2]
+            const w = 2 * std.math.pi * (d + taps / 2) / taps;
+            const window = 0.42 - 0.5 * @cos(w) + 0.08 * @cos(2 * w);
+            c.* = sinc * window;
+            sum += c.*;
+        }
+        var out: [taps]f32 = undefined;
+        for (&out, k) |*o, c| o.* = @floatCast(c / sum);
+        row.* = out;
+    }
+    break :blk rows;
+};
+
+channels: usize,
+/// Input frames consumed per output frame: above 1 shortens the stream.
+ratio: f64 = 1.0,
+/// Read position of the next output's first tap in `buf`.
+pos: f64 = 0,
+/// Frames held in `buf`.
+len: usize = taps / 2 - 1,
+/// Deinterleaved input history, primed with silence so output frame `n`
+/// lines up with input frame `n` at ratio 1.
+buf: [max_channels][taps + block]f32 = .{.{0} ** (taps + block)} ** max_channels,
+
+pub fn init(channels: usize) Resampler {
+    std.debug.assert(channels >= 1 and channels <= max_channels);
+    return .{ .channels = channels };
+}
+
+pub const Progress = struct {
+    /// Input bytes consumed.
+    consumed: usize,
+    /// Output bytes written.
+    produced: usize,
+};
+
+/// Resample interleaved s16le frames from `in` into `out` until the input is
+/// used up or `out` is full. Input that arrives in pieces resamples exactly
+/// as if it had been passed at once.
+pub fn process(self: *Resampler, in: []const u8, out: []u8) Progress {
+    const frame_bytes = 2 * self.channels;
+    var consumed: usize = 0;
+    var produced: usize = 0;
+    while (true) {
+        while (produced + frame_bytes <= out.len) {
+            const i: usize = @intFromFloat(self.pos);
+            if (i + taps > self.len) break;
+            const k = kernel(self.pos - @floor(self.pos));
+            for (0..self.channels) |c| {
+                const x: Taps = self.buf[c][i..][0..taps].*;
+                writeSample(out[produced + 2 * c ..][0..2], @reduce(.Add, x * k));
+            }
+            produced += frame_bytes;
+            self.pos += self.ratio;
+        }
+        if (produced + frame_bytes > out.len) break;
+
+        // Out of lookahead: drop frames already behind `pos`, then refill
+        const drop = @min(@as(usize, @intFromFloat(self.pos)), self.len);
+        for (self.buf[0..self.channels]) |*ch| {
+            std.mem.copyForwards(f32, ch[0 .. self.len - drop], ch[drop..self.len]);
+        }
+        self.len -= drop;
+        self.pos -= @floatFromInt(drop);
+        const n = @min(self.buf[0].len - self.len, (in.len - consumed) / frame_bytes);
+        if (n == 0) break;
+        for (0..n) |f| {
+            const frame = in[consumed + f * frame_bytes ..];
+            for (0..self.channels) |c| {
+                const s = std.mem.readInt(i16, frame[2 * c ..][0..2], .little);
+                self.buf[c][self.len + f] = @as(f32, @floatFromInt(s)) / 32768.0;
+            }
+        }
+        self.len += n;
+        consumed += n * frame_bytes;
+    }
+    return .{ .consumed = consumed, .produced = produced };
+}
+
+/// Coefficients for fractional delay `frac` in [0, 1).
+fn kernel(frac: f64) Taps {
+    const x = frac * phases;
+    const p = @min(@as(usize, @intFromFloat(x)), phases - 1);
+    const t: Taps = @splat(@floatCast(x - @as(f64, @floatFromInt(p))));
+    return table[p] + (table[p + 1] - table[p]) * t;
+}
+
+fn writeSample(out: *[2]u8, s: f32) void {
+    const v = std.math.clamp(@round(s * 32768.0), -32768.0, 32767.0);
+    std.mem.writeInt(i16, out, @intFromFloat(v), .little);
+}
+
+/// Ratio controller: a PI loop on the smoothed buffer depth (written but not
+/// yet played), updated on a fixed cadence. The ratio moves continuously
+/// (sub-ppm steps) and stays within `max_deviation` of 1.
+pub const Control = struct {
+    /// Depth to hold, in bytes.
+    target: f64,
+    /// Smoothed depth.
+    fill: f64 = 0,
+    integral: f64 = 0,
+    primed: bool = false,
+
+    /// Depth smoothing per update.
+    pub const smoothing = 0.05;
+    /// Ratio change per unit of relative depth error (twice the target
+    /// gives +1000 ppm).
+    pub const kp = 0.001;
+    /// Integral gain per update: removes the steady offset a constant drift
+    /// leaves with `kp` alone.
+    pub const ki = 0.00002;
+    /// Largest correction: far beyond any clock drift, small enough to be
+    /// inaudible as pitch.
+    pub const max_deviation = 0.005;
+
+    pub fn init(target_bytes: usize) Control {
+        return .{ .target = @floatFromInt(@max(target_bytes, 1)) };
+    }
+
+    /// Record the current depth and return the ratio to resample with.
+    pub fn update(self: *Control, depth_bytes: u64) f64 {
+        const f: f64 = @floatFromInt(depth_bytes);
+        if (!self.primed) {
+            self.fill = f;
+            self.primed = true;
+        }
+        self.fill += (f - self.fill) * smoothing;
+        const err = (self.fill - self.target) / self.target;
+        self.integral = std.math.clamp(self.integral + err * ki, -max_deviation, max_deviation);
+        return 1.0 + std.math.clamp(err * kp + self.integral, -max_deviation, max_deviation);
+    }
+};
+
+// --- Tests ---
+
+fn testTone(out: []u8, channels: usize, period: f64) void {
+    for (0..out.len / (2 * channels)) |f| {
+        const s = @sin(2 * std.math.pi * @as(f64, @floatFromInt(f)) / period) * 16000;
+        for (0..channels) |c| {
+            std.mem.writeInt(i16, out[(f * channels + c) * 2 ..][0..2], @intFromFloat(@round(s)), .little);
+        }
+    }
+}
+
+test "ratio 1 passes samples through unchanged" {
+    var rs = Resampler.init(2);
+    var in: [4000]u8 = undefined;
+    testTone(&in, 2, 37.0);
+    var out: [4000]u8 = undefined;
+    // Feed in two uneven pieces
+    const a = rs.process(in[0..1236], &out);
+    const b = rs.process(in[a.consumed..], out[a.produced..]);
+    const produced = a.produced + b.produced;
+    try std.testing.expectEqual(in.len, a.consumed + b.consumed);
+    // The last taps/2 frames wait for lookahead
+    try std.testing.expectEqual(in.len - (taps / 2) * 4, produced);
+    try std.testing.expectEqualSlices(u8, in[0..produced], out[0..produced]);
+}
+
+test "ratio above 1 shortens the stream and keeps the tone" {
+    var rs = Resampler.init(1);
+    rs.ratio = 1.01;
+    var in: [20000]u8 = undefined;
+    testTone(&in, 1, 50.0);
+    var out: [20000]u8 = undefined;
+    const p = rs.process(&in, &out);
+    try std.testing.expectEqual(in.len, p.consumed);
+    const frames = p.produced / 2;
+    try std.testing.expectApproxEqAbs(@as(f64, 9900), @as(f64, @floatFromInt(frames)), 20);
+    // Output frame n is input time n * 1.01: compare against the ideal tone
+    for (100..frames) |n| {
+        const t = @as(f64, @floatFromInt(n)) * 1.01;
+        const ideal = @sin(2 * std.math.pi * t / 50.0) * 16000;
+        const got = std.mem.readInt(i16, out[n * 2 ..][0..2], .little);
+        try std.testing.expectApproxEqAbs(ideal, @as(f64, @floatFromInt(got)), 40);
+    }
+}
+
+test "control steers the ratio toward the target depth" {
+    var ctl = Control.init(8000);
+    try std.testing.expectApproxEqAbs(@as(f64, 1.0), ctl.update(8000), 1e-9);
+    // Audio piling up: consume input faster
+    var ratio: f64 = 1;
+    for (0..100) |_| ratio = ctl.update(16000);
+    try std.testing.expect(ratio > 1.0 and ratio <= 1.0 + Control.max_deviation);
+    // Running dry: slow down
+    for (0..2000) |_| ratio = ctl.update(0);
+    try std.testing.expect(ratio < 1.0 and ratio >= 1.0 - Control.max_deviation);
+}
@@ -0,0 +1,427 @@
+//! Shared-memory frame and audio ring between a host process and
+//! `gmz-daemon`. The host creates a memfd holding a header, three frame
+//! slots and an audio byte ring, and passes it to the daemon over a Unix
+//! socket together with an eventfd it signals on every commit.
+//!
+//! Frames use a triple buffer: the host renders into its back slot and
+//! publishes it with one atomic exchange, the daemon takes the newest
+//! published slot with another. Neither side ever waits for the other, and
+//! frames the daemon had no time for are simply overwritten. Audio is a
+//! single-producer, single-consumer byte ring. The modeline is guarded by
+//! a sequence counter. Linux only.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const posix = std.posix;
+
+const ShmRing = @This();
+
+/// Whether shared-memory rings are available on this target.
+pub const supported = builtin.os.tag == .linux;
+
+/// Socket the daemon listens on when none is given.
+pub const default_socket_path = "/tmp/gmz-daemon.sock";
+
+pub const magic: u32 = 0x535A4D47; // "GMZS"
+pub const layout_version: u32 = 1;
+
+/// Frame slots: one being written, one published, one being sent.
+pub const slot_count = 3;
+const index_mask: u32 = 0x3;
+const fresh_bit: u32 = 0x4;
+
+/// Connection settings, written by the host before the ring is handed over.
+pub const Config = extern struct {
+    /// FPGA address, NUL-terminated.
+    host: [64]u8 = .{0} ** 64,
+    mtu: u16 = 1500,
+    rgb_mode: u8 = 0,
+    lz4_mode: u8 = 0,
+    sound_rate: u8 = 0,
+    sound_channels: u8 = 0,
+    /// Host pixel format of the frames (`ingest.PixelFormat`).
+    format: u8 = 0,
+    _pad: u8 = 0,
+    slot_bytes: u32 = 0,
+    /// Audio ring size: a power of two, a multiple of 4 (0 = no audio).
+    audio_bytes: u32 = 0,
+};
+
+/// Modeline as stored in the ring (the field names of `gmz_modeline_t`).
+pub const Mode = extern struct {
+    pixel_clock: f64 = 0,
+    h_active: u16 = 0,
+    h_begin: u16 = 0,
+    h_end: u16 = 0,
+    h_total: u16 = 0,
+    v_active: u16 = 0,
+    v_begin: u16 = 0,
+    v_end: u16 = 0,
+    v_total: u16 = 0,
+    interlaced: u8 = 0,
+    _pad: [7]u8 = .{0} ** 7,
+};
+
+/// Metadata of one published frame.
+pub const SlotInfo = extern struct {
+    frame: u32 = 0,
+    len: u32 = 0,
+    vsync_line: u16 = 0,
+    field: u8 = 0,
+    _pad: u8 = 0,
+};
+
+/// Start of the shared mapping.
+pub const Header = extern struct {
+    magic: u32,
+    version: u32,
+    config: Config,
+    /// Odd while the host is writing `mode`.
+    mode_seq: u32 = 0,
+    mode: Mode = .{},
+    /// Newest published slot, with `fresh_bit` until the daemon takes it.
+    ready: u32 align(64) = 1,
+    /// Audio bytes written, free-running.
+    audio_head: u32 align(64) = 0,
+    /// Audio bytes consumed, free-running.
+    audio_tail: u32 align(64) = 0,
+    slots: [slot_count]SlotInfo align(64) = .{SlotInfo{}} ** slot_count,
+};
+
+/// File seals (linux/fcntl.h). A sealed size means a host cannot shrink
+/// the memfd under the daemon's mapping, which would SIGBUS the daemon.
+const f_add_seals = 1033;
+const f_get_seals = 1034;
+const seal_seal = 0x1;
+const seal_shrink = 0x2;
+const seal_grow = 0x4;
+const required_seals = seal_shrink | seal_grow;
+
+const page = std.heap.page_size_min;
+const slot_align = 64;
+
+// --- State ---
+fd: posix.fd_t,
+memory: []align(page) u8,
+header: *Header,
+/// Copy of `header.config` taken when the ring was set up. The daemon never
+/// trusts the shared copy again, so a host cannot resize slots under it.
+config: Config,
+
+/// Offset of the first frame slot.
+const slots_offset = std.mem.alignForward(usize, @sizeOf(Header), page);
+
+/// Mapping size for `slot_bytes`-sized frames and `audio_bytes` of audio.
+pub fn sizeFor(slot_bytes: usize, audio_bytes: usize) usize {
+    return slots_offset + slot_count * std.mem.alignForward(usize, slot_bytes, slot_align) + audio_bytes;
+}
+
+/// Create a ring in a new memfd (host side). Its size is sealed.
+pub fn create(config: Config) !ShmRing {
+    std.debug.assert(config.audio_bytes % 4 == 0 and (config.audio_bytes == 0 or std.math.isPowerOfTwo(config.audio_bytes)));
+    const fd = try posix.memfd_create("gmz-ring", std.os.linux.MFD.CLOEXEC | std.os.linux.MFD.ALLOW_SEALING);
+    errdefer posix.close(fd);
+    const size = sizeFor(config.slot_bytes, config.audio_bytes);
+    try posix.ftruncate(fd, size);
+    if (std.os.linux.E.init(std.os.linux.fcntl(fd, f_add_seals, required_seals | seal_seal)) != .SUCCESS) return error.SealFailed;
+    var self = try mapFd(fd, size);
+    self.header.* = .{ .magic = magic, .version = layout_version, .config = config };
+    self.config = config;
+    return self;
+}
+
+/// Map a ring received from a host (daemon side). Takes ownership of `fd`.
+/// Rejects a memfd whose size is not sealed.
+pub fn open(fd: posix.fd_t) !ShmRing {
+    errdefer posix.close(fd);
+    // Raw syscall: a host may pass any fd, and EINVAL must be an error here
+    const seals = std.os.linux.fcntl(fd, f_get_seals, 0);
+    if (std.os.linux.E.init(seals) != .SUCCESS or seals & required_seals != required_seals) return error.BadRing;
+    const size: usize = @intCast((try posix.fstat(fd)).size);
+    if (size < @sizeOf(Header)) return error.BadRing;
+    var self = try mapFd(fd, size);
+    errdefer posix.munmap(self.memory);
+    const h = self.header;
+    if (h.magic != magic or h.version != layout_version) return error.BadRing;
+    self.config = h.config;
+    const audio = self.config.audio_bytes;
+    if (audio % 4 != 0 or (audio != 0 and !std.math.isPowerOfTwo(audio))) return error.BadRing;
+    if (sizeFor(self.config.slot_bytes, audio) > size) return error.BadRing;
+    return self;
+}
+
+fn mapFd(fd: posix.fd_t, size: usize) !ShmRing {
+    const memory = try posix.mmap(null, size, posix.PROT.READ | posix.PROT.WRITE, .{ .TYPE = .SHARED }, fd, 0);
+    return .{ .fd = fd, .memory = memory, .header = @ptrCast(memory.ptr), .config = .{} };
+}
+
+/// Unmap the ring and close its memfd.
+pub fn deinit(self: *ShmRing) void {
+    posix.munmap(self.memory);
+    posix.close(self.fd);
+    self.* = undefined;
+}
+
+/// Frame slot `i`, `slot_bytes` long and cache-line aligned.
+pub fn slot(self: *const ShmRing, i: u32) []u8 {
+    const stride = std.mem.alignForward(usize, self.config.slot_bytes, slot_align);
+    return self.memory[slots_offset + i * stride ..][0..self.config.slot_bytes];
+}
+
+// --- Frames ---
+
+/// Host: publish back slot `back`, whose `SlotInfo` is filled in, and
+/// return the slot to render the next frame into.
+pub fn publish(self: *ShmRing, back: u32) u32 {
+    const prev = @atomicRmw(u32, &self.header.ready, .Xchg, back | fresh_bit, .acq_rel);
+    return prev & index_mask;
+}
+
+/// Daemon: whether a frame was published since the last `take`.
+pub fn pending(self: *const ShmRing) bool {
+    return @atomicLoad(u32, &self.header.ready, .acquire) & fresh_bit != 0;
+}
+
+/// Daemon: swap out the newest published slot for `front`, the slot it is
+/// done with, or null when nothing new was published since the last take
+/// (or the host wrote a slot index out of range).
+pub fn take(self: *ShmRing, front: u32) ?u32 {
+    if (!self.pending()) return null;
+    const prev = @atomicRmw(u32, &self.header.ready, .Xchg, front, .acq_rel);
+    const i = prev & index_mask;
+    return if (i < slot_count) i else null;
+}
+
+// --- Modeline ---
+
+/// Host: store a new modeline.
+pub fn setMode(self: *ShmRing, mode: Mode) void {
+    const h = self.header;
+    // Odd while writing; the acquire keeps the writes below it
+    const seq = @atomicRmw(u32, &h.mode_seq, .Add, 1, .acq_rel);
+    @as(*volatile Mode, &h.mode).* = mode;
+    @atomicStore(u32, &h.mode_seq, seq +% 2, .release);
+}
+
+/// Daemon: the modeline, when it changed since `seen` (updated on return).
+/// Never waits for the host: null too while a `setMode` is in progress or
+/// overlapped the read, and the change is picked up on a later call. A host
+/// that dies mid-write leaves the seq odd for good, and must not keep the
+/// caller from reaching its hangup check.
+pub fn modeChanged(self: *ShmRing, seen: *u32) ?Mode {
+    const h = self.header;
+    const seq = @atomicLoad(u32, &h.mode_seq, .acquire);
+    if (seq == seen.* or seq & 1 != 0) return null;
+    const mode = @as(*volatile Mode, &h.mode).*;
+    // A no-op RMW orders the reads above before the re-check
+    if (@atomicRmw(u32, &h.mode_seq, .Add, 0, .acq_rel) != seq) return null;
+    seen.* = seq;
+    return mode;
+}
+
+// --- Audio ---
+
+fn audioRing(self: *const ShmRing) []u8 {
+    return self.memory[sizeFor(self.config.slot_bytes, 0)..][0..self.config.audio_bytes];
+}
+
+/// Host: queue PCM, dropping what doesn't fit. Whole 4-byte frames only.
+/// Returns the bytes queued.
+pub fn writeAudio(self: *ShmRing, pcm: []const u8) usize {
+    const ring = self.audioRing();
+    const h = self.header;
+    const head = @atomicLoad(u32, &h.audio_head, .monotonic);
+    const tail = @atomicLoad(u32, &h.audio_tail, .acquire);
+    const free = ring.len - (head -% tail);
+    const n = @min(pcm.len, free) & ~@as(usize, 3);
+    if (n == 0) return 0;
+    const at = head & (ring.len - 1);
+    const first = @min(n, ring.len - at);
+    @memcpy(ring[at..][0..first], pcm[0..first]);
+    @memcpy(ring[0 .. n - first], pcm[first..n]);
+    @atomicStore(u32, &h.audio_head, head +% @as(u32, @intCast(n)), .release);
+    return n;
+}
+
+/// Daemon: the queued audio, in up to two pieces (the ring may wrap).
+pub fn readableAudio(self: *ShmRing) [2][]const u8 {
+    const ring = self.audioRing();
+    if (ring.len == 0) return .{ &.{}, &.{} };
+    const h = self.header;
+    const head = @atomicLoad(u32, &h.audio_head, .acquire);
+    const tail = @atomicLoad(u32, &h.audio_tail, .monotonic);
+    const n: usize = @min(head -% tail, ring.len);
+    const at = tail & (ring.len - 1);
+    const first = @min(n, ring.len - at);
+    return .{ ring[at..][0..first], ring[0 .. n - first] };
+}
+
+/// Daemon: release `n` bytes returned by `readableAudio`.
+pub fn consumeAudio(self: *ShmRing, n: usize) void {
+    const h = self.header;
+    const tail = @atomicLoad(u32, &h.audio_tail, .monotonic);
+    @atomicStore(u32, &h.audio_tail, tail +% @as(u32, @intCast(n)), .release);
+}
+
+// --- Handover ---
+
+const scm_rights = 1;
+const msg_cmsg_cloexec = 0x40000000;
+
+/// Control message carrying the ring's memfd and eventfd.
+const FdMessage = extern struct {
+    len: usize = @sizeOf(FdMessage),
+    level: c_int = posix.SOL.SOCKET,
+    type: c_int = scm_rights,
+    fds: [2]posix.fd_t,
+};
+
+/// Host: pass `fds` (memfd, eventfd) over a connected Unix socket.
+pub fn sendFds(sock: posix.socket_t, fds: [2]posix.fd_t) !void {
+    const byte = [1]u8{0};
+    const iov = [_]posix.iovec_const{.{ .base = &byte, .len = 1 }};
+    var control = FdMessage{ .fds = fds };
+    const msg = posix.msghdr_const{
+        .name = null,
+        .namelen = 0,
+        .iov = &iov,
+        .iovlen = iov.len,
+        .control = &control,
+        .controllen = @sizeOf(FdMessage),
+        .flags = 0,
+    };
+    _ = try posix.sendmsg(sock, &msg, 0);
+}
+
+/// Daemon: receive the fds sent by `sendFds`.
+pub fn recvFds(sock: posix.socket_t) ![2]posix.fd_t {
+    const linux = std.os.linux;
+    var byte: [1]u8 = undefined;
+    var iov = [_]posix.iovec{.{ .base = &byte, .len = 1 }};
+    var control: FdMessage = .{ .len = 0, .fds = .{ -1, -1 } };
+    var msg = linux.msghdr{
+        .name = null,
+        .namelen = 0,
+        .iov = &iov,
+        .iovlen = iov.len,
+        .control = &control,
+        .controllen = @sizeOf(FdMessage),
+        .flags = 0,
+    };
+    while (true) {
+        const rc = linux.recvmsg(sock, &msg, msg_cmsg_cloexec);
+        switch (linux.E.init(rc)) {
+            .SUCCESS => break,
+            .INTR => continue,
+            else => return error.RecvFailed,
+        }
+    }
+    if (control.len != @sizeOf(FdMessage) or control.level != posix.SOL.SOCKET or control.type != scm_rights) {
+        return error.NoFds;
+    }
+    return control.fds;
+}
+
+/// Host: wake the daemon (`eventfd` counter += 1).
+pub fn signal(efd: posix.fd_t) void {
+    const one: u64 = 1;
+    _ = posix.write(efd, std.mem.asBytes(&one)) catch {};
+}
+
+// --- Tests ---
+
+fn testConfig() Config {
+    return .{ .slot_bytes = 1000, .audio_bytes = 64 };
+}
+
+test "triple buffer hands the daemon the newest frame only" {
+    if (!supported) return error.SkipZigTest;
+    var ring = try ShmRing.create(testConfig());
+    defer ring.deinit();
+
+    var back: u32 = 0;
+    var front: u32 = 2;
+    try std.testing.expectEqual(@as(?u32, null), ring.take(front));
+
+    // Two frames before the daemon looks: the first is overwritten
+    ring.slot(back)[0] = 1;
+    back = ring.publish(back);
+    ring.slot(back)[0] = 2;
+    back = ring.publish(back);
+    front = ring.take(front).?;
+    try std.testing.expectEqual(@as(u8, 2), ring.slot(front)[0]);
+    try std.testing.expectEqual(@as(?u32, null), ring.take(front));
+
+    // The three slots stay distinct
+    try std.testing.expect(back != front);
+    ring.slot(back)[0] = 3;
+    back = ring.publish(back);
+    try std.testing.expect(back != front);
+    front = ring.take(front).?;
+    try std.testing.expectEqual(@as(u8, 3), ring.slot(front)[0]);
+}
+
+test "audio ring wraps and drops what does not fit" {
+    if (!supported) return error.SkipZigTest;
+    var ring = try ShmRing.create(testConfig());
+    defer ring.deinit();
+
+    var pcm: [48]u8 = undefined;
+    for (&pcm, 0..) |*b, i| b.* = @truncate(i);
+    try std.testing.expectEqual(@as(usize, 48), ring.writeAudio(&pcm));
+    ring.consumeAudio(40);
+    // 56 free, wrapping past the end; 2 stray bytes are not a whole frame
+    var odd: [50]u8 = undefined;
+    @memset(&odd, 0xEE);
+    try std.testing.expectEqual(@as(usize, 48), ring.writeAudio(&odd));
+    const pieces = ring.readableAudio();
+    try std.testing.expectEqual(@as(usize, 56), pieces[0].len + pieces[1].len);
+    try std.testing.expectEqualSlices(u8, pcm[40..48], pieces[0][0..8]);
+    try std.testing.expectEqual(@as(usize, 8), ring.writeAudio(&pcm));
+    try std.testing.expectEqual(@as(usize, 0), ring.writeAudio(&pcm));
+}
+
+test "daemon side maps the ring received over a socket" {
+    if (!supported) return error.SkipZigTest;
+    var ring = try ShmRing.create(testConfig());
+    defer ring.deinit();
+    ring.setMode(.{ .h_active = 320, .v_active = 240 });
+
+    var pair: [2]posix.socket_t = undefined;
+    try std.testing.expectEqual(@as(usize, 0), std.os.linux.socketpair(posix.AF.UNIX, posix.SOCK.STREAM, 0, &pair));
+    defer for (pair) |s| posix.close(s);
+    const efd = try posix.eventfd(0, std.os.linux.EFD.CLOEXEC);
+    defer posix.close(efd);
+
+    try sendFds(pair[0], .{ ring.fd, efd });
+    const fds = try recvFds(pair[1]);
+    defer posix.close(fds[1]);
+    var remote = try ShmRing.open(fds[0]);
+    defer remote.deinit();
+
+    var seen: u32 = 0;
+    try std.testing.expectEqual(@as(u16, 320), remote.modeChanged(&seen).?.h_active);
+    try std.testing.expectEqual(@as(?Mode, null), remote.modeChanged(&seen));
+    // A host stuck halfway through setMode: no spinning, and the mode
+    // arrives once the write completes
+    const seq = @atomicRmw(u32, &ring.header.mode_seq, .Add, 1, .acq_rel);
+    try std.testing.expectEqual(@as(?Mode, null), remote.modeChanged(&seen));
+    ring.header.mode.h_active = 640;
+    @atomicStore(u32, &ring.header.mode_seq, seq +% 2, .release);
+    try std.testing.expectEqual(@as(u16, 640), remote.modeChanged(&seen).?.h_active);
+    ring.slot(0)[999] = 0x5A;
+    _ = ring.publish(0);
+    try std.testing.expectEqual(@as(u32, 0), remote.take(2).?);
+    try std.testing.expectEqual(@as(u8, 0x5A), remote.slot(0)[999]);
+}
+
+test "ring size is sealed and unsealed memfds are rejected" {
+    if (!supported) return error.SkipZigTest;
+    var ring = try ShmRing.create(testConfig());
+    defer ring.deinit();
+    try std.testing.expectError(error.AccessDenied, posix.ftruncate(ring.fd, page));
+
+    const fd = try posix.memfd_create("gmz-test", std.os.linux.MFD.CLOEXEC);
+    try posix.ftruncate(fd, sizeFor(1000, 64));
+    try std.testing.expectError(error.BadRing, ShmRing.open(fd));
+}
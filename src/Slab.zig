@@ -0,0 +1,164 @@
+//! One contiguous, pre-faulted allocation that a connection's frame buffers
+//! are carved from. On Linux the slab is backed by 2MB huge pages when the
+//! system has them reserved (MAP_HUGETLB), otherwise by 2MB-aligned pages
+//! advised for transparent huge pages. Either way every page is faulted in
+//! up front so the first frames don't pay for it. Full-frame passes over a
+//! handful of huge pages also stop missing the TLB.
+//!
+//! Embedders can supply their own `std.mem.Allocator` instead; its memory
+//! is still pre-faulted but huge pages are then up to the allocator.
+
+const std = @import("std");
+const builtin = @import("builtin");
+
+const Slab = @This();
+
+/// Huge page size targeted on Linux.
+pub const huge_page_size = 2 * 1024 * 1024;
+
+/// Alignment of every region handed out by `take` (one cache line).
+pub const region_align = 64;
+
+/// Where the slab memory came from.
+pub const Backing = enum {
+    /// Explicit huge pages (MAP_HUGETLB).
+    huge_pages,
+    /// Regular pages advised for transparent huge pages.
+    transparent_huge_pages,
+    /// Regular pages from the OS.
+    pages,
+    /// A caller-supplied allocator.
+    allocator,
+};
+
+const page_align = std.heap.page_size_min;
+
+// --- State ---
+memory: []u8,
+used: usize = 0,
+backing: Backing,
+/// Allocator that owns `memory`, unless it was mapped directly.
+allocator: ?std.mem.Allocator = null,
+/// Full mapping to unmap (may be larger than `memory`).
+mapping: []align(page_align) u8 = &.{},
+
+/// Bytes needed to `take` regions of the given sizes, in order.
+pub fn sizeFor(sizes: []const usize) usize {
+    var total: usize = 0;
+    for (sizes) |n| total += std.mem.alignForward(usize, n, region_align);
+    return total;
+}
+
+/// Allocate and pre-fault a slab of at least `size` bytes, from `allocator`
+/// when given, otherwise from the OS (huge pages where possible).
+pub fn init(size: usize, allocator: ?std.mem.Allocator) !Slab {
+    if (allocator) |a| {
+        const ptr = a.rawAlloc(@max(size, 1), .fromByteUnits(region_align), @returnAddress()) orelse
+            return error.OutOfMemory;
+        const memory = ptr[0..size];
+        prefault(memory);
+        return .{ .memory = memory, .backing = .allocator, .allocator = a };
+    }
+    if (builtin.os.tag == .linux) return initLinux(size);
+
+    const memory = try std.heap.page_allocator.alloc(u8, size);
+    prefault(memory);
+    return .{ .memory = memory, .backing = .pages, .allocator = std.heap.page_allocator };
+}
+
+/// Release the slab. Regions taken from it become invalid.
+pub fn deinit(self: *Slab) void {
+    if (self.mapping.len > 0) {
+        std.posix.munmap(self.mapping);
+    } else if (self.allocator) |a| {
+        if (self.backing == .allocator) {
+            a.rawFree(self.memory.ptr[0..@max(self.memory.len, 1)], .fromByteUnits(region_align), @returnAddress());
+        } else {
+            a.free(self.memory);
+        }
+    }
+    self.* = undefined;
+}
+
+/// Carve the next `n` bytes, cache-line aligned. The slab must have been
+/// sized with `sizeFor` to cover every region taken.
+pub fn take(self: *Slab, n: usize) []u8 {
+    const region = self.memory[self.used..][0..n];
+    self.used += std.mem.alignForward(usize, n, region_align);
+    std.debug.assert(self.used <= std.mem.alignForward(usize, self.memory.len, region_align));
+    return region;
+}
+
+fn initLinux(size: usize) !Slab {
+    const linux = std.os.linux;
+    const prot = std.posix.PROT.READ | std.posix.PROT.WRITE;
+    const len = std.mem.alignForward(usize, @max(size, 1), huge_page_size);
+
+    // Reserved huge pages, faulted in by the kernel
+    if (std.posix.mmap(null, len, prot, .{ .TYPE = .PRIVATE, .ANONYMOUS = true, .HUGETLB = true, .POPULATE = true }, -1, 0)) |mapping| {
+        return .{ .memory = mapping[0..size], .backing = .huge_pages, .mapping = mapping };
+    } else |_| {}
+
+    // Otherwise over-map so a 2MB-aligned range can be advised for THP
+    const raw = try std.posix.mmap(null, len + huge_page_size, prot, .{ .TYPE = .PRIVATE, .ANONYMOUS = true }, -1, 0);
+    const start = std.mem.alignForward(usize, @intFromPtr(raw.ptr), huge_page_size) - @intFromPtr(raw.ptr);
+    if (start > 0) std.posix.munmap(@alignCast(raw[0..start]));
+    const tail = raw.len - start - len;
+    if (tail > 0) std.posix.munmap(@alignCast(raw[start + len ..]));
+    const mapping: []align(page_align) u8 = @alignCast(raw[start..][0..len]);
+
+    var backing: Backing = .pages;
+    if (std.posix.madvise(mapping.ptr, mapping.len, linux.MADV.HUGEPAGE)) |_| {
+        backing = .transparent_huge_pages;
+    } else |_| {}
+    prefault(mapping);
+    return .{ .memory = mapping[0..size], .backing = backing, .mapping = mapping };
+}
+
+/// Touch every page so later frame passes don't take page faults.
+fn prefault(memory: []u8) void {
+    var i: usize = 0;
+    while (i < memory.len) : (i += page_align) {
+        @as(*volatile u8, &memory[i]).* = 0;
+    }
+}
+
+// --- Tests ---
+
+test "sizeFor rounds every region to a cache line" {
+    try std.testing.expectEqual(@as(usize, 0), sizeFor(&.{}));
+    try std.testing.expectEqual(@as(usize, 64 + 128 + 0), sizeFor(&.{ 1, 100, 0 }));
+}
+
+test "take carves aligned, disjoint regions" {
+    var slab = try Slab.init(sizeFor(&.{ 100, 4096, 3 }), null);
+    defer slab.deinit();
+    const a = slab.take(100);
+    const b = slab.take(4096);
+    const c = slab.take(3);
+    try std.testing.expectEqual(@as(usize, 0), @intFromPtr(b.ptr) % region_align);
+    try std.testing.expectEqual(@as(usize, 0), @intFromPtr(c.ptr) % region_align);
+    try std.testing.expect(@intFromPtr(a.ptr) + a.len <= @intFromPtr(b.ptr));
+    try std.testing.expect(@intFromPtr(b.ptr) + b.len <= @intFromPtr(c.ptr));
+    @memset(a, 1);
+    @memset(b, 2);
+    @memset(c, 3);
+    try std.testing.expectEqual(@as(u8, 1), a[99]);
+}
+
+test "slab from a caller-supplied allocator" {
+    var slab = try Slab.init(1000, std.testing.allocator);
+    defer slab.deinit();
+    try std.testing.expectEqual(Backing.allocator, slab.backing);
+    try std.testing.expectEqual(@as(usize, 1000), slab.take(1000).len);
+}
+
+test "OS-backed slab is huge-page sized on Linux" {
+    var slab = try Slab.init(3 * 1024 * 1024, null);
+    defer slab.deinit();
+    if (builtin.os.tag == .linux) {
+        try std.testing.expect(slab.backing != .allocator);
+        try std.testing.expectEqual(@as(usize, 4 * 1024 * 1024), slab.mapping.len);
+        try std.testing.expectEqual(@as(usize, 0), @intFromPtr(slab.mapping.ptr) % huge_page_size);
+    }
+}
@@ -8,22 +8,558 @@ const delta = @import("delta.zig");
 const version_info = @import("version.zig");
 const sync = @import("sync.zig");
 const pacer = @import("pacer.zig");
+const Pipeline = @import("Pipeline.zig");
+const isa = @import("isa.zig");
+const Slab = @import("Slab.zig");
+const FrameCache = @import("FrameCache.zig");
+const ingest = @import("ingest.zig");
+const FormatPolicy = @import("FormatPolicy.zig");
+const ShmRing = @import("ShmRing.zig");
+const AudioRing = @import("AudioRing.zig");
+const Resampler = @import("Resampler.zig");
+const pcm = @import("pcm.zig");
+const AudioMeter = @import("AudioMeter.zig");
+const clock = @import("clock.zig");
 
 // --- Internal handles ---
 
+/// Upper bound for the default delta worker count chosen at connect. The
+/// delta pass is memory-bound and stops scaling after a few cores.
+const default_max_workers = 4;
+
+/// Audio ring fill held by drift compensation when the host passes 0.
+const default_audio_target_ms = 30;
+
 const InputHandle = struct {
     input: Input,
 };
 
-const ConnHandle = struct {
+/// Host side of a `gmz-daemon` stream.
+const ShmClient = struct {
+    ring: ShmRing,
+    sock: std.posix.socket_t,
+    efd: std.posix.fd_t,
+    /// Bytes per pixel of the host format.
+    bpp: usize,
+    mode: ?ShmRing.Mode = null,
+    /// Triple-buffer slot the host renders into.
+    back: u32 = 0,
+    acquired: bool = false,
+
+    /// Create the ring and its eventfd and hand both to the daemon.
+    fn open(path: [*:0]const u8, cfg: *const gmz_shm_config_t) !*ShmClient {
+        const fmt = try std.meta.intToEnum(ingest.PixelFormat, cfg.format);
+        _ = try std.meta.intToEnum(protocol.RgbMode, cfg.rgb_mode);
+        const host = std.mem.span(cfg.host orelse return error.NoHost);
+        var config = ShmRing.Config{
+            .mtu = cfg.mtu,
+            .rgb_mode = cfg.rgb_mode,
+            .lz4_mode = cfg.lz4_mode,
+            .sound_rate = cfg.sound_rate,
+            .sound_channels = cfg.sound_channels,
+            .format = cfg.format,
+            .slot_bytes = std.math.cast(u32, @as(usize, cfg.max_width) * cfg.max_height * fmt.bytesPerPixel()) orelse return error.FrameTooLarge,
+            .audio_bytes = cfg.audio_bytes,
+        };
+        if (host.len >= config.host.len) return error.HostTooLong;
+        @memcpy(config.host[0..host.len], host);
+        if (cfg.audio_bytes % 4 != 0 or (cfg.audio_bytes != 0 and !std.math.isPowerOfTwo(cfg.audio_bytes))) return error.BadAudioSize;
+
+        var ring = try ShmRing.create(config);
+        errdefer ring.deinit();
+        const efd = try std.posix.eventfd(0, std.os.linux.EFD.CLOEXEC | std.os.linux.EFD.NONBLOCK);
+        errdefer std.posix.close(efd);
+        const sock = try std.posix.socket(std.posix.AF.UNIX, std.posix.SOCK.STREAM | std.posix.SOCK.CLOEXEC, 0);
+        errdefer std.posix.close(sock);
+        const addr = try std.net.Address.initUnix(std.mem.span(path));
+        try std.posix.connect(sock, &addr.any, addr.getOsSockLen());
+        try ShmRing.sendFds(sock, .{ ring.fd, efd });
+
+        const self = try std.heap.c_allocator.create(ShmClient);
+        self.* = .{ .ring = ring, .sock = sock, .efd = efd, .bpp = fmt.bytesPerPixel() };
+        return self;
+    }
+
+    /// Hang up (the daemon stops the stream) and free everything.
+    fn close(self: *ShmClient) void {
+        std.posix.close(self.sock);
+        std.posix.close(self.efd);
+        self.ring.deinit();
+        std.heap.c_allocator.destroy(self);
+    }
+
+    /// Bytes per row and per frame (one field when interlaced) for the modeline.
+    fn pitch(self: *const ShmClient, m: ShmRing.Mode) usize {
+        return @as(usize, m.h_active) * self.bpp;
+    }
+
+    fn frameLen(self: *const ShmClient, m: ShmRing.Mode) usize {
+        const rows: usize = if (m.interlaced != 0) (m.v_active + 1) / 2 else m.v_active;
+        return self.pitch(m) * rows;
+    }
+};
+
+pub const ConnHandle = struct {
     conn: Connection,
     modeline: ?protocol.Modeline = null,
     timing: ?sync.FrameTiming = null,
-    compress_buf: ?[]u8 = null,
     delta_state: ?*delta.DeltaState = null,
+    pool: ?*std.Thread.Pool = null,
+    pipeline: ?*Pipeline = null,
+    frame_cache: ?*FrameCache = null,
+    pacer_state: pacer.PacerState = .{},
+
+    // --- Frame buffers, all carved from `slab` ---
+    slab: ?Slab = null,
+    compress_buf: ?[]u8 = null,
     delta_buf: ?[]u8 = null,
     prev_frames: [2]?[]u8 = .{ null, null },
-    pacer_state: pacer.PacerState = .{},
+    alt_buf: ?[]u8 = null,
+    /// Converted-frame staging for compressors that can't read a source.
+    stage_buf: ?[]u8 = null,
+    /// Host-format copy of a `gmz_submit_iov` frame while fallen back.
+    gather_buf: ?[]u8 = null,
+    /// Largest frame the compression buffers hold (0 = not yet sized).
+    frame_capacity: usize = 0,
+    interlaced: bool = false,
+    /// Requested features whose buffers live in the slab.
+    dual_encode: bool = false,
+    pipeline_depth: u8 = 0,
+    staging: bool = false,
+    gathering: bool = false,
+    /// Ordered-dither frames converted to RGB565 by `gmz_submit_format`.
+    dither: bool = false,
+    /// Filter scaling `gmz_submit_strided` frames to the modeline, if any.
+    scaler: ?ingest.Filter = null,
+    /// RGB mode the host submits with `gmz_submit` (the mode at connect).
+    host_mode: protocol.RgbMode = .bgr888,
+    /// Bandwidth fallback to RGB565, when enabled.
+    format_policy: ?FormatPolicy = null,
+    /// Duration of the last submit, for the format policy.
+    last_send_ms: f64 = 0,
+    /// Library-owned frame slots for `gmz_acquire_frame`, carved from the
+    /// slab once `ring` is requested. Slots exchange places with the delta
+    /// references as frames are committed.
+    frame_ring: ?[ring_slots][]u8 = null,
+    ring: bool = false,
+    ring_head: u8 = 0,
+    /// A slot was handed out by `gmz_acquire_frame` and not yet committed.
+    acquired: bool = false,
+    /// Unread format transitions, oldest first, overwritten when full.
+    format_events: [8]gmz_format_event_t = undefined,
+    format_event_head: u8 = 0,
+    format_event_count: u8 = 0,
+    /// Embedder-supplied memory for the slab (null = OS pages).
+    alloc_hook: ?gmz_allocator_t = null,
+    /// PCM queued by `gmz_audio_write`, sent at frame boundaries (null when
+    /// the session has no audio).
+    audio_ring: ?AudioRing = null,
+    /// Drift compensation for `gmz_audio_write`, when enabled.
+    resampler: ?*Resampler = null,
+    /// Steers `audio_ratio` once per frame from `pumpAudio`.
+    audio_control: Resampler.Control = .{ .target = 1 },
+    /// Resampling ratio for the writer thread; stored by the frame thread
+    /// (atomic).
+    audio_ratio: f64 = 1.0,
+    /// TPDF dither for s32/f32 audio, when enabled.
+    audio_dither: ?pcm.Dither = null,
+    /// The audio meter as of the last frame boundary, for `gmz_audio_stats`
+    /// on any thread.
+    audio_stats: Input.Seqlock(gmz_audio_stats_t) = .{},
+
+    /// Send any pipelined frames so the compressor is idle and its state can
+    /// be changed from this thread.
+    fn drainPipeline(self: *ConnHandle) void {
+        if (self.pipeline) |p| p.flush(&self.conn) catch {};
+    }
+
+    /// Use `threads` threads (including the caller) for the banded delta
+    /// pass, (re)creating the shared worker pool with `threads - 1` workers.
+    /// Dual encoding needs a pool, so it keeps at least one worker.
+    fn setWorkers(self: *ConnHandle, threads: usize) !void {
+        const ds = self.delta_state orelse return error.NotDelta;
+        const n_jobs = @max(threads, 1) - 1 + @intFromBool(self.dual_encode and threads <= 1);
+        if (self.pool) |pool| if (pool.threads.len != n_jobs) {
+            pool.deinit();
+            std.heap.c_allocator.destroy(pool);
+            self.pool = null;
+        };
+        if (self.pool == null and n_jobs > 0) {
+            const pool = try std.heap.c_allocator.create(std.Thread.Pool);
+            errdefer std.heap.c_allocator.destroy(pool);
+            try pool.init(.{ .allocator = std.heap.c_allocator, .n_jobs = n_jobs });
+            self.pool = pool;
+        }
+        ds.pool = self.pool;
+        ds.bands = @max(threads, 1);
+    }
+
+    /// Size the compression buffers for frames of `frame_bytes` bytes; a
+    /// no-op when already sized that way.
+    fn sizeBuffers(self: *ConnHandle, frame_bytes: usize, interlaced: bool) !void {
+        if (self.slab != null and frame_bytes == self.frame_capacity and interlaced == self.interlaced) return;
+        try self.rebuildBuffers(frame_bytes, interlaced);
+    }
+
+    /// Carve every per-connection buffer (compress output, delta references
+    /// and scratch, dual-encode candidate, pipeline slots, frame ring) from
+    /// one new slab and release the old one. The field-1 reference only
+    /// exists when `interlaced`. References survive when the frame size is
+    /// unchanged; otherwise the next frame on each field is a keyframe.
+    /// Raw connections only have a slab for the frame ring.
+    fn rebuildBuffers(self: *ConnHandle, frame_bytes: usize, interlaced: bool) !void {
+        const compressed = self.conn.config.compressor != null;
+        if (!compressed and !self.ring) return;
+        self.drainPipeline();
+
+        const bound = if (compressed) lz4.compressBound(frame_bytes) else 0;
+        const ref_bytes = if (self.delta_state != null) frame_bytes else 0;
+        const field1_bytes = if (interlaced) ref_bytes else 0;
+        const alt_bytes = if (self.delta_state != null and self.dual_encode) bound else 0;
+        const depth = self.pipeline_depth;
+        const pipe_bytes = if (depth > 0) Pipeline.bufferBytes(depth, frame_bytes, bound) else 0;
+        const stage_bytes = if (self.staging) frame_bytes else 0;
+        const gather_bytes = if (self.gathering) if (self.modeline) |m| frameBytes(m, self.host_mode) else 0 else 0;
+        // Slots hold frames as the host renders them, in its own RGB mode
+        const slot_bytes = if (self.ring) if (self.modeline) |m| frameBytes(m, self.host_mode) else frame_bytes else 0;
+
+        const ring_bytes = ring_slots * Slab.sizeFor(&.{slot_bytes});
+        var slab = try Slab.init(Slab.sizeFor(&.{ bound, ref_bytes, field1_bytes, ref_bytes, alt_bytes, pipe_bytes, stage_bytes, gather_bytes }) + ring_bytes, self.slabAllocator());
+        errdefer slab.deinit();
+        const compress_buf = slab.take(bound);
+        const prev0 = slab.take(ref_bytes);
+        const prev1 = slab.take(field1_bytes);
+        const delta_buf = slab.take(ref_bytes);
+        const alt_buf = slab.take(alt_bytes);
+        const pipe_mem = slab.take(pipe_bytes);
+        const stage_buf = slab.take(stage_bytes);
+        const gather_buf = slab.take(gather_bytes);
+        var ring: [ring_slots][]u8 = undefined;
+        for (&ring) |*slot| slot.* = slab.take(slot_bytes);
+
+        const pipeline = if (depth > 0) blk: {
+            var new_comp = self.conn.config.compressor.?;
+            new_comp.buf = compress_buf;
+            break :blk try Pipeline.create(std.heap.c_allocator, new_comp, depth, frame_bytes, bound, pipe_mem);
+        } else null;
+
+        // Carry the delta references over when the frame size is unchanged
+        var keep: [2]bool = .{ false, false };
+        if (self.delta_state) |ds| if (frame_bytes == self.frame_capacity) {
+            if (self.prev_frames[0]) |old| if (ds.has_prev[0]) {
+                @memcpy(prev0, old);
+                keep[0] = true;
+            };
+            if (self.prev_frames[1]) |old| if (interlaced and ds.has_prev[1]) {
+                @memcpy(prev1, old);
+                keep[1] = true;
+            };
+        };
+        self.freeBuffers();
+
+        self.slab = slab;
+        if (self.conn.config.compressor) |*c| {
+            self.compress_buf = compress_buf;
+            c.buf = compress_buf;
+        }
+        self.pipeline = pipeline;
+        self.stage_buf = if (stage_bytes > 0) stage_buf else null;
+        self.gather_buf = if (gather_bytes > 0) gather_buf else null;
+        self.frame_ring = if (self.ring) ring else null;
+        if (self.delta_state) |ds| {
+            self.prev_frames = .{ prev0, if (interlaced) prev1 else null };
+            self.delta_buf = delta_buf;
+            self.alt_buf = if (alt_bytes > 0) alt_buf else null;
+            ds.prev_frames = .{ prev0, prev1 };
+            ds.delta_buf = delta_buf;
+            ds.alt_buf = self.alt_buf;
+            ds.has_prev = keep;
+        }
+        self.frame_capacity = frame_bytes;
+        self.interlaced = interlaced;
+    }
+
+    /// Release the slab, the pipeline and every buffer view into the slab.
+    /// The caller drains the pipeline first.
+    fn freeBuffers(self: *ConnHandle) void {
+        if (self.pipeline) |p| p.destroy();
+        self.pipeline = null;
+        if (self.delta_state) |ds| {
+            ds.prev_frames = .{ &.{}, &.{} };
+            ds.delta_buf = &.{};
+            ds.alt_buf = null;
+            ds.has_prev = .{ false, false };
+        }
+        if (self.conn.config.compressor) |*c| c.buf = &.{};
+        if (self.slab) |*slab| slab.deinit();
+        self.slab = null;
+        self.compress_buf = null;
+        self.delta_buf = null;
+        self.prev_frames = .{ null, null };
+        self.alt_buf = null;
+        self.stage_buf = null;
+        self.gather_buf = null;
+        self.frame_ring = null;
+        self.acquired = false;
+        self.frame_capacity = 0;
+    }
+
+    /// Send (or queue) a frame read through `source`. Sizes the buffers the
+    /// way `gmz_submit` does, plus a staging buffer the first time a plain
+    /// LZ4 connection without a pipeline needs one.
+    fn submitSource(self: *ConnHandle, source: *const ingest.Source, opts: Connection.FrameOpts) !void {
+        const len = source.frameBytes();
+        if (self.conn.config.compressor) |comp| {
+            if (len > self.frame_capacity) {
+                if (self.modeline != null) return error.FrameTooLarge;
+                try self.sizeBuffers(len, true);
+            }
+            if (comp.compressSourceFn == null and self.pipeline == null and !self.staging and source.contiguous() == null) {
+                self.staging = true;
+                try self.rebuildBuffers(self.frame_capacity, self.interlaced);
+            }
+        }
+        if (self.pipeline) |p| {
+            try p.submitSource(&self.conn, source, opts);
+        } else {
+            try self.conn.sendSource(source, self.stage_buf orelse &.{}, opts);
+        }
+    }
+
+    /// Send (or queue) a frame held in several buffers. Sizes the buffers the
+    /// way `gmz_submit` does; a plain LZ4 connection without a pipeline
+    /// gathers into the staging buffer. After a fallback the frame is
+    /// gathered once, then converted like a `gmz_submit` frame.
+    fn submitGather(self: *ConnHandle, parts: []const []const u8, opts: Connection.FrameOpts) !void {
+        const len = Connection.gatherLen(parts);
+        if (self.fallenBack()) {
+            if (self.gather_buf == null) {
+                self.gathering = true;
+                try self.rebuildBuffers(self.frame_capacity, self.interlaced);
+            }
+            const buf = self.gather_buf orelse return error.FrameTooLarge;
+            if (len > buf.len) return error.FrameTooLarge;
+            const frame = buf[0..len];
+            Connection.gatherInto(parts, frame);
+            return self.submitFallback(frame, opts);
+        }
+        if (self.conn.config.compressor != null) {
+            if (len > self.frame_capacity) {
+                if (self.modeline != null) return error.FrameTooLarge;
+                try self.sizeBuffers(len, true);
+            }
+            if (self.pipeline == null and !self.staging) {
+                self.staging = true;
+                try self.rebuildBuffers(self.frame_capacity, self.interlaced);
+            }
+        }
+        if (self.pipeline) |p| {
+            try p.submitGather(&self.conn, parts, opts);
+        } else {
+            try self.conn.sendGather(parts, self.stage_buf orelse &.{}, opts);
+        }
+    }
+
+    /// Send the frame rendered into ring slot `slot`, in place. Raw frames go
+    /// straight out of it; a delta compressor adopts it as the reference and
+    /// hands back its old one, which becomes the slot. Pipelined frames are
+    /// copied into the pipeline slot, and fallen-back frames are converted,
+    /// so the slot never outlives the call in either case.
+    fn commitSlot(self: *ConnHandle, slot: *[]u8, opts: Connection.FrameOpts) !void {
+        if (self.fallenBack()) return self.submitFallback(slot.*, opts);
+        if (self.pipeline) |p| return p.submit(&self.conn, slot.*, opts);
+        try self.conn.sendOwned(slot, opts);
+        if (self.delta_state) |ds| {
+            self.prev_frames[0] = ds.prev_frames[0];
+            if (self.interlaced) self.prev_frames[1] = ds.prev_frames[1];
+        }
+    }
+
+    /// Send a frame in the host's RGB mode after a fallback to RGB565 (only
+    /// possible with a modeline), converted and dithered.
+    fn submitFallback(self: *ConnHandle, frame: []const u8, opts: Connection.FrameOpts) !void {
+        var source = ingest.Source.init(frame, ingest.PixelFormat.fromRgbMode(self.host_mode), self.modeline.?.h_active, self.conn.config.rgb_mode) orelse return error.PartialRows;
+        source.dither = true;
+        try self.submitSource(&source, opts);
+    }
+
+    fn slabAllocator(self: *ConnHandle) ?std.mem.Allocator {
+        const hook = if (self.alloc_hook) |*h| h else return null;
+        return .{ .ptr = hook, .vtable = &hook_vtable };
+    }
+
+    /// Point a hook-backed slab at `hook`, a copy of the one it came from,
+    /// while `alloc_hook` changes under it.
+    fn retargetSlab(self: *ConnHandle, hook: *?gmz_allocator_t) void {
+        const slab = if (self.slab) |*s| s else return;
+        if (slab.backing != .allocator) return;
+        if (hook.*) |*h| slab.allocator.?.ptr = h;
+    }
+
+    /// Whether the session has fallen back from the host's RGB mode.
+    fn fallenBack(self: *const ConnHandle) bool {
+        return self.conn.config.rgb_mode != self.host_mode;
+    }
+
+    /// Dither conversions to RGB565: on request, and always after a fallback.
+    fn ditherOn(self: *const ConnHandle) bool {
+        return self.dither or self.fallenBack();
+    }
+
+    /// Send the queued audio that is due and sample the audio latency. Runs
+    /// on the frame thread, between frames, so audio never splits a frame's
+    /// datagrams.
+    fn pumpAudio(self: *ConnHandle) void {
+        const now = clock.nowNs();
+        var queued: usize = 0;
+        if (self.audio_ring) |*ring| {
+            ring.drain(now, &self.conn) catch {};
+            queued = ring.fill();
+        }
+        const meter = &self.conn.audio;
+        meter.sample(queued, now);
+        self.audio_stats.store(.{
+            .latency_ms = meter.latency_ms,
+            .fpga_ms = meter.bytesToMs(meter.downstreamBytes(now)),
+            .bytes_sent = meter.sent,
+            .underruns = meter.underruns,
+            .histogram = meter.histogram,
+        });
+        if (self.resampler != null) {
+            // Everything written and not yet played by the FPGA: the drain
+            // schedule cancels out, leaving host production against playback
+            const buffered = queued + self.conn.audio.downstreamBytes(now);
+            @atomicStore(f64, &self.audio_ratio, self.audio_control.update(buffered), .monotonic);
+        }
+    }
+
+    /// The ratio `pumpAudio` last settled on, for `rs` on the writer thread.
+    fn steer(self: *ConnHandle, rs: *Resampler) void {
+        rs.ratio = @atomicLoad(f64, &self.audio_ratio, .monotonic);
+    }
+
+    /// Resample s16 `frames` (the session's layout) into `ring`. Returns the
+    /// input bytes consumed; output that doesn't fit is dropped.
+    fn queueResampled(ring: *AudioRing, rs: *Resampler, frames: []const u8) usize {
+        var consumed: usize = 0;
+        while (true) {
+            var out: [4096]u8 = undefined;
+            const p = rs.process(frames[consumed..], &out);
+            consumed += p.consumed;
+            // Ring full: the rest is dropped
+            if (ring.write(out[0..p.produced]) < p.produced) break;
+            if (p.produced < out.len) break;
+        }
+        return consumed;
+    }
+
+    /// Convert `src` into the audio ring: in place when nothing else is in
+    /// the way, through a stack chunk when resampling. Returns the frames
+    /// queued.
+    fn queueAudio(self: *ConnHandle, src: *const pcm.Source) usize {
+        const ring = if (self.audio_ring) |*r| r else return 0;
+        const frame_bytes: usize = ring.frame_bytes;
+        const out_channels = frame_bytes / 2;
+        const dither = if (self.audio_dither) |*d| d else null;
+        var done: usize = 0;
+        if (self.resampler) |rs| {
+            self.steer(rs);
+            while (done < src.frames) {
+                var chunk: [1024 * 4]u8 = undefined;
+                const n = @min(chunk.len / frame_bytes, src.frames - done);
+                pcm.convert(src, done, n, out_channels, &chunk, dither);
+                const consumed = queueResampled(ring, rs, chunk[0 .. n * frame_bytes]);
+                done += consumed / frame_bytes;
+                if (consumed < n * frame_bytes) break;
+            }
+            return done;
+        }
+        for (ring.reserve()) |piece| {
+            const n = @min(piece.len / frame_bytes, src.frames - done);
+            pcm.convert(src, done, n, out_channels, piece, dither);
+            done += n;
+        }
+        ring.commit(done * frame_bytes);
+        if (done < src.frames) ring.countOverrun();
+        return done;
+    }
+
+    /// Start timing a submit when the format policy watches send times.
+    fn submitStart(self: *const ConnHandle) u64 {
+        return if (self.format_policy != null) clock.nowNs() else 0;
+    }
+
+    /// Note the duration of the submit that began at `start`.
+    fn submitEnd(self: *ConnHandle, start: u64) void {
+        if (start == 0) return;
+        self.last_send_ms = @as(f64, @floatFromInt(clock.nowNs() -| start)) / std.time.ns_per_ms;
+    }
+
+    /// Switch the session's wire format: drain, re-INIT, resend the
+    /// modeline, and resize the buffers. Both fields restart on keyframes.
+    /// On failure the previous mode is put back, on the wire and in the
+    /// delta state, so the session stays consistent.
+    fn switchRgbMode(self: *ConnHandle, mode: protocol.RgbMode) !void {
+        const m = self.modeline orelse return error.NoModeline;
+        const prev = self.conn.config.rgb_mode;
+        self.drainPipeline();
+        self.applyRgbMode(m, mode) catch |err| {
+            // The old buffers are still in place: their size check passes
+            self.applyRgbMode(m, prev) catch {};
+            return err;
+        };
+    }
+
+    fn applyRgbMode(self: *ConnHandle, m: protocol.Modeline, mode: protocol.RgbMode) !void {
+        self.conn.config.rgb_mode = mode;
+        try self.conn.sendInit();
+        try self.conn.switchRes(m);
+        if (self.delta_state) |ds| {
+            ds.rgb565 = mode == .rgb565;
+            ds.kernel = isa.forModeline(m, mode);
+            delta.requestKeyframe(ds, 0);
+            delta.requestKeyframe(ds, 1);
+        }
+        try self.sizeBuffers(frameBytes(m, mode), m.interlaced);
+        self.pacer_state.updateTiming(self.timing.?);
+    }
+
+    /// Feed the frame `beginFrame` just paced to the format policy and
+    /// apply any transition it decides on.
+    fn adaptFormat(self: *ConnHandle, result: pacer.PaceResult) void {
+        const policy = if (self.format_policy) |*p| p else return;
+        if (result == .stalled or self.modeline == null) return;
+        const level = policy.observe(.{
+            .rtt_ms = self.pacer_state.last_sync_ms,
+            .send_ms = self.last_send_ms,
+            .period_ms = @as(f64, @floatFromInt(self.pacer_state.frame_time_ns)) / std.time.ns_per_ms,
+            .skipped = result == .skip,
+        }) orelse return;
+        const frame = self.pacer_state.client_frame;
+        self.switchRgbMode(if (level == .reduced) .rgb565 else self.host_mode) catch {
+            // Still in the old mode: the policy must agree, and the host hear of it
+            policy.level = if (level == .reduced) .full else .reduced;
+            self.pushFormatEvent(frame, true);
+            return;
+        };
+        self.pushFormatEvent(frame, false);
+    }
+
+    fn pushFormatEvent(self: *ConnHandle, frame: u32, failed: bool) void {
+        const cap = self.format_events.len;
+        const slot = (self.format_event_head + self.format_event_count) % cap;
+        self.format_events[slot] = .{
+            .frame = frame,
+            .rgb_mode = @intFromEnum(self.conn.config.rgb_mode),
+            .fallback = @intFromBool(self.fallenBack()),
+            .failed = @intFromBool(failed),
+        };
+        if (self.format_event_count < cap) {
+            self.format_event_count += 1;
+        } else {
+            self.format_event_head = @intCast((self.format_event_head + 1) % cap);
+        }
+    }
 
     fn periodMs(self: *const ConnHandle) f64 {
         const m = self.modeline orelse return 16.7;
@@ -32,6 +568,37 @@ const ConnHandle = struct {
     }
 };
 
+/// Adapts a `gmz_allocator_t` to `std.mem.Allocator` for the slab.
+const hook_vtable = std.mem.Allocator.VTable{
+    .alloc = hookAlloc,
+    .resize = std.mem.Allocator.noResize,
+    .remap = std.mem.Allocator.noRemap,
+    .free = hookFree,
+};
+
+fn hookAlloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, _: usize) ?[*]u8 {
+    const hook: *const gmz_allocator_t = @ptrCast(@alignCast(ctx));
+    return @ptrCast(hook.alloc.?(hook.ctx, len, alignment.toByteUnits()));
+}
+
+fn hookFree(ctx: *anyopaque, memory: []u8, _: std.mem.Alignment, _: usize) void {
+    const hook: *const gmz_allocator_t = @ptrCast(@alignCast(ctx));
+    hook.free.?(hook.ctx, memory.ptr, memory.len);
+}
+
+/// Slots in the `gmz_acquire_frame` ring. Frames are sent (or copied into
+/// the pipeline) before `gmz_commit_frame` returns, so two let the host
+/// start on the next frame while the last committed one is still the
+/// delta reference.
+const ring_slots = 2;
+
+/// Bytes per submitted frame for a modeline: one field when interlaced,
+/// sized for the larger (top) field of an odd `v_active`.
+fn frameBytes(m: protocol.Modeline, mode: protocol.RgbMode) usize {
+    const rows: usize = if (m.interlaced) (m.v_active + 1) / 2 else m.v_active;
+    return @as(usize, m.h_active) * rows * mode.bytesPerPixel();
+}
+
 // --- C-visible structs ---
 
 /// Combined modeline parameters for `gmz_set_modeline`.
@@ -100,6 +667,105 @@ pub const gmz_ps2_state_t = extern struct {
     keys: [32]u8 = .{0} ** 32,
 };
 
+/// Input transition returned by `gmz_input_events`.
+pub const gmz_input_event_t = extern struct {
+    /// Host monotonic time the packet was received.
+    time_ns: u64 = 0,
+    frame: u32 = 0,
+    /// GMZ_INPUT_JOY_DOWN .. GMZ_INPUT_MOUSE_UP.
+    kind: u8 = 0,
+    /// Joystick events: 0 or 1.
+    player: u8 = 0,
+    /// Joystick button bit, SDL scancode, or mouse button (0 left, 1 right, 2 middle).
+    code: u16 = 0,
+};
+
+/// Delta compressor counters returned by `gmz_compress_stats`.
+pub const gmz_compress_stats_t = extern struct {
+    keyframes: u64 = 0,
+    delta_frames: u64 = 0,
+    scene_cuts: u64 = 0,
+    dual_keyframe_wins: u64 = 0,
+    forced_keyframes: u64 = 0,
+    lost_frames: u64 = 0,
+    near_lossless_frames: u64 = 0,
+    exact_refreshes: u64 = 0,
+    cache_hits: u64 = 0,
+    cache_misses: u64 = 0,
+    cache_bytes_saved: u64 = 0,
+};
+
+/// Embedder memory hook for `gmz_set_allocator`. `alloc` returns memory of
+/// at least `size` bytes aligned to `alignment`, or null; `free` receives
+/// the pointer and size that `alloc` was called with.
+pub const gmz_allocator_t = extern struct {
+    ctx: ?*anyopaque = null,
+    alloc: ?*const fn (ctx: ?*anyopaque, size: usize, alignment: usize) callconv(.c) ?*anyopaque = null,
+    free: ?*const fn (ctx: ?*anyopaque, ptr: ?*anyopaque, size: usize) callconv(.c) void = null,
+};
+
+/// RGB mode transition reported by `gmz_poll_format_event`.
+pub const gmz_format_event_t = extern struct {
+    /// Pacer frame count when the transition happened.
+    frame: u32 = 0,
+    /// RGB mode now on the wire.
+    rgb_mode: u8 = 0,
+    /// 1 when this is a fallback from the host's mode, 0 when restored.
+    fallback: u8 = 0,
+    /// 1 when the switch failed and the session stayed in `rgb_mode`.
+    failed: u8 = 0,
+    _pad: u8 = 0,
+};
+
+/// Pipeline stage timings returned by `gmz_pipeline_stats`.
+pub const gmz_pipeline_stats_t = extern struct {
+    frames: u64 = 0,
+    avg_compress_us: f64 = 0,
+    avg_send_us: f64 = 0,
+    avg_stall_us: f64 = 0,
+    depth: u8 = 0,
+    _pad: [7]u8 = .{0} ** 7,
+};
+
+/// Audio buffer levels and latency from `gmz_audio_stats`. Durations are
+/// estimates: downstream audio is bytes sent minus what the FPGA has played
+/// at the session rate while reporting `audio_active`.
+pub const gmz_audio_stats_t = extern struct {
+    /// Queued + downstream, as of the last frame boundary.
+    latency_ms: f64 = 0,
+    /// Queued in the library's ring, not yet sent.
+    ring_ms: f64 = 0,
+    /// Sent and not yet played: in flight and in the HPS buffer, as of the
+    /// last frame boundary.
+    fpga_ms: f64 = 0,
+    bytes_sent: u64 = 0,
+    /// Times the FPGA ran out of audio while playing.
+    underruns: u64 = 0,
+    /// `gmz_audio_write*` calls cut short by a full ring.
+    overruns: u64 = 0,
+    /// Latency samples (one per `gmz_begin_frame` / `gmz_tick`) in 10 ms
+    /// buckets; the last holds 150 ms and up.
+    histogram: [AudioMeter.buckets]u32 = .{0} ** AudioMeter.buckets,
+};
+
+/// Stream settings for `gmz_shm_open`: the connection `gmz-daemon` opens
+/// (as `gmz_connect_ex`), the host pixel format (`GMZ_PIXEL_*`), the largest
+/// frame to reserve slots for, and the audio ring size (a power of two, 0 =
+/// no audio).
+pub const gmz_shm_config_t = extern struct {
+    host: ?[*:0]const u8 = null,
+    mtu: u16 = 1500,
+    rgb_mode: u8 = 0,
+    sound_rate: u8 = 0,
+    sound_channels: u8 = 0,
+    lz4_mode: u8 = 0,
+    format: u8 = 0,
+    _pad: u8 = 0,
+    max_width: u16 = 0,
+    max_height: u16 = 0,
+    audio_bytes: u32 = 0,
+};
+
 // --- Exported functions ---
 
 /// Open a UDP connection to the FPGA and send CMD_INIT.
@@ -124,12 +790,15 @@ pub export fn gmz_connect(host: [*:0]const u8, mtu: u16, rgb_mode: u8, sound_rat
             std.heap.c_allocator.destroy(handle);
             return null;
         },
+        .host_mode = mode,
     };
     handle.conn.sendInit() catch {
         handle.conn.close();
         std.heap.c_allocator.destroy(handle);
         return null;
     };
+    // Optional: without a ring only gmz_submit_audio sends audio
+    handle.audio_ring = AudioRing.init(std.heap.c_allocator, rate, channels) catch null;
     return handle;
 }
 
@@ -145,66 +814,32 @@ pub export fn gmz_connect_ex(host: [*:0]const u8, mtu: u16, rgb_mode: u8, sound_
 
     const lz4_enum: protocol.Lz4Mode = std.meta.intToEnum(protocol.Lz4Mode, lz4_mode) catch return null;
 
-    // Max frame size: generous 2MB covering up to ~800x600 BGR888
-    const max_frame_size = 2 * 1024 * 1024;
-
+    // Frame buffers are sized from the modeline by gmz_set_modeline
     var compressor_val: ?Connection.Compressor = null;
-    var compress_buf: ?[]u8 = null;
     var delta_state_ptr: ?*delta.DeltaState = null;
-    var delta_buf_alloc: ?[]u8 = null;
-    var prev_frame_allocs: [2]?[]u8 = .{ null, null };
 
     if (lz4_mode > 0) {
-        const buf = std.heap.c_allocator.alloc(u8, lz4.compressBound(max_frame_size)) catch {
-            std.heap.c_allocator.destroy(handle);
-            return null;
-        };
-        compress_buf = buf;
-
         // Delta modes: lz4_delta(2), lz4_hc_delta(4), adaptive_delta(6)
         const is_delta = (lz4_mode == 2 or lz4_mode == 4 or lz4_mode == 6);
         if (is_delta) {
-            const pf0 = std.heap.c_allocator.alloc(u8, max_frame_size) catch {
-                std.heap.c_allocator.free(buf);
-                std.heap.c_allocator.destroy(handle);
-                return null;
-            };
-            prev_frame_allocs[0] = pf0;
-
-            const pf1 = std.heap.c_allocator.alloc(u8, max_frame_size) catch {
-                std.heap.c_allocator.free(pf0);
-                std.heap.c_allocator.free(buf);
-                std.heap.c_allocator.destroy(handle);
-                return null;
-            };
-            prev_frame_allocs[1] = pf1;
-
-            const db = std.heap.c_allocator.alloc(u8, max_frame_size) catch {
-                std.heap.c_allocator.free(pf1);
-                std.heap.c_allocator.free(pf0);
-                std.heap.c_allocator.free(buf);
-                std.heap.c_allocator.destroy(handle);
-                return null;
-            };
-            delta_buf_alloc = db;
-
             const ds = std.heap.c_allocator.create(delta.DeltaState) catch {
-                std.heap.c_allocator.free(db);
-                std.heap.c_allocator.free(pf1);
-                std.heap.c_allocator.free(pf0);
-                std.heap.c_allocator.free(buf);
                 std.heap.c_allocator.destroy(handle);
                 return null;
             };
             ds.* = .{
-                .prev_frames = .{ pf0, pf1 },
-                .delta_buf = db,
-                .keyframe_interval = 120,
+                .prev_frames = .{ &.{}, &.{} },
+                .delta_buf = &.{},
+                // Loss detection resyncs a corrupted field within a few frames,
+                // so the periodic keyframe only backstops undetected loss.
+                .keyframe_interval = 300,
+                .keyframe_max_interval = 900,
+                .scene_cut_ratio = 0.5,
+                .rgb565 = mode == .rgb565,
             };
             delta_state_ptr = ds;
-            compressor_val = delta.compressor(ds, buf);
+            compressor_val = delta.compressor(ds, &.{});
         } else {
-            compressor_val = lz4.compressor(buf);
+            compressor_val = lz4.compressor(&.{});
         }
     }
 
@@ -220,36 +855,44 @@ pub export fn gmz_connect_ex(host: [*:0]const u8, mtu: u16, rgb_mode: u8, sound_
             .lz4_mode = lz4_enum,
         }) catch {
             if (delta_state_ptr) |ds| std.heap.c_allocator.destroy(ds);
-            if (delta_buf_alloc) |db| std.heap.c_allocator.free(db);
-            for (prev_frame_allocs) |pf| if (pf) |p| std.heap.c_allocator.free(p);
-            if (compress_buf) |buf| std.heap.c_allocator.free(buf);
             std.heap.c_allocator.destroy(handle);
             return null;
         },
-        .compress_buf = compress_buf,
         .delta_state = delta_state_ptr,
-        .delta_buf = delta_buf_alloc,
-        .prev_frames = prev_frame_allocs,
+        .host_mode = mode,
     };
     handle.conn.sendInit() catch {
         if (handle.delta_state) |ds| std.heap.c_allocator.destroy(ds);
-        if (handle.delta_buf) |db| std.heap.c_allocator.free(db);
-        for (handle.prev_frames) |pf| if (pf) |p| std.heap.c_allocator.free(p);
-        if (handle.compress_buf) |buf| std.heap.c_allocator.free(buf);
         handle.conn.close();
         std.heap.c_allocator.destroy(handle);
         return null;
     };
+    // Optional: without a ring only gmz_submit_audio sends audio
+    handle.audio_ring = AudioRing.init(std.heap.c_allocator, rate, channels) catch null;
+    if (handle.delta_state != null) {
+        // Optional: without a pool the delta pass simply runs serially
+        const cpus = std.Thread.getCpuCount() catch 1;
+        handle.setWorkers(@min(cpus, default_max_workers)) catch {};
+    }
     return handle;
 }
 
 /// Send CMD_CLOSE, close the socket, and free the handle. Null-safe.
 pub export fn gmz_disconnect(conn: ?*ConnHandle) callconv(.c) void {
     const handle = conn orelse return;
+    handle.drainPipeline();
+    handle.freeBuffers();
+    if (handle.pool) |pool| {
+        pool.deinit();
+        std.heap.c_allocator.destroy(pool);
+    }
+    if (handle.frame_cache) |cache| {
+        cache.deinit();
+        std.heap.c_allocator.destroy(cache);
+    }
     if (handle.delta_state) |ds| std.heap.c_allocator.destroy(ds);
-    if (handle.delta_buf) |db| std.heap.c_allocator.free(db);
-    for (handle.prev_frames) |pf| if (pf) |p| std.heap.c_allocator.free(p);
-    if (handle.compress_buf) |buf| std.heap.c_allocator.free(buf);
+    if (handle.audio_ring) |*ring| ring.deinit(std.heap.c_allocator);
+    if (handle.resampler) |rs| std.heap.c_allocator.destroy(rs);
     handle.conn.close();
     std.heap.c_allocator.destroy(handle);
 }
@@ -259,6 +902,7 @@ pub export fn gmz_disconnect(conn: ?*ConnHandle) callconv(.c) void {
 pub export fn gmz_tick(conn: ?*ConnHandle) callconv(.c) gmz_state_t {
     const handle = conn orelse return .{};
     handle.conn.poll();
+    handle.pumpAudio();
     const s = handle.conn.fpgaStatus();
     handle.conn.health.recordReady(s.vram_ready);
     const h = handle.conn.getHealth();
@@ -286,6 +930,8 @@ pub export fn gmz_tick(conn: ?*ConnHandle) callconv(.c) gmz_state_t {
 /// Send CMD_SWITCHRES to change display timing. Returns 0 on success, -1 on error.
 pub export fn gmz_set_modeline(conn: ?*ConnHandle, m: *const gmz_modeline_t) callconv(.c) c_int {
     const handle = conn orelse return -1;
+    // Frames queued for the old mode must go out before CMD_SWITCHRES
+    handle.drainPipeline();
     const modeline = protocol.Modeline{
         .pixel_clock = m.pixel_clock,
         .h_active = m.h_active,
@@ -299,14 +945,229 @@ pub export fn gmz_set_modeline(conn: ?*ConnHandle, m: *const gmz_modeline_t) cal
         .interlaced = m.interlaced != 0,
     };
     handle.modeline = modeline;
+    handle.sizeBuffers(frameBytes(modeline, handle.conn.config.rgb_mode), modeline.interlaced) catch return -1;
+    if (handle.delta_state) |ds| ds.kernel = isa.forModeline(modeline, handle.conn.config.rgb_mode);
     handle.timing = sync.frameTiming(modeline);
     handle.pacer_state.updateTiming(handle.timing.?);
     handle.conn.switchRes(modeline) catch return -1;
     return 0;
 }
 
+/// Configure delta keyframe scheduling. `interval` is the preferred number of
+/// frames between keyframes (0 = no periodic keyframes), `max_interval` bounds
+/// how long a due keyframe may be deferred through static content, and
+/// `scene_cut_ratio` (0.0-1.0, 0 = off) is the sampled fraction of changed
+/// bytes that forces an immediate keyframe.
+/// Returns 0 on success, -1 on null handle or a non-delta connection.
+pub export fn gmz_set_keyframe_policy(conn: ?*ConnHandle, interval: u32, max_interval: u32, scene_cut_ratio: f32) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const ds = handle.delta_state orelse return -1;
+    if (!(scene_cut_ratio >= 0 and scene_cut_ratio <= 1)) return -1;
+    handle.drainPipeline();
+    ds.keyframe_interval = interval;
+    ds.keyframe_max_interval = max_interval;
+    ds.scene_cut_ratio = scene_cut_ratio;
+    return 0;
+}
+
+/// Enable near-lossless delta coding for noisy sources (cameras, capture
+/// cards): pixel channels that moved by less than `threshold` (in 8-bit
+/// units) since the FPGA's last reconstruction are sent unchanged, so the
+/// shown image differs from the source by less than `threshold`. 0 restores
+/// exact coding. Every `exact_interval` delta frames per field are coded
+/// exactly (0 = only keyframes are exact).
+/// Returns 0 on success, -1 on null handle or a non-delta connection.
+pub export fn gmz_set_near_lossless(conn: ?*ConnHandle, threshold: u8, exact_interval: u32) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const ds = handle.delta_state orelse return -1;
+    handle.drainPipeline();
+    ds.lossy_threshold = threshold;
+    ds.exact_refresh_interval = exact_interval;
+    ds.lossy_count = .{ 0, 0 };
+    return 0;
+}
+
+/// Cache compressed keyframes of recurring screens (menus, pause screens,
+/// attract loops) in up to `budget_bytes` of memory, least recently used
+/// evicted first. A frame due as a keyframe that matches a cached screen is
+/// sent as that keyframe without compressing. 0 disables and frees the cache.
+/// Returns 0 on success, -1 on null handle, non-delta connection, or
+/// allocation failure.
+pub export fn gmz_set_frame_cache(conn: ?*ConnHandle, budget_bytes: usize) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const ds = handle.delta_state orelse return -1;
+    handle.drainPipeline();
+    if (budget_bytes == 0) {
+        ds.cache = null;
+        if (handle.frame_cache) |cache| {
+            cache.deinit();
+            std.heap.c_allocator.destroy(cache);
+        }
+        handle.frame_cache = null;
+        return 0;
+    }
+    if (handle.frame_cache) |cache| {
+        // Shrinking: refill from scratch rather than evict to the new budget
+        if (budget_bytes < cache.used) cache.clear();
+        cache.budget = budget_bytes;
+        return 0;
+    }
+    const cache = std.heap.c_allocator.create(FrameCache) catch return -1;
+    cache.* = FrameCache.init(std.heap.c_allocator, budget_bytes);
+    handle.frame_cache = cache;
+    ds.cache = cache;
+    return 0;
+}
+
+/// Enable or disable dual-candidate encoding (delta modes only). When enabled,
+/// each delta frame is also compressed as a keyframe on a second worker thread
+/// and the smaller encoding is sent. `budget_us` pauses dual encoding while the
+/// last dual encode exceeded it (0 = no limit).
+/// Returns 0 on success, -1 on null handle, non-delta connection, or allocation failure.
+pub export fn gmz_set_dual_encode(conn: ?*ConnHandle, enable: u8, budget_us: u32) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const ds = handle.delta_state orelse return -1;
+    handle.drainPipeline();
+    if (enable == 0) {
+        handle.dual_encode = false;
+        ds.alt_buf = null;
+        return 0;
+    }
+    handle.dual_encode = true;
+    // The candidate buffer lives in the slab; re-carve it once sized
+    if (handle.alt_buf == null and handle.frame_capacity > 0) {
+        handle.rebuildBuffers(handle.frame_capacity, handle.interlaced) catch {
+            handle.dual_encode = false;
+            return -1;
+        };
+    }
+    ds.alt_buf = handle.alt_buf;
+    if (handle.pool == null) handle.setWorkers(ds.bands) catch {
+        handle.dual_encode = false;
+        ds.alt_buf = null;
+        return -1;
+    };
+    ds.dual_budget_ns = @as(u64, budget_us) * std.time.ns_per_us;
+    ds.dual_over_budget = false;
+    return 0;
+}
+
+/// Supply the memory for this connection's frame buffer slab, or pass null
+/// to go back to OS pages (huge pages where available). Buffers are
+/// re-carved immediately; delta references carry over into the new slab.
+/// The hook must stay valid until `gmz_disconnect`. On allocation failure
+/// the previous buffers and hook stay in use.
+/// Returns 0 on success, -1 on null handle, incomplete hook, or allocation failure.
+pub export fn gmz_set_allocator(conn: ?*ConnHandle, hook: ?*const gmz_allocator_t) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    if (hook) |h| if (h.alloc == null or h.free == null) return -1;
+    handle.drainPipeline();
+    var old_hook = handle.alloc_hook;
+    handle.alloc_hook = if (hook) |h| h.* else null;
+    if (handle.slab == null) return 0;
+
+    // The old slab goes back through the hook that allocated it, now only
+    // in `old_hook`; `rebuildBuffers` releases it once the new one is in
+    handle.retargetSlab(&old_hook);
+    handle.rebuildBuffers(handle.frame_capacity, handle.interlaced) catch {
+        handle.alloc_hook = old_hook;
+        handle.retargetSlab(&handle.alloc_hook);
+        return -1;
+    };
+    return 0;
+}
+
+/// Set the number of threads (including the caller) that split the delta
+/// pass into scanline bands. 0 picks a default from the CPU count, 1 runs
+/// serially. Worker threads are shared with dual encoding.
+/// Returns 0 on success, -1 on null handle, non-delta connection, or thread
+/// creation failure.
+pub export fn gmz_set_workers(conn: ?*ConnHandle, threads: u8) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    if (handle.delta_state == null) return -1;
+    handle.drainPipeline();
+    const n: usize = if (threads == 0) @min(std.Thread.getCpuCount() catch 1, default_max_workers) else threads;
+    handle.setWorkers(n) catch return -1;
+    return 0;
+}
+
+/// Make the next frame for `field` (0 or 1) a keyframe; a negative `field`
+/// requests it for both fields. Use when the host knows the FPGA's reference
+/// is stale. Returns 0 on success, -1 on null handle or a non-delta connection.
+pub export fn gmz_force_keyframe(conn: ?*ConnHandle, field: c_int) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const ds = handle.delta_state orelse return -1;
+    if (field < 0) {
+        delta.requestKeyframe(ds, 0);
+        delta.requestKeyframe(ds, 1);
+    } else {
+        delta.requestKeyframe(ds, @intCast(@min(field, 1)));
+    }
+    return 0;
+}
+
+/// Read delta compressor counters. Null-safe (returns zeroed stats, also for
+/// connections without delta compression). Safe while a pipeline worker is
+/// compressing: the counters are atomic.
+pub export fn gmz_compress_stats(conn: ?*ConnHandle) callconv(.c) gmz_compress_stats_t {
+    const handle = conn orelse return .{};
+    const ds = handle.delta_state orelse return .{};
+    const stats = ds.stats.snapshot();
+    return .{
+        .keyframes = stats.keyframes,
+        .delta_frames = stats.delta_frames,
+        .scene_cuts = stats.scene_cuts,
+        .dual_keyframe_wins = stats.dual_keyframe_wins,
+        .forced_keyframes = stats.forced_keyframes,
+        .lost_frames = handle.conn.loss.lost_frames,
+        .near_lossless_frames = stats.near_lossless_frames,
+        .exact_refreshes = stats.exact_refreshes,
+        .cache_hits = stats.cache_hits,
+        .cache_misses = stats.cache_misses,
+        .cache_bytes_saved = stats.cache_bytes_saved,
+    };
+}
+
+/// Enable pipelined compression with `depth` frames in flight (2-4), or
+/// disable it with 0. While enabled, `gmz_submit` copies the frame and
+/// compresses it on a worker thread while the previous frame is sent, adding
+/// up to `depth - 1` frames of latency. Requires a compressed connection.
+/// Returns 0 on success, -1 on null handle, bad depth, no compressor, or
+/// allocation failure.
+pub export fn gmz_set_pipeline(conn: ?*ConnHandle, depth: u8) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    if (depth == 1 or depth > Pipeline.max_depth) return -1;
+    if (handle.conn.config.compressor == null) return -1;
+    if (handle.pipeline_depth == depth) return 0;
+    const old_depth = handle.pipeline_depth;
+    handle.pipeline_depth = depth;
+    // Slot buffers live in the slab; re-carve it once sized
+    if (handle.frame_capacity > 0) handle.rebuildBuffers(handle.frame_capacity, handle.interlaced) catch {
+        handle.pipeline_depth = old_depth;
+        return -1;
+    };
+    return 0;
+}
+
+/// Read pipeline stage timings. Null-safe (returns zeroed stats, also when
+/// pipelining is disabled).
+pub export fn gmz_pipeline_stats(conn: ?*ConnHandle) callconv(.c) gmz_pipeline_stats_t {
+    const handle = conn orelse return .{};
+    const p = handle.pipeline orelse return .{ .depth = handle.pipeline_depth };
+    const s = p.getStats();
+    return .{
+        .frames = s.frames,
+        .avg_compress_us = s.avg_compress_ns / std.time.ns_per_us,
+        .avg_send_us = s.avg_send_ns / std.time.ns_per_us,
+        .avg_stall_us = s.avg_stall_ns / std.time.ns_per_us,
+        .depth = handle.pipeline_depth,
+    };
+}
+
 /// Send a BGR frame to the FPGA and record sync timing for health.
-/// Returns 0 on success, -1 on error.
+/// With pipelining enabled the frame is queued and the oldest compressed
+/// frame is sent instead. Compressed connections reject frames larger than
+/// the modeline's frame size. Returns 0 on success, -1 on error.
 pub export fn gmz_submit(
     conn: ?*ConnHandle,
     data: [*]const u8,
@@ -317,16 +1178,272 @@ pub export fn gmz_submit(
     sync_wait_ms: f64,
 ) callconv(.c) c_int {
     const handle = conn orelse return -1;
-    handle.conn.sendFrame(data[0..len], .{
-        .frame_num = frame,
-        .field = field,
-        .vsync_line = vsync_line,
-    }) catch return -1;
-    // Only record sync timing from submit when caller provides it (non-pacer clients).
-    // When using gmz_begin_frame(), the pacer records sync wait internally.
-    if (sync_wait_ms > 0) {
-        handle.conn.health.record(sync_wait_ms, handle.conn.fpgaStatus().vram_ready);
+    const start = handle.submitStart();
+    const opts = Connection.FrameOpts{
+        .frame_num = frame,
+        .field = field,
+        .vsync_line = vsync_line,
+    };
+    if (handle.fallenBack()) {
+        handle.submitFallback(data[0..len], opts) catch return -1;
+    } else {
+        if (handle.conn.config.compressor != null and len > handle.frame_capacity) {
+            if (handle.modeline != null) return -1;
+            // No modeline yet: size the buffers from the first frame instead
+            handle.sizeBuffers(len, true) catch return -1;
+        }
+        if (handle.pipeline) |p| {
+            p.submit(&handle.conn, data[0..len], opts) catch return -1;
+        } else {
+            handle.conn.sendFrame(data[0..len], opts) catch return -1;
+        }
+    }
+    handle.submitEnd(start);
+    // Only record sync timing from submit when caller provides it (non-pacer clients).
+    // When using gmz_begin_frame(), the pacer records sync wait internally.
+    if (sync_wait_ms > 0) {
+        handle.conn.health.record(sync_wait_ms, handle.conn.fpgaStatus().vram_ready);
+    }
+    return 0;
+}
+
+/// Send a frame in host pixel format `format` (`ingest.PixelFormat`),
+/// converted to the connection's RGB mode as it is read. Rows are the
+/// modeline's `h_active` wide (one row without a modeline). Delta modes fuse
+/// the conversion into the delta pass; raw mode converts per datagram.
+/// Returns 0 on success, -1 on null handle, bad format, partial rows, or
+/// send failure.
+pub export fn gmz_submit_format(
+    conn: ?*ConnHandle,
+    data: [*]const u8,
+    len: usize,
+    format: u8,
+    frame: u32,
+    field: u8,
+    vsync_line: u16,
+    sync_wait_ms: f64,
+) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const fmt = std.meta.intToEnum(ingest.PixelFormat, format) catch return -1;
+    const width: usize = if (handle.modeline) |m| m.h_active else 0;
+    var source = ingest.Source.init(data[0..len], fmt, width, handle.conn.config.rgb_mode) orelse return -1;
+    source.dither = handle.ditherOn();
+    const start = handle.submitStart();
+    handle.submitSource(&source, .{
+        .frame_num = frame,
+        .field = field,
+        .vsync_line = vsync_line,
+    }) catch return -1;
+    handle.submitEnd(start);
+    if (sync_wait_ms > 0) {
+        handle.conn.health.record(sync_wait_ms, handle.conn.fpgaStatus().vram_ready);
+    }
+    return 0;
+}
+
+/// Send the `w` x `h` rectangle at column `x`, row `y` of a framebuffer at
+/// `base` whose rows are `pitch` bytes apart, in host pixel format `format`,
+/// without repacking it first. Raw frames already in the connection's RGB
+/// mode are gathered from the rows into datagrams; everything else is read
+/// row by row through the fused conversion path of `gmz_submit_format`.
+/// Returns 0 on success, -1 on null handle, bad format, a rectangle that
+/// overruns `pitch`, or send failure.
+pub export fn gmz_submit_strided(
+    conn: ?*ConnHandle,
+    base: [*]const u8,
+    pitch: usize,
+    x: u32,
+    y: u32,
+    w: u32,
+    h: u32,
+    format: u8,
+    frame: u32,
+    field: u8,
+    vsync_line: u16,
+    sync_wait_ms: f64,
+) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const fmt = std.meta.intToEnum(ingest.PixelFormat, format) catch return -1;
+    var source = ingest.Source.initStrided(base, pitch, x, y, w, h, fmt, handle.conn.config.rgb_mode) orelse return -1;
+    source.dither = handle.ditherOn();
+    if (handle.scaler) |filter| if (handle.modeline) |m| {
+        const rows: usize = if (m.interlaced) (m.v_active + 1) / 2 else m.v_active;
+        if (w != m.h_active or h != rows) source.scale = .{ .width = m.h_active, .height = rows, .filter = filter };
+    };
+    const start = handle.submitStart();
+    handle.submitSource(&source, .{
+        .frame_num = frame,
+        .field = field,
+        .vsync_line = vsync_line,
+    }) catch return -1;
+    handle.submitEnd(start);
+    if (sync_wait_ms > 0) {
+        handle.conn.health.record(sync_wait_ms, handle.conn.fpgaStatus().vram_ready);
+    }
+    return 0;
+}
+
+/// One buffer of a `gmz_submit_iov` frame (laid out like `struct iovec`).
+pub const gmz_iovec_t = extern struct {
+    base: ?[*]const u8 = null,
+    len: usize = 0,
+};
+
+/// Most buffers one `gmz_submit_iov` frame may span.
+const max_submit_iov = 64;
+
+/// Send a frame held in `iovcnt` buffers (header plus scanline slices,
+/// say), in order, as if they were one contiguous `gmz_submit` frame. Raw
+/// frames go out as MTU-sized datagrams gathered straight from the buffers,
+/// without a copy; compressed frames are gathered once into the staging
+/// buffer or pipeline slot. Returns 0 on success, -1 on null handle, more
+/// than 64 buffers, a null buffer with a length, or send failure.
+pub export fn gmz_submit_iov(
+    conn: ?*ConnHandle,
+    iov: ?[*]const gmz_iovec_t,
+    iovcnt: usize,
+    frame: u32,
+    field: u8,
+    vsync_line: u16,
+    sync_wait_ms: f64,
+) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    if (iovcnt > max_submit_iov) return -1;
+    var parts: [max_submit_iov][]const u8 = undefined;
+    if (iovcnt > 0) {
+        const vecs = iov orelse return -1;
+        for (vecs[0..iovcnt], parts[0..iovcnt]) |v, *p| {
+            p.* = if (v.base) |b| b[0..v.len] else if (v.len == 0) &.{} else return -1;
+        }
+    }
+    const start = handle.submitStart();
+    handle.submitGather(parts[0..iovcnt], .{
+        .frame_num = frame,
+        .field = field,
+        .vsync_line = vsync_line,
+    }) catch return -1;
+    handle.submitEnd(start);
+    if (sync_wait_ms > 0) {
+        handle.conn.health.record(sync_wait_ms, handle.conn.fpgaStatus().vram_ready);
+    }
+    return 0;
+}
+
+/// Hand out a library-owned buffer to render the next frame into, in the
+/// host's RGB mode: `*ptr` gets the frame's first byte and `*pitch` the
+/// bytes per row (the modeline's `h_active` wide, one field when
+/// interlaced). Slots are cache-line aligned and carved from the
+/// connection's slab (huge pages where available). Acquiring again before
+/// `gmz_commit_frame` returns the same slot. The slot is invalidated by
+/// anything that re-carves the slab (`gmz_set_modeline`, `gmz_set_pipeline`,
+/// `gmz_set_allocator`, an RGB mode fallback); commit then fails and the
+/// frame must be acquired again. Returns 0 on success, -1 on null handle or
+/// pointer, no modeline, or allocation failure.
+pub export fn gmz_acquire_frame(conn: ?*ConnHandle, ptr: ?*?[*]u8, pitch: ?*usize) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const out = ptr orelse return -1;
+    const out_pitch = pitch orelse return -1;
+    const m = handle.modeline orelse return -1;
+    if (handle.frame_ring == null) {
+        handle.ring = true;
+        const capacity = frameBytes(m, handle.conn.config.rgb_mode);
+        handle.rebuildBuffers(capacity, m.interlaced) catch {
+            handle.ring = false;
+            return -1;
+        };
+    }
+    out.* = handle.frame_ring.?[handle.ring_head].ptr;
+    out_pitch.* = @as(usize, m.h_active) * handle.host_mode.bytesPerPixel();
+    handle.acquired = true;
+    return 0;
+}
+
+/// Send the frame rendered into the slot from `gmz_acquire_frame`, without
+/// copying it: raw frames are sent straight from the slot, and delta modes
+/// take the delta against it and keep it as the field's reference in place
+/// of a copy. The slot is done with when this returns, and the next acquire
+/// gets another. Pipelined connections copy the frame into the pipeline as
+/// `gmz_submit` does. Returns 0 on success, -1 on null handle, no acquired
+/// slot, or send failure.
+pub export fn gmz_commit_frame(conn: ?*ConnHandle, frame: u32, field: u8, vsync_line: u16) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    if (!handle.acquired) return -1;
+    handle.acquired = false;
+    const slot = &handle.frame_ring.?[handle.ring_head];
+    handle.ring_head = (handle.ring_head + 1) % ring_slots;
+    const start = handle.submitStart();
+    handle.commitSlot(slot, .{
+        .frame_num = frame,
+        .field = field,
+        .vsync_line = vsync_line,
+    }) catch return -1;
+    handle.submitEnd(start);
+    return 0;
+}
+
+/// Scale `gmz_submit_strided` rectangles whose size differs from the
+/// modeline's active area (one field when interlaced) to fit it, while they
+/// are converted: 1 = nearest, 2 = integer (whole ratios, centred on
+/// black), 3 = box average, 0 = off. Returns 0 on success, -1 on null
+/// handle or unknown filter.
+pub export fn gmz_set_scaler(conn: ?*ConnHandle, filter: u8) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    handle.scaler = if (filter == 0) null else std.meta.intToEnum(ingest.Filter, filter) catch return -1;
+    return 0;
+}
+
+/// Enable (1) or disable (0) the bandwidth fallback: when sends, sync round
+/// trips or backpressure skips show, over `gmz_begin_frame`, that the link
+/// cannot carry the session's RGB mode, the session re-INITs with RGB565 and
+/// frames are converted and dithered on submit. It steps back up after
+/// `stable_frames` clean frames (0 = default 600), twice as long after each
+/// restore that falls back again quickly. Disabling while fallen back
+/// restores the host's mode at once. Transitions are reported through
+/// `gmz_poll_format_event`. Returns 0 on success, -1 on null handle, a
+/// connection already in RGB565, or a failed restore.
+pub export fn gmz_set_format_policy(conn: ?*ConnHandle, enabled: u8, stable_frames: u32) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    if (handle.host_mode == .rgb565) return -1;
+    if (enabled == 0) {
+        handle.format_policy = null;
+        if (handle.fallenBack()) {
+            handle.switchRgbMode(handle.host_mode) catch {
+                handle.pushFormatEvent(handle.pacer_state.client_frame, true);
+                return -1;
+            };
+            handle.pushFormatEvent(handle.pacer_state.client_frame, false);
+        }
+        return 0;
     }
+    var policy = FormatPolicy{};
+    if (stable_frames > 0) {
+        policy.stable_frames = stable_frames;
+        policy.max_stable_frames = stable_frames *| 8;
+    }
+    if (handle.fallenBack()) policy.level = .reduced;
+    handle.format_policy = policy;
+    return 0;
+}
+
+/// Pop the oldest unread RGB mode transition into `out`. Returns 1 when an
+/// event was read, 0 when there is none, -1 on null handle or `out`.
+pub export fn gmz_poll_format_event(conn: ?*ConnHandle, out: ?*gmz_format_event_t) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const dst = out orelse return -1;
+    if (handle.format_event_count == 0) return 0;
+    dst.* = handle.format_events[handle.format_event_head];
+    handle.format_event_head = @intCast((handle.format_event_head + 1) % handle.format_events.len);
+    handle.format_event_count -= 1;
+    return 1;
+}
+
+/// Enable (1) or disable (0) 4x4 ordered dithering when `gmz_submit_format`
+/// converts 8-bit channels to RGB565. The pattern is fixed to screen
+/// position, so static content stays static for delta compression.
+/// Returns 0 on success, -1 on null handle.
+pub export fn gmz_set_dither(conn: ?*ConnHandle, enabled: u8) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    handle.dither = enabled != 0;
     return 0;
 }
 
@@ -339,6 +1456,111 @@ pub export fn gmz_submit_audio(conn: ?*ConnHandle, data: [*]const u8, len: usize
     return 0;
 }
 
+/// Queue 16-bit PCM (interleaved if stereo) of any length for sending. The
+/// library sends it from `gmz_begin_frame` and `gmz_tick`, paced to the
+/// session's sound rate and split into CMD_AUDIO packets. Lock-free and
+/// never blocks, so an audio thread may call it while another thread
+/// streams frames; what doesn't fit in the ring (about 250 ms) is dropped.
+/// Returns the bytes queued (whole sample frames); 0 on null handle or a
+/// session without audio.
+pub export fn gmz_audio_write(conn: ?*ConnHandle, data: [*]const u8, len: usize) callconv(.c) usize {
+    const handle = conn orelse return 0;
+    const ring = if (handle.audio_ring) |*r| r else return 0;
+    const rs = handle.resampler orelse return ring.write(data[0..len]);
+    handle.steer(rs);
+    return ConnHandle.queueResampled(ring, rs, data[0..len]);
+}
+
+/// Like `gmz_audio_write` for audio in another sample format (`GMZ_SAMPLE_*`:
+/// s16, s32, f32) or channel count (1 or 2): `frames` interleaved frames are
+/// converted eight at a time in vector registers, with saturation, straight
+/// into the ring. Mono is duplicated to stereo sessions and stereo averaged
+/// to mono ones. Returns the frames queued; 0 on null handle, bad format or
+/// channel count, or a session without audio.
+pub export fn gmz_audio_write_format(conn: ?*ConnHandle, data: [*]const u8, frames: usize, format: u8, channels: u8) callconv(.c) usize {
+    const handle = conn orelse return 0;
+    const fmt = std.meta.intToEnum(pcm.SampleFormat, format) catch return 0;
+    const src = pcm.Source.interleaved(data, fmt, channels, frames) orelse return 0;
+    return handle.queueAudio(&src);
+}
+
+/// `gmz_audio_write_format` for planar audio: `planes[c]` holds channel
+/// `c`'s `frames` samples. Returns the frames queued.
+pub export fn gmz_audio_write_planar(conn: ?*ConnHandle, planes: ?[*]const ?[*]const u8, channels: u8, frames: usize, format: u8) callconv(.c) usize {
+    const handle = conn orelse return 0;
+    const p = planes orelse return 0;
+    const fmt = std.meta.intToEnum(pcm.SampleFormat, format) catch return 0;
+    const src = pcm.Source.planar(p[0..channels], fmt, frames) orelse return 0;
+    return handle.queueAudio(&src);
+}
+
+/// Enable (1) or disable (0) TPDF dither when s32 and f32 audio is reduced
+/// to 16 bits, trading a -96 dB noise floor for truncation distortion.
+/// Returns 0 on success, -1 on null handle.
+pub export fn gmz_set_audio_dither(conn: ?*ConnHandle, enabled: u8) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    handle.audio_dither = if (enabled != 0) pcm.Dither{} else null;
+    return 0;
+}
+
+/// Read the audio buffer levels, latency estimate, underrun and overrun
+/// counts, and latency histogram. Safe from any thread: the meter's fields
+/// are one consistent snapshot taken at the last frame boundary
+/// (`gmz_begin_frame` / `gmz_tick`); the ring level and overruns are read
+/// live. Null-safe (returns zeroed stats); zeroed for sessions without audio.
+pub export fn gmz_audio_stats(conn: ?*ConnHandle) callconv(.c) gmz_audio_stats_t {
+    const handle = conn orelse return .{};
+    var stats = handle.audio_stats.load();
+    if (handle.audio_ring) |*ring| {
+        stats.ring_ms = handle.conn.audio.bytesToMs(ring.fill());
+        stats.overruns = @atomicLoad(u32, &ring.overruns, .monotonic);
+    }
+    return stats;
+}
+
+/// Enable (1) or disable (0) audio drift compensation. The host's audio,
+/// generated at a rate tied to the FPGA's video clock, is resampled on its
+/// way into the ring by a ratio within 0.5% of 1. Once per frame
+/// (`gmz_begin_frame`, `gmz_tick`) the ratio is steered so the audio written
+/// but not yet played by the FPGA (ring plus the downstream estimate) stays
+/// `target_ms` (0 = 30 ms) beyond the send lead: no overruns or gaps on long
+/// sessions. Call before audio starts. Returns 0 on
+/// success, -1 on null handle, a session without audio, or allocation
+/// failure.
+pub export fn gmz_set_audio_resample(conn: ?*ConnHandle, enabled: u8, target_ms: u32) callconv(.c) c_int {
+    const handle = conn orelse return -1;
+    const ring = handle.audio_ring orelse return -1;
+    if (handle.resampler) |rs| std.heap.c_allocator.destroy(rs);
+    handle.resampler = null;
+    @atomicStore(f64, &handle.audio_ratio, 1.0, .monotonic);
+    if (enabled == 0) return 0;
+    const rs = std.heap.c_allocator.create(Resampler) catch return -1;
+    rs.* = Resampler.init(ring.frame_bytes / 2);
+    handle.resampler = rs;
+    const ms: u64 = (if (target_ms == 0) default_audio_target_ms else target_ms) + AudioRing.lead_ms;
+    handle.audio_control = Resampler.Control.init(@intCast(ring.byte_rate * ms / std.time.ms_per_s));
+    @atomicStore(f64, &handle.audio_ratio, 1.0, .monotonic);
+    return 0;
+}
+
+/// Current drift compensation ratio: input frames consumed per frame queued
+/// (above 1 when the host produces faster than the FPGA plays). 1.0 when
+/// disabled or on null handle.
+pub export fn gmz_audio_ratio(conn: ?*ConnHandle) callconv(.c) f64 {
+    const handle = conn orelse return 1.0;
+    return @atomicLoad(f64, &handle.audio_ratio, .monotonic);
+}
+
+/// Bytes queued by `gmz_audio_write` and not yet sent, for hosts steering
+/// their audio generation. `capacity` (optional) receives the ring size.
+/// Returns 0 on null handle or a session without audio.
+pub export fn gmz_audio_fill(conn: ?*ConnHandle, capacity: ?*usize) callconv(.c) usize {
+    const handle = conn orelse return 0;
+    const ring = if (handle.audio_ring) |*r| r else return 0;
+    if (capacity) |c| c.* = ring.buf.len;
+    return ring.fill();
+}
+
 /// Block until ACK received or timeout. Returns 0=ACK, 1=timeout, -1=null handle.
 pub export fn gmz_wait_sync(conn: ?*ConnHandle, timeout_ms: c_int) callconv(.c) c_int {
     const handle = conn orelse return -1;
@@ -350,7 +1572,10 @@ pub export fn gmz_wait_sync(conn: ?*ConnHandle, timeout_ms: c_int) callconv(.c)
 /// Returns: 0=ready to submit, 1=FPGA stalled (reconnect), 2=backpressure (skip), -1=null handle.
 pub export fn gmz_begin_frame(conn: ?*ConnHandle) callconv(.c) c_int {
     const handle = conn orelse return -1;
-    return @intFromEnum(handle.pacer_state.beginFrame(&handle.conn));
+    const result = handle.pacer_state.beginFrame(&handle.conn);
+    handle.adaptFormat(result);
+    handle.pumpAudio();
+    return @intFromEnum(result);
 }
 
 /// Return the library version string (e.g. "0.1.0"). Null-terminated.
@@ -358,6 +1583,12 @@ pub export fn gmz_version() callconv(.c) [*:0]const u8 {
     return version_info.version_string;
 }
 
+/// Return the kernel ISA variant picked for this CPU: "baseline",
+/// "x86_64_v3" (AVX2) or "x86_64_v4" (AVX-512). Null-terminated.
+pub export fn gmz_kernel_variant() callconv(.c) [*:0]const u8 {
+    return @tagName(isa.active());
+}
+
 /// Return the library major version number.
 pub export fn gmz_version_major() callconv(.c) u32 {
     return @intCast(version_info.version.major);
@@ -423,13 +1654,25 @@ pub export fn gmz_input_close(handle: ?*InputHandle) callconv(.c) void {
     std.heap.c_allocator.destroy(h);
 }
 
+/// Start a background thread that receives input packets as they arrive,
+/// stamping each on arrival. `gmz_input_joy`/`gmz_input_ps2` then return
+/// current state from any thread without polling, and `gmz_input_poll` only
+/// reports whether anything new arrived. Stopped by `gmz_input_close`.
+/// Returns 0 on success (or already running), -1 on failure. Null-safe.
+pub export fn gmz_input_start_thread(handle: ?*InputHandle) callconv(.c) c_int {
+    const h = handle orelse return -1;
+    h.input.startReceiver() catch return -1;
+    return 0;
+}
+
 /// Poll for pending input packets. Returns 1 if new data, 0 if none. Null-safe.
 pub export fn gmz_input_poll(handle: ?*InputHandle) callconv(.c) c_int {
     const h = handle orelse return 0;
     return if (h.input.poll()) 1 else 0;
 }
 
-/// Read latest joystick state. Null-safe (returns zeroed state).
+/// Read latest joystick state. Lock-free from any thread (a read that
+/// overlaps an update retries). Null-safe (returns zeroed state).
 pub export fn gmz_input_joy(handle: ?*InputHandle) callconv(.c) gmz_joy_state_t {
     const h = handle orelse return .{};
     const s = h.input.joyState();
@@ -449,7 +1692,8 @@ pub export fn gmz_input_joy(handle: ?*InputHandle) callconv(.c) gmz_joy_state_t
     };
 }
 
-/// Read latest PS/2 keyboard + mouse state. Null-safe (returns zeroed state).
+/// Read latest PS/2 keyboard + mouse state. Lock-free from any thread (a
+/// read that overlaps an update retries). Null-safe (returns zeroed state).
 pub export fn gmz_input_ps2(handle: ?*InputHandle) callconv(.c) gmz_ps2_state_t {
     const h = handle orelse return .{};
     const s = h.input.ps2State();
@@ -464,6 +1708,118 @@ pub export fn gmz_input_ps2(handle: ?*InputHandle) callconv(.c) gmz_ps2_state_t
     };
 }
 
+/// Drain up to `max` queued input transitions (button and key presses and
+/// releases) into `buf`, oldest first, each stamped with its packet's
+/// receive time. Transitions are recorded by `gmz_input_poll`, so a press
+/// and release between two polls are both reported. Returns the count
+/// written. Null-safe.
+pub export fn gmz_input_events(handle: ?*InputHandle, buf: ?[*]gmz_input_event_t, max: usize) callconv(.c) usize {
+    const h = handle orelse return 0;
+    const out = buf orelse return 0;
+    var events: [64]Input.Event = undefined;
+    var total: usize = 0;
+    while (total < max) {
+        const n = h.input.takeEvents(events[0..@min(events.len, max - total)]);
+        if (n == 0) break;
+        for (events[0..n], out[total..][0..n]) |e, *o| o.* = .{
+            .time_ns = e.time_ns,
+            .frame = e.frame,
+            .kind = @intFromEnum(e.kind),
+            .player = e.player,
+            .code = e.code,
+        };
+        total += n;
+    }
+    return total;
+}
+
+/// Count of input transitions lost because the event queue (1024 entries)
+/// was full: nonzero means `gmz_input_events` is not drained often enough
+/// and the event stream has gaps. Null-safe (returns 0).
+pub export fn gmz_input_events_dropped(handle: ?*InputHandle) callconv(.c) u32 {
+    const h = handle orelse return 0;
+    return h.input.droppedEvents();
+}
+
+// --- Shared-memory client exports ---
+
+/// Attach to `gmz-daemon` listening at `socket_path` (null = the default,
+/// /tmp/gmz-daemon.sock): create a shared-memory ring of three frame slots
+/// and an audio ring, and hand it over with an eventfd. The daemon opens the
+/// connection in `cfg` and paces, converts, compresses and sends what the
+/// host writes. Linux only. Returns null on bad settings, no daemon, or
+/// other platforms.
+pub export fn gmz_shm_open(socket_path: ?[*:0]const u8, cfg: ?*const gmz_shm_config_t) callconv(.c) ?*ShmClient {
+    const c = cfg orelse return null;
+    const path: [*:0]const u8 = socket_path orelse ShmRing.default_socket_path;
+    if (ShmRing.supported) return ShmClient.open(path, c) catch null else return null;
+}
+
+/// Detach from the daemon and free the ring. Null-safe.
+pub export fn gmz_shm_close(client: ?*ShmClient) callconv(.c) void {
+    const c = client orelse return;
+    if (ShmRing.supported) c.close();
+}
+
+/// Set the stream's modeline; the daemon applies it before the next frame.
+/// Returns 0 on success, -1 on null handle or a frame larger than the slots.
+pub export fn gmz_shm_set_modeline(client: ?*ShmClient, m: ?*const gmz_modeline_t) callconv(.c) c_int {
+    const c = client orelse return -1;
+    const src = m orelse return -1;
+    var mode = ShmRing.Mode{};
+    inline for (std.meta.fields(gmz_modeline_t)) |f| {
+        if (comptime !std.mem.eql(u8, f.name, "_pad")) @field(mode, f.name) = @field(src, f.name);
+    }
+    if (c.frameLen(mode) > c.ring.config.slot_bytes) return -1;
+    c.ring.setMode(mode);
+    c.mode = mode;
+    return 0;
+}
+
+/// Get the shared slot to render the next frame into, in the host format:
+/// `*ptr` is its first byte, `*pitch` the bytes per row. The daemon reads
+/// it straight from shared memory. Acquiring again before
+/// `gmz_shm_commit_frame` returns the same slot. Returns 0 on success, -1 on
+/// null handle or pointer, or no modeline.
+pub export fn gmz_shm_acquire_frame(client: ?*ShmClient, ptr: ?*?[*]u8, pitch: ?*usize) callconv(.c) c_int {
+    const c = client orelse return -1;
+    const out = ptr orelse return -1;
+    const out_pitch = pitch orelse return -1;
+    const mode = c.mode orelse return -1;
+    out.* = c.ring.slot(c.back).ptr;
+    out_pitch.* = c.pitch(mode);
+    c.acquired = true;
+    return 0;
+}
+
+/// Publish the acquired slot and wake the daemon. Never blocks: a frame the
+/// daemon had no time for is replaced by the next one. Returns 0 on
+/// success, -1 on null handle or no acquired slot.
+pub export fn gmz_shm_commit_frame(client: ?*ShmClient, frame: u32, field: u8, vsync_line: u16) callconv(.c) c_int {
+    const c = client orelse return -1;
+    if (!c.acquired) return -1;
+    c.acquired = false;
+    c.ring.header.slots[c.back] = .{
+        .frame = frame,
+        .len = @intCast(c.frameLen(c.mode.?)),
+        .vsync_line = vsync_line,
+        .field = field,
+    };
+    c.back = c.ring.publish(c.back);
+    ShmRing.signal(c.efd);
+    return 0;
+}
+
+/// Queue 16-bit PCM (interleaved if stereo) for the daemon to send. Never
+/// blocks: what doesn't fit in the audio ring is dropped. Returns the bytes
+/// queued (whole 4-byte frames).
+pub export fn gmz_shm_write_audio(client: ?*ShmClient, data: [*]const u8, len: usize) callconv(.c) usize {
+    const c = client orelse return 0;
+    const n = c.ring.writeAudio(data[0..len]);
+    if (n > 0) ShmRing.signal(c.efd);
+    return n;
+}
+
 // --- Tests ---
 
 test "ConnHandle.periodMs with modeline" {
@@ -585,6 +1941,11 @@ test "null handle safety: gmz_frame_time_ns" {
     try std.testing.expectEqual(@as(u64, 0), gmz_frame_time_ns(null));
 }
 
+test "gmz_kernel_variant names the active ISA variant" {
+    const name = std.mem.span(gmz_kernel_variant());
+    try std.testing.expect(std.meta.stringToEnum(isa.Variant, name) != null);
+}
+
 test "gmz_connect_ex without lz4 behaves like gmz_connect" {
     const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 0);
     // May fail to connect (no FPGA) but should not crash
@@ -600,12 +1961,599 @@ test "gmz_connect_ex with lz4 enabled" {
 test "gmz_connect_ex with lz4_delta mode" {
     const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
     if (handle) |h| {
-        // Delta state should be allocated
+        // Delta state is allocated; frame buffers wait for the modeline
         try std.testing.expect(h.delta_state != null);
-        try std.testing.expect(h.delta_buf != null);
-        try std.testing.expect(h.prev_frames[0] != null);
+        try std.testing.expect(h.delta_buf == null);
+        try std.testing.expect(h.prev_frames[0] == null);
+        gmz_disconnect(h);
+    }
+}
+
+test "null handle safety: gmz_set_keyframe_policy" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_keyframe_policy(null, 120, 600, 0.5));
+}
+
+test "null handle safety: gmz_compress_stats" {
+    const stats = gmz_compress_stats(null);
+    try std.testing.expectEqual(@as(u64, 0), stats.keyframes);
+}
+
+test "gmz_set_keyframe_policy configures delta state" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_keyframe_policy(h, 240, 1200, 0.7));
+        try std.testing.expectEqual(@as(u32, 240), h.delta_state.?.keyframe_interval);
+        try std.testing.expectEqual(@as(u32, 1200), h.delta_state.?.keyframe_max_interval);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_keyframe_policy(h, 240, 1200, 1.5));
+    }
+}
+
+test "gmz_set_near_lossless configures delta state" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_near_lossless(null, 4, 0));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 2, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_near_lossless(h, 6, 30));
+        try std.testing.expectEqual(@as(u8, 6), h.delta_state.?.lossy_threshold);
+        try std.testing.expectEqual(@as(u32, 30), h.delta_state.?.exact_refresh_interval);
+        try std.testing.expect(h.delta_state.?.rgb565);
+    }
+}
+
+test "near-lossless noise is not a scene cut under the connect defaults" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_near_lossless(h, 8, 0));
+        // Sensor noise: every byte jitters by a few units around mid-grey
+        var prng = std.Random.DefaultPrng.init(60);
+        var frame: [3072]u8 = undefined;
+        for (0..20) |_| {
+            for (&frame) |*b| b.* = 0x80 + prng.random().uintLessThan(u8, 4);
+            try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 1, 0, 0, 0));
+        }
+        const cs = gmz_compress_stats(h);
+        try std.testing.expectEqual(@as(u64, 0), cs.scene_cuts);
+        try std.testing.expectEqual(@as(u64, 1), cs.keyframes);
+        try std.testing.expectEqual(@as(u64, 19), cs.delta_frames);
+    }
+}
+
+test "gmz_set_frame_cache attaches and frees the keyframe cache" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_frame_cache(null, 1 << 20));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_frame_cache(h, 1 << 20));
+        try std.testing.expect(h.delta_state.?.cache == h.frame_cache.?);
+        const frame = [_]u8{0x10} ** 1024;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(usize, 1), h.frame_cache.?.count());
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_frame_cache(h, 0));
+        try std.testing.expect(h.delta_state.?.cache == null);
+    }
+}
+
+test "null handle safety: gmz_set_dual_encode" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_dual_encode(null, 1, 0));
+}
+
+test "gmz_set_dual_encode requires a delta connection" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 1);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_dual_encode(h, 1, 0));
+    }
+}
+
+test "gmz_set_dual_encode wires pool and candidate buffer into delta state" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        const frame = [_]u8{0x10} ** 1024;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_dual_encode(h, 1, 4000));
+        try std.testing.expect(h.delta_state.?.pool != null);
+        try std.testing.expect(h.delta_state.?.alt_buf != null);
+        try std.testing.expectEqual(@as(u64, 4_000_000), h.delta_state.?.dual_budget_ns);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_dual_encode(h, 0, 0));
+        try std.testing.expect(h.delta_state.?.alt_buf == null);
+    }
+}
+
+test "gmz_set_modeline selects a specialised delta kernel" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        var m = gmz_modeline_t{
+            .pixel_clock = 6.7,
+            .h_active = 320,
+            .h_begin = 336,
+            .h_end = 368,
+            .h_total = 426,
+            .v_active = 240,
+            .v_begin = 244,
+            .v_end = 247,
+            .v_total = 262,
+        };
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqualStrings("320x240 bgr888", h.delta_state.?.kernel.?.name);
+        m.h_active = 300;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqualStrings("generic", h.delta_state.?.kernel.?.name);
+    }
+}
+
+test "gmz_set_modeline sizes compression buffers from the mode" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        var m = gmz_modeline_t{
+            .pixel_clock = 6.7,
+            .h_active = 320,
+            .h_begin = 336,
+            .h_end = 368,
+            .h_total = 426,
+            .v_active = 240,
+            .v_begin = 244,
+            .v_end = 247,
+            .v_total = 262,
+        };
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqual(@as(usize, 320 * 240 * 3), h.frame_capacity);
+        try std.testing.expectEqual(@as(usize, 320 * 240 * 3), h.delta_buf.?.len);
+        try std.testing.expect(h.prev_frames[1] == null);
+        try std.testing.expectEqual(lz4.compressBound(320 * 240 * 3), h.conn.config.compressor.?.buf.len);
+
+        // Progressive: frames tagged field 1 share field 0's reference
+        const progressive = try std.testing.allocator.alloc(u8, h.frame_capacity);
+        defer std.testing.allocator.free(progressive);
+        @memset(progressive, 0x21);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, progressive.ptr, progressive.len, 1, 1, 0, 0));
+        try std.testing.expectEqual(@as(u8, 0x21), h.prev_frames[0].?[0]);
+
+        // Interlaced 640x480: one 240-line field per submit, both references
+        m.h_active = 640;
+        m.v_active = 480;
+        m.interlaced = 1;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqual(@as(usize, 640 * 240 * 3), h.frame_capacity);
         try std.testing.expect(h.prev_frames[1] != null);
+
+        // Oversized submits are rejected instead of overrunning the references
+        const big = try std.testing.allocator.alloc(u8, h.frame_capacity + 1);
+        defer std.testing.allocator.free(big);
+        @memset(big, 0);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_submit(h, big.ptr, big.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, big.ptr, big.len - 1, 1, 0, 0, 0));
+
+        // Odd v_active: the 244-line top field fits, not just the 243-line one
+        m.v_active = 487;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqual(@as(usize, 640 * 244 * 3), h.frame_capacity);
+        const top = try std.testing.allocator.alloc(u8, h.frame_capacity);
+        defer std.testing.allocator.free(top);
+        @memset(top, 0x42);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, top.ptr, top.len, 2, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, top.ptr, 640 * 243 * 3, 2, 1, 0, 0));
+    }
+}
+
+test "gmz_allocator_t field layout" {
+    try std.testing.expectEqual(@as(usize, 0), @offsetOf(gmz_allocator_t, "ctx"));
+    try std.testing.expectEqual(@as(usize, @sizeOf(usize)), @offsetOf(gmz_allocator_t, "alloc"));
+    try std.testing.expectEqual(@as(usize, 2 * @sizeOf(usize)), @offsetOf(gmz_allocator_t, "free"));
+    try std.testing.expectEqual(@as(usize, 3 * @sizeOf(usize)), @sizeOf(gmz_allocator_t));
+}
+
+const CountingHook = struct {
+    var live: usize = 0;
+
+    fn alloc(_: ?*anyopaque, size: usize, _: usize) callconv(.c) ?*anyopaque {
+        const mem = std.heap.page_allocator.alloc(u8, size) catch return null;
+        live += size;
+        return mem.ptr;
+    }
+
+    fn free(_: ?*anyopaque, ptr: ?*anyopaque, size: usize) callconv(.c) void {
+        const p: [*]u8 = @ptrCast(ptr.?);
+        std.heap.page_allocator.free(p[0..size]);
+        live -= size;
+    }
+};
+
+test "gmz_set_allocator carves buffers from embedder memory" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_allocator(null, null));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        const frame = [_]u8{0x42} ** 4096;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 1, 0, 0, 0));
+        try std.testing.expect(h.slab.?.backing != .allocator);
+
+        const incomplete = gmz_allocator_t{ .alloc = &CountingHook.alloc };
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_allocator(h, &incomplete));
+
+        const hook = gmz_allocator_t{ .alloc = &CountingHook.alloc, .free = &CountingHook.free };
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_allocator(h, &hook));
+        try std.testing.expectEqual(Slab.Backing.allocator, h.slab.?.backing);
+        try std.testing.expect(CountingHook.live >= 3 * frame.len);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 2, 0, 0, 0));
+
+        // A hook that can't allocate leaves the current buffers working
+        const failing = gmz_allocator_t{ .alloc = &failAlloc, .free = &CountingHook.free };
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_allocator(h, &failing));
+        try std.testing.expectEqual(Slab.Backing.allocator, h.slab.?.backing);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 3, 0, 0, 0));
+
         gmz_disconnect(h);
+        try std.testing.expectEqual(@as(usize, 0), CountingHook.live);
+    }
+}
+
+test "re-carving the slab keeps delta references" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        const frame = [_]u8{0x24} ** 2048;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_pipeline(h, 2));
+        try std.testing.expect(h.pipeline != null);
+        try std.testing.expect(h.delta_state.?.has_prev[0]);
+        try std.testing.expectEqualSlices(u8, &frame, h.prev_frames[0].?);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_pipeline(h, 0));
+        try std.testing.expect(h.delta_state.?.has_prev[0]);
+    }
+}
+
+test "gmz_submit without a modeline sizes buffers from the frame" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 1);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        const frame = [_]u8{0x11} ** 4096;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(usize, 4096), h.frame_capacity);
+    }
+}
+
+test "gmz_submit_format converts host pixels into the delta reference" {
+    const rgba = [_]u8{ 0x10, 0x20, 0x30, 0xFF } ** 1024;
+    try std.testing.expectEqual(@as(c_int, -1), gmz_submit_format(null, &rgba, rgba.len, 4, 1, 0, 0, 0));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_submit_format(h, &rgba, rgba.len, 99, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, -1), gmz_submit_format(h, &rgba, rgba.len - 1, 4, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_format(h, &rgba, rgba.len, 4, 1, 0, 0, 0));
+
+        var expected: [1024 * 3]u8 = undefined;
+        ingest.convert(.rgba8888, .bgr888, &rgba, &expected);
+        try std.testing.expectEqual(@as(usize, expected.len), h.frame_capacity);
+        try std.testing.expectEqualSlices(u8, &expected, h.prev_frames[0].?);
+    }
+    const plain = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 1);
+    if (plain) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_format(h, &rgba, rgba.len, 4, 1, 0, 0, 0));
+        try std.testing.expect(h.staging);
+        try std.testing.expectEqual(@as(usize, 1024 * 3), h.stage_buf.?.len);
+    }
+}
+
+test "gmz_submit_strided deltas a cropped rectangle" {
+    const pitch = 48 * 4;
+    var fb: [40 * pitch]u8 = undefined;
+    for (&fb, 0..) |*b, i| b.* = @truncate(i * 5);
+    try std.testing.expectEqual(@as(c_int, -1), gmz_submit_strided(null, &fb, pitch, 0, 0, 32, 32, 1, 1, 0, 0, 0));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 1, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        // Overruns the row
+        try std.testing.expectEqual(@as(c_int, -1), gmz_submit_strided(h, &fb, pitch, 20, 0, 32, 32, 1, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_strided(h, &fb, pitch, 8, 4, 32, 32, 1, 1, 0, 0, 0));
+        const ref = h.prev_frames[0].?;
+        try std.testing.expectEqual(@as(usize, 32 * 32 * 4), ref.len);
+        for (0..32) |row| {
+            try std.testing.expectEqualSlices(u8, fb[(4 + row) * pitch + 8 * 4 ..][0 .. 32 * 4], ref[row * 32 * 4 ..][0 .. 32 * 4]);
+        }
+    }
+}
+
+test "gmz_submit_iov gathers buffers into the delta reference" {
+    try std.testing.expectEqual(@as(usize, 0), @offsetOf(gmz_iovec_t, "base"));
+    try std.testing.expectEqual(@as(usize, @sizeOf(usize)), @offsetOf(gmz_iovec_t, "len"));
+    var frame: [4096]u8 = undefined;
+    for (&frame, 0..) |*b, i| b.* = @truncate(i * 3);
+    const iov = [_]gmz_iovec_t{
+        .{ .base = &frame, .len = 7 },
+        .{},
+        .{ .base = frame[7..].ptr, .len = 2000 },
+        .{ .base = frame[2007..].ptr, .len = frame.len - 2007 },
+    };
+    try std.testing.expectEqual(@as(c_int, -1), gmz_submit_iov(null, &iov, iov.len, 1, 0, 0, 0));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        const bad = [_]gmz_iovec_t{.{ .len = 4 }};
+        try std.testing.expectEqual(@as(c_int, -1), gmz_submit_iov(h, &bad, bad.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, -1), gmz_submit_iov(h, &iov, max_submit_iov + 1, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_iov(h, &iov, iov.len, 1, 0, 0, 0));
+        try std.testing.expectEqualSlices(u8, &frame, h.prev_frames[0].?);
+    }
+    const raw = gmz_connect("127.0.0.1", 1500, 0, 0, 0);
+    if (raw) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_iov(h, &iov, iov.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_iov(h, null, 0, 2, 0, 0, 0));
+    }
+}
+
+test "gmz_commit_frame keeps the acquired slot as the delta reference" {
+    var ptr: ?[*]u8 = null;
+    var pitch: usize = 0;
+    try std.testing.expectEqual(@as(c_int, -1), gmz_acquire_frame(null, &ptr, &pitch));
+    try std.testing.expectEqual(@as(c_int, -1), gmz_commit_frame(null, 1, 0, 0));
+    var m = gmz_modeline_t{
+        .pixel_clock = 6.7,
+        .h_active = 320,
+        .h_begin = 336,
+        .h_end = 367,
+        .h_total = 426,
+        .v_active = 240,
+        .v_begin = 244,
+        .v_end = 247,
+        .v_total = 262,
+    };
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        // Needs a modeline, and a slot to commit
+        try std.testing.expectEqual(@as(c_int, -1), gmz_acquire_frame(h, &ptr, &pitch));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqual(@as(c_int, -1), gmz_commit_frame(h, 1, 0, 0));
+
+        try std.testing.expectEqual(@as(c_int, 0), gmz_acquire_frame(h, &ptr, &pitch));
+        try std.testing.expectEqual(@as(usize, 320 * 3), pitch);
+        try std.testing.expectEqual(@as(usize, 0), @intFromPtr(ptr.?) % Slab.region_align);
+        const first = ptr.?;
+        @memset(first[0 .. pitch * 240], 0x40);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_commit_frame(h, 1, 0, 0));
+        try std.testing.expectEqual(first, h.prev_frames[0].?.ptr);
+
+        try std.testing.expectEqual(@as(c_int, 0), gmz_acquire_frame(h, &ptr, &pitch));
+        try std.testing.expect(ptr.? != first);
+        @memset(ptr.?[0 .. pitch * 240], 0x40);
+        ptr.?[0] = 0x41;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_commit_frame(h, 2, 0, 0));
+        try std.testing.expectEqual(ptr.?, h.prev_frames[0].?.ptr);
+        try std.testing.expectEqual(@as(u8, 0x41), h.prev_frames[0].?[0]);
+        try std.testing.expectEqual(@as(u64, 1), h.delta_state.?.stats.delta_frames);
+    }
+    const raw = gmz_connect("127.0.0.1", 1500, 0, 0, 0);
+    if (raw) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_acquire_frame(h, &ptr, &pitch));
+        @memset(ptr.?[0 .. pitch * 240], 0x40);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_commit_frame(h, 1, 0, 0));
+        try std.testing.expectEqual(@as(c_int, -1), gmz_commit_frame(h, 2, 0, 0));
+    }
+}
+
+test "gmz_set_scaler fits strided frames to the modeline" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_scaler(null, 1));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_scaler(h, 4));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_scaler(h, 2));
+        var m = gmz_modeline_t{
+            .pixel_clock = 6.7,
+            .h_active = 320,
+            .h_begin = 336,
+            .h_end = 367,
+            .h_total = 426,
+            .v_active = 240,
+            .v_begin = 244,
+            .v_end = 247,
+            .v_total = 262,
+        };
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+
+        // 256x224 native frame, centred in 320x240
+        const fb = try std.testing.allocator.alloc(u8, 256 * 224 * 3);
+        defer std.testing.allocator.free(fb);
+        @memset(fb, 0x80);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_strided(h, fb.ptr, 256 * 3, 0, 0, 256, 224, 0, 1, 0, 0, 0));
+        const ref = h.prev_frames[0].?;
+        try std.testing.expectEqual(@as(u8, 0), ref[0]);
+        try std.testing.expectEqual(@as(u8, 0x80), ref[(8 * 320 + 32) * 3]);
+        try std.testing.expectEqual(@as(u8, 0), ref[(8 * 320 + 31) * 3]);
+    }
+}
+
+test "gmz_format_event_t field layout" {
+    try std.testing.expectEqual(@as(usize, 0), @offsetOf(gmz_format_event_t, "frame"));
+    try std.testing.expectEqual(@as(usize, 4), @offsetOf(gmz_format_event_t, "rgb_mode"));
+    try std.testing.expectEqual(@as(usize, 5), @offsetOf(gmz_format_event_t, "fallback"));
+    try std.testing.expectEqual(@as(usize, 6), @offsetOf(gmz_format_event_t, "failed"));
+    try std.testing.expectEqual(@as(usize, 8), @sizeOf(gmz_format_event_t));
+}
+
+test "format fallback re-INITs with RGB565 and converts submits" {
+    var ev: gmz_format_event_t = .{};
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_format_policy(null, 1, 0));
+    try std.testing.expectEqual(@as(c_int, -1), gmz_poll_format_event(null, &ev));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        var m = gmz_modeline_t{
+            .pixel_clock = 6.7,
+            .h_active = 320,
+            .h_begin = 336,
+            .h_end = 367,
+            .h_total = 426,
+            .v_active = 240,
+            .v_begin = 244,
+            .v_end = 247,
+            .v_total = 262,
+        };
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_format_policy(h, 1, 30));
+
+        // A window of skipped frames falls back
+        for (0..FormatPolicy.window) |_| h.adaptFormat(.skip);
+        try std.testing.expectEqual(protocol.RgbMode.rgb565, h.conn.config.rgb_mode);
+        try std.testing.expectEqual(@as(usize, 320 * 240 * 2), h.frame_capacity);
+        try std.testing.expectEqual(@as(c_int, 1), gmz_poll_format_event(h, &ev));
+        try std.testing.expectEqual(@as(u8, 2), ev.rgb_mode);
+        try std.testing.expectEqual(@as(u8, 1), ev.fallback);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_poll_format_event(h, &ev));
+
+        // The host keeps submitting BGR888
+        const frame = try std.testing.allocator.alloc(u8, 320 * 240 * 3);
+        defer std.testing.allocator.free(frame);
+        @memset(frame, 0x40);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, frame.ptr, frame.len, 1, 0, 0, 0));
+        try std.testing.expectEqual(@as(u16, 0x4208), std.mem.readInt(u16, h.prev_frames[0].?[0..2], .little));
+
+        // Disabling restores the host's mode
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_format_policy(h, 0, 0));
+        try std.testing.expectEqual(protocol.RgbMode.bgr888, h.conn.config.rgb_mode);
+        try std.testing.expectEqual(@as(c_int, 1), gmz_poll_format_event(h, &ev));
+        try std.testing.expectEqual(@as(u8, 0), ev.fallback);
+    }
+}
+
+fn failAlloc(_: ?*anyopaque, _: usize, _: usize) callconv(.c) ?*anyopaque {
+    return null;
+}
+
+test "failed format switch keeps the previous mode and reports it" {
+    const h = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2) orelse return error.SkipZigTest;
+    defer gmz_disconnect(h);
+    var m = gmz_modeline_t{ .pixel_clock = 6.7, .h_active = 320, .h_begin = 336, .h_end = 367, .h_total = 426, .v_active = 240, .v_begin = 244, .v_end = 247, .v_total = 262 };
+    try std.testing.expectEqual(@as(c_int, 0), gmz_set_modeline(h, &m));
+    try std.testing.expectEqual(@as(c_int, 0), gmz_set_format_policy(h, 1, 30));
+    const capacity = h.frame_capacity;
+
+    // The RGB565 buffers cannot be allocated
+    h.alloc_hook = .{ .alloc = &failAlloc, .free = &CountingHook.free };
+    defer h.alloc_hook = null;
+    for (0..FormatPolicy.window) |_| h.adaptFormat(.skip);
+    try std.testing.expectEqual(protocol.RgbMode.bgr888, h.conn.config.rgb_mode);
+    try std.testing.expectEqual(capacity, h.frame_capacity);
+    try std.testing.expectEqual(FormatPolicy.Level.full, h.format_policy.?.level);
+    try std.testing.expect(!h.delta_state.?.rgb565);
+    var ev: gmz_format_event_t = .{};
+    try std.testing.expectEqual(@as(c_int, 1), gmz_poll_format_event(h, &ev));
+    try std.testing.expectEqual(@as(u8, 1), ev.failed);
+    try std.testing.expectEqual(@as(u8, 0), ev.fallback);
+    try std.testing.expectEqual(@as(u8, 0), ev.rgb_mode);
+}
+
+test "gmz_set_dither dithers RGB565 conversion" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_dither(null, 1));
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 2, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_dither(h, 1));
+        const rgba = [_]u8{ 132, 130, 60, 0xFF } ** 256;
+        try std.testing.expectEqual(@as(c_int, 0), gmz_submit_format(h, &rgba, rgba.len, 4, 1, 0, 0, 0));
+
+        var expected: [256 * 2]u8 = undefined;
+        ingest.convertDithered565(.rgba8888, &rgba, &expected, 0, 0);
+        try std.testing.expectEqualSlices(u8, &expected, h.prev_frames[0].?);
+        var plain: [256 * 2]u8 = undefined;
+        ingest.convert(.rgba8888, .rgb565, &rgba, &plain);
+        try std.testing.expect(!std.mem.eql(u8, &plain, &expected));
+    }
+}
+
+test "null handle safety: gmz_set_workers" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_workers(null, 2));
+}
+
+test "gmz_set_workers resizes the shared pool" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_workers(h, 3));
+        try std.testing.expectEqual(@as(usize, 3), h.delta_state.?.bands);
+        try std.testing.expectEqual(@as(usize, 2), h.pool.?.threads.len);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_workers(h, 1));
+        try std.testing.expect(h.pool == null);
+        // Dual encoding still gets a worker when the delta pass is serial
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_dual_encode(h, 1, 0));
+        try std.testing.expectEqual(@as(usize, 1), h.pool.?.threads.len);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_workers(h, 1));
+        try std.testing.expect(h.delta_state.?.pool != null);
+    }
+    const plain = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 1);
+    if (plain) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_workers(h, 2));
+    }
+}
+
+test "null handle safety: gmz_force_keyframe" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_force_keyframe(null, 0));
+}
+
+test "gmz_force_keyframe flags both fields for negative field" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_force_keyframe(h, -1));
+        try std.testing.expect(h.delta_state.?.force_keyframe[0].load(.acquire));
+        try std.testing.expect(h.delta_state.?.force_keyframe[1].load(.acquire));
+    }
+}
+
+test "gmz_pipeline_stats_t field layout" {
+    try std.testing.expectEqual(@as(usize, 0), @offsetOf(gmz_pipeline_stats_t, "frames"));
+    try std.testing.expectEqual(@as(usize, 8), @offsetOf(gmz_pipeline_stats_t, "avg_compress_us"));
+    try std.testing.expectEqual(@as(usize, 16), @offsetOf(gmz_pipeline_stats_t, "avg_send_us"));
+    try std.testing.expectEqual(@as(usize, 24), @offsetOf(gmz_pipeline_stats_t, "avg_stall_us"));
+    try std.testing.expectEqual(@as(usize, 32), @offsetOf(gmz_pipeline_stats_t, "depth"));
+    try std.testing.expectEqual(@as(usize, 40), @sizeOf(gmz_pipeline_stats_t));
+}
+
+test "null handle safety: gmz_set_pipeline" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_pipeline(null, 2));
+    try std.testing.expectEqual(@as(u8, 0), gmz_pipeline_stats(null).depth);
+}
+
+test "gmz_set_pipeline requires a compressor and a valid depth" {
+    const handle = gmz_connect("127.0.0.1", 1500, 0, 0, 0);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_pipeline(h, 2));
+    }
+    const handle_lz4 = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle_lz4) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_pipeline(h, 1));
+        try std.testing.expectEqual(@as(c_int, -1), gmz_set_pipeline(h, Pipeline.max_depth + 1));
+    }
+}
+
+test "gmz_submit through the pipeline sends every frame" {
+    const handle = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 2);
+    if (handle) |h| {
+        defer gmz_disconnect(h);
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_pipeline(h, 3));
+        var frame = [_]u8{0x20} ** (64 * 48 * 3);
+        for (0..8) |i| {
+            frame[i * 7] +%= 1;
+            try std.testing.expectEqual(@as(c_int, 0), gmz_submit(h, &frame, frame.len, @intCast(i), 0, 0, 0));
+        }
+        try std.testing.expectEqual(@as(u8, 3), gmz_pipeline_stats(h).depth);
+        // Disabling flushes the frames still in flight
+        try std.testing.expectEqual(@as(c_int, 0), gmz_set_pipeline(h, 0));
+        try std.testing.expect(h.pipeline == null);
+        const cs = gmz_compress_stats(h);
+        try std.testing.expectEqual(@as(u64, 8), cs.keyframes + cs.delta_frames);
     }
 }
 
@@ -622,6 +2570,7 @@ test "null handle safety: gmz_input_close" {
 
 test "null handle safety: gmz_input_poll" {
     try std.testing.expectEqual(@as(c_int, 0), gmz_input_poll(null));
+    try std.testing.expectEqual(@as(c_int, -1), gmz_input_start_thread(null));
 }
 
 test "null handle safety: gmz_input_joy" {
@@ -663,7 +2612,197 @@ test "gmz_ps2_state_t field layout" {
     try std.testing.expectEqual(@as(usize, 44), @sizeOf(gmz_ps2_state_t));
 }
 
+test "gmz_input_event_t field layout" {
+    try std.testing.expectEqual(@as(usize, 8), @offsetOf(gmz_input_event_t, "frame"));
+    try std.testing.expectEqual(@as(usize, 12), @offsetOf(gmz_input_event_t, "kind"));
+    try std.testing.expectEqual(@as(usize, 14), @offsetOf(gmz_input_event_t, "code"));
+    try std.testing.expectEqual(@as(usize, 16), @sizeOf(gmz_input_event_t));
+}
+
+test "gmz_input_events drains queued transitions" {
+    try std.testing.expectEqual(@as(usize, 0), gmz_input_events(null, null, 4));
+    var handle = InputHandle{ .input = .{ .sock = undefined } };
+    var pkt = [_]u8{0} ** 37;
+    pkt[0] = 1;
+    pkt[5 + 1] = 0x02; // scancode 9
+    _ = handle.input.accept(&pkt, 500);
+    pkt[0] = 2;
+    pkt[5 + 1] = 0;
+    _ = handle.input.accept(&pkt, 600);
+
+    var out: [4]gmz_input_event_t = undefined;
+    try std.testing.expectEqual(@as(usize, 1), gmz_input_events(&handle, &out, 1));
+    try std.testing.expectEqual(@as(u8, 3), out[0].kind); // key down
+    try std.testing.expectEqual(@as(u16, 9), out[0].code);
+    try std.testing.expectEqual(@as(u64, 500), out[0].time_ns);
+    try std.testing.expectEqual(@as(usize, 1), gmz_input_events(&handle, &out, 4));
+    try std.testing.expectEqual(@as(u8, 4), out[0].kind); // key up
+    try std.testing.expectEqual(@as(u32, 2), out[0].frame);
+    try std.testing.expectEqual(@as(u32, 0), gmz_input_events_dropped(&handle));
+    try std.testing.expectEqual(@as(u32, 0), gmz_input_events_dropped(null));
+}
+
 test "gmz_input_bind and close on loopback" {
     const handle = gmz_input_bind("127.0.0.1");
     if (handle) |h| gmz_input_close(h);
 }
+
+test "gmz_input_start_thread runs until close" {
+    const h = gmz_input_bind("127.0.0.1") orelse return error.SkipZigTest;
+    try std.testing.expectEqual(@as(c_int, 0), gmz_input_start_thread(h));
+    try std.testing.expectEqual(@as(c_int, 0), gmz_input_start_thread(h));
+    try std.testing.expectEqual(@as(c_int, 0), gmz_input_poll(h));
+    try std.testing.expectEqual(@as(u32, 0), gmz_input_joy(h).frame);
+    gmz_input_close(h);
+}
+
+test "null handle safety: gmz_shm functions" {
+    gmz_shm_close(null);
+    try std.testing.expectEqual(@as(?*ShmClient, null), gmz_shm_open(null, null));
+    try std.testing.expectEqual(@as(c_int, -1), gmz_shm_set_modeline(null, null));
+    try std.testing.expectEqual(@as(c_int, -1), gmz_shm_acquire_frame(null, null, null));
+    try std.testing.expectEqual(@as(c_int, -1), gmz_shm_commit_frame(null, 0, 0, 0));
+    var samples = [_]u8{0} ** 4;
+    try std.testing.expectEqual(@as(usize, 0), gmz_shm_write_audio(null, &samples, samples.len));
+}
+
+test "gmz_shm_open fails without a daemon" {
+    const cfg = gmz_shm_config_t{ .host = "127.0.0.1", .max_width = 16, .max_height = 16 };
+    try std.testing.expectEqual(@as(?*ShmClient, null), gmz_shm_open("/tmp/gmz-test-no-daemon.sock", &cfg));
+}
+
+test "gmz_shm frames reach the daemon side of the ring" {
+    if (!ShmRing.supported) return error.SkipZigTest;
+    const posix = std.posix;
+    const path = "/tmp/gmz-test-shm.sock";
+    posix.unlink(path) catch {};
+    defer posix.unlink(path) catch {};
+    const listener = try posix.socket(posix.AF.UNIX, posix.SOCK.STREAM | posix.SOCK.CLOEXEC, 0);
+    defer posix.close(listener);
+    const addr = try std.net.Address.initUnix(path);
+    try posix.bind(listener, &addr.any, addr.getOsSockLen());
+    try posix.listen(listener, 1);
+
+    const cfg = gmz_shm_config_t{ .host = "127.0.0.1", .max_width = 16, .max_height = 8, .audio_bytes = 64 };
+    const client = gmz_shm_open(path, &cfg) orelse return error.OpenFailed;
+    defer gmz_shm_close(client);
+    const sock = try posix.accept(listener, null, null, posix.SOCK.CLOEXEC);
+    defer posix.close(sock);
+    const fds = try ShmRing.recvFds(sock);
+    defer posix.close(fds[1]);
+    var ring = try ShmRing.open(fds[0]);
+    defer ring.deinit();
+
+    var ptr: ?[*]u8 = null;
+    var pitch: usize = 0;
+    try std.testing.expectEqual(@as(c_int, -1), gmz_shm_acquire_frame(client, &ptr, &pitch));
+    const too_big = gmz_modeline_t{ .h_active = 32, .v_active = 8 };
+    try std.testing.expectEqual(@as(c_int, -1), gmz_shm_set_modeline(client, &too_big));
+    const ml = gmz_modeline_t{ .pixel_clock = 6.7, .h_active = 16, .v_active = 8 };
+    try std.testing.expectEqual(@as(c_int, 0), gmz_shm_set_modeline(client, &ml));
+    try std.testing.expectEqual(@as(c_int, 0), gmz_shm_acquire_frame(client, &ptr, &pitch));
+    try std.testing.expectEqual(@as(usize, 16 * 3), pitch);
+    ptr.?[0] = 0xA5;
+    try std.testing.expectEqual(@as(c_int, 0), gmz_shm_commit_frame(client, 7, 0, 100));
+    try std.testing.expectEqual(@as(c_int, -1), gmz_shm_commit_frame(client, 8, 0, 100));
+
+    var seen: u32 = 0;
+    try std.testing.expectEqual(@as(u16, 16), ring.modeChanged(&seen).?.h_active);
+    const front = ring.take(2) orelse return error.NoFrame;
+    const info = ring.header.slots[front];
+    try std.testing.expectEqual(@as(u32, 7), info.frame);
+    try std.testing.expectEqual(@as(u32, @intCast(pitch * 8)), info.len);
+    try std.testing.expectEqual(@as(u8, 0xA5), ring.slot(front)[0]);
+}
+
+test "null handle safety: gmz_audio_write and gmz_audio_fill" {
+    const dummy = [_]u8{0} ** 4;
+    try std.testing.expectEqual(@as(usize, 0), gmz_audio_write(null, &dummy, dummy.len));
+    try std.testing.expectEqual(@as(usize, 0), gmz_audio_fill(null, null));
+}
+
+test "gmz_audio_write queues until a frame boundary sends it" {
+    // 48 kHz stereo
+    const conn = gmz_connect_ex("127.0.0.1", 1500, 0, 3, 2, 0) orelse return error.ConnectFailed;
+    defer gmz_disconnect(conn);
+    const samples = [_]u8{0x10} ** 6000;
+    try std.testing.expectEqual(@as(usize, 6000), gmz_audio_write(conn, &samples, samples.len));
+    var capacity: usize = 0;
+    try std.testing.expectEqual(@as(usize, 6000), gmz_audio_fill(conn, &capacity));
+    try std.testing.expectEqual(@as(usize, 65536), capacity);
+    // The first drain sends the 40 ms lead (7680 bytes): everything queued
+    _ = gmz_tick(conn);
+    try std.testing.expectEqual(@as(usize, 0), gmz_audio_fill(conn, null));
+
+    const silent = gmz_connect_ex("127.0.0.1", 1500, 0, 0, 0, 0) orelse return error.ConnectFailed;
+    defer gmz_disconnect(silent);
+    try std.testing.expectEqual(@as(usize, 0), gmz_audio_write(silent, &samples, samples.len));
+}
+
+test "gmz_connect sessions with sound queue audio too" {
+    // 48 kHz stereo, no compression
+    const conn = gmz_connect("127.0.0.1", 1500, 0, 3, 2) orelse return error.ConnectFailed;
+    defer gmz_disconnect(conn);
+    const samples = [_]u8{0} ** 1920;
+    try std.testing.expectEqual(samples.len, gmz_audio_write(conn, &samples, samples.len));
+    try std.testing.expectEqual(samples.len, gmz_audio_fill(conn, null));
+    try std.testing.expectEqual(@as(c_int, 0), gmz_set_audio_resample(conn, 1, 0));
+}
+
+test "gmz_set_audio_resample steers once per frame toward the target depth" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_audio_resample(null, 1, 0));
+    try std.testing.expectEqual(@as(f64, 1.0), gmz_audio_ratio(null));
+    const conn = gmz_connect_ex("127.0.0.1", 1500, 0, 3, 2, 0) orelse return error.ConnectFailed;
+    defer gmz_disconnect(conn);
+    try std.testing.expectEqual(@as(c_int, 0), gmz_set_audio_resample(conn, 1, 10));
+    // Writes alone don't move the ratio
+    const samples = [_]u8{0} ** 3840;
+    for (0..10) |_| try std.testing.expectEqual(samples.len, gmz_audio_write(conn, &samples, samples.len));
+    try std.testing.expectEqual(@as(f64, 1.0), gmz_audio_ratio(conn));
+    // 200 ms written and the FPGA not playing: far above 10 ms past the lead
+    for (0..5) |_| _ = gmz_tick(conn);
+    try std.testing.expect(gmz_audio_ratio(conn) > 1.0);
+    try std.testing.expectEqual(@as(c_int, 0), gmz_set_audio_resample(conn, 0, 0));
+    try std.testing.expectEqual(@as(f64, 1.0), gmz_audio_ratio(conn));
+}
+
+test "gmz_audio_write_format converts f32 mono into a stereo session" {
+    try std.testing.expectEqual(@as(c_int, -1), gmz_set_audio_dither(null, 1));
+    const in = [_]f32{ 0.5, -0.25, 1.5 };
+    const bytes = std.mem.sliceAsBytes(&in);
+    try std.testing.expectEqual(@as(usize, 0), gmz_audio_write_format(null, bytes.ptr, 3, 2, 1));
+    const conn = gmz_connect_ex("127.0.0.1", 1500, 0, 3, 2, 0) orelse return error.ConnectFailed;
+    defer gmz_disconnect(conn);
+    try std.testing.expectEqual(@as(usize, 0), gmz_audio_write_format(conn, bytes.ptr, 3, 9, 1));
+    try std.testing.expectEqual(@as(usize, 0), gmz_audio_write_format(conn, bytes.ptr, 3, 2, 3));
+    try std.testing.expectEqual(@as(usize, 3), gmz_audio_write_format(conn, bytes.ptr, 3, 2, 1));
+    const ring = &conn.audio_ring.?;
+    try std.testing.expectEqual(@as(usize, 12), ring.fill());
+    const want = [_]i16{ 16384, 16384, -8192, -8192, 32767, 32767 };
+    for (want, 0..) |w, i| try std.testing.expectEqual(w, std.mem.readInt(i16, ring.buf[i * 2 ..][0..2], .little));
+
+    const planes = [_]?[*]const u8{ bytes.ptr, bytes.ptr };
+    try std.testing.expectEqual(@as(usize, 3), gmz_audio_write_planar(conn, &planes, 2, 3, 2));
+    try std.testing.expectEqual(@as(usize, 24), ring.fill());
+}
+
+test "gmz_audio_stats tracks sends and overruns" {
+    const none = gmz_audio_stats(null);
+    try std.testing.expectEqual(@as(u64, 0), none.bytes_sent);
+    const conn = gmz_connect_ex("127.0.0.1", 1500, 0, 3, 2, 0) orelse return error.ConnectFailed;
+    defer gmz_disconnect(conn);
+    const samples = [_]u8{0} ** 1920; // 10 ms
+    try std.testing.expectEqual(@as(c_int, 0), gmz_submit_audio(conn, &samples, samples.len));
+    _ = gmz_tick(conn);
+    const stats = gmz_audio_stats(conn);
+    try std.testing.expectEqual(@as(u64, 1920), stats.bytes_sent);
+    // Nothing acknowledged playback: all of it is still downstream
+    try std.testing.expectApproxEqAbs(@as(f64, 10), stats.fpga_ms, 0.001);
+    try std.testing.expectEqual(@as(u32, 1), stats.histogram[1]);
+
+    const big = try std.testing.allocator.alloc(u8, 128 * 1024);
+    defer std.testing.allocator.free(big);
+    @memset(big, 0);
+    _ = gmz_audio_write(conn, big.ptr, big.len);
+    try std.testing.expectEqual(@as(u64, 1), gmz_audio_stats(conn).overruns);
+}
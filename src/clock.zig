@@ -0,0 +1,30 @@
+//! Monotonic time shared by the pacer, the audio path, the loss and health
+//! trackers, and input timestamps. Wall-clock time (`std.time.nanoTimestamp`)
+//! can step backwards under NTP; every interval the library measures is taken
+//! from here instead.
+
+const std = @import("std");
+
+const Instant = std.time.Instant;
+
+/// The clock's zero: `nowNs` counts from it.
+const origin: Instant = .{ .timestamp = std.mem.zeroes(@FieldType(Instant, "timestamp")) };
+
+/// Monotonic nanosecond timestamp (arbitrary origin, never steps backwards).
+/// Returns 0 only if the platform has no monotonic clock.
+pub fn nowNs() u64 {
+    const now = Instant.now() catch return 0;
+    return now.since(origin);
+}
+
+// --- Tests ---
+
+test "nowNs never goes backwards" {
+    var last = nowNs();
+    try std.testing.expect(last > 0);
+    for (0..1000) |_| {
+        const t = nowNs();
+        try std.testing.expect(t >= last);
+        last = t;
+    }
+}
@@ -1,6 +1,11 @@
 const std = @import("std");
 const Connection = @import("Connection.zig");
 const lz4 = @import("lz4.zig");
+const kernels = @import("kernels.zig");
+const isa = @import("isa.zig");
+const FrameCache = @import("FrameCache.zig");
+const ingest = @import("ingest.zig");
+const clock = @import("clock.zig");
 
 /// State for delta frame encoding. Tracks the previous frame and provides
 /// a scratch buffer for wrapping subtraction. Heap-allocated, pointed to by
@@ -11,8 +16,154 @@ pub const DeltaState = struct {
     has_prev: [2]bool = .{ false, false },
     frame_count: [2]u32 = .{ 0, 0 },
     keyframe_interval: u32 = 0, // 0 = disabled
+    /// Upper bound on frames between keyframes. Once `keyframe_interval` is
+    /// reached, the periodic keyframe waits for a frame whose sampled change
+    /// ratio is at least `refresh_ratio`, but never past this bound.
+    /// 0 (or any value <= `keyframe_interval`) fires exactly on schedule.
+    keyframe_max_interval: u32 = 0,
+    /// Sampled change ratio (0.0-1.0) at which a frame is treated as a scene
+    /// cut and sent as a keyframe immediately. 0 = disabled.
+    scene_cut_ratio: f32 = 0,
+    /// Minimum sampled change ratio for a deferred periodic keyframe to fire.
+    refresh_ratio: f32 = 0.05,
+    /// Worker pool for the banded delta pass and dual-candidate encoding.
+    /// When set together with `alt_buf`, every delta frame is also compressed
+    /// as a keyframe in parallel and whichever encoding is smaller gets sent.
+    pool: ?*std.Thread.Pool = null,
+    /// Output buffer for the keyframe candidate, at least
+    /// `lz4.compressBound(frame_size)` bytes.
+    alt_buf: ?[]u8 = null,
+    /// Fall back to single (delta-only) encoding while the last dual encode
+    /// took longer than this. Re-probed after every keyframe. 0 = no limit.
+    dual_budget_ns: u64 = 0,
+    dual_over_budget: bool = false,
+    /// Split the delta pass into up to this many scanline bands, processed
+    /// in parallel on `pool` (the calling thread takes one band). 1 = serial.
+    bands: usize = 1,
+    /// Delta kernel for the active modeline. Used when a frame matches its
+    /// specialised size; other frames take the generic kernel of the CPU's
+    /// ISA variant.
+    kernel: ?kernels.Kernel = null,
+    /// Per-field request for the next frame to be a keyframe (loss recovery,
+    /// host request). Cleared when the keyframe is produced. Atomic because
+    /// the host may request one while a pipeline worker is compressing.
+    force_keyframe: [2]std.atomic.Value(bool) = .{ .init(false), .init(false) },
+    /// Near-lossless mode: pixel channels within this distance (in 8-bit
+    /// units) of the reference keep the reference value, so their delta is
+    /// zero. The reference tracks what the FPGA reconstructs, so the error
+    /// stays below the threshold instead of accumulating. 0 = exact.
+    lossy_threshold: u8 = 0,
+    /// In near-lossless mode, code every Nth delta frame of a field exactly,
+    /// clearing the residual error without a keyframe. 0 = only keyframes.
+    exact_refresh_interval: u32 = 0,
+    lossy_count: [2]u32 = .{ 0, 0 },
+    /// Pixels are RGB565 (channel boundaries for near-lossless mode);
+    /// otherwise every byte is one 8-bit channel.
+    rgb565: bool = false,
+    /// Compressed keyframes of recently seen screens. When a frame is due as a
+    /// keyframe (first frame, schedule, request, scene cut) and matches an
+    /// entry, the cached keyframe is sent without compressing. Every keyframe
+    /// is added; delta-coded frames never pay for the lookup.
+    cache: ?*FrameCache = null,
+    stats: Stats = .{},
 };
 
+/// Running counters for keyframe/delta decisions.
+pub const Stats = struct {
+    keyframes: u64 = 0,
+    delta_frames: u64 = 0,
+    /// Keyframes forced by the scene-cut estimator.
+    scene_cuts: u64 = 0,
+    /// Dual-candidate frames where the keyframe encoding was smaller.
+    dual_keyframe_wins: u64 = 0,
+    /// Keyframes sent because of `requestKeyframe`.
+    forced_keyframes: u64 = 0,
+    /// Delta frames coded with the near-lossless threshold.
+    near_lossless_frames: u64 = 0,
+    /// Near-lossless delta frames coded exactly by `exact_refresh_interval`.
+    exact_refreshes: u64 = 0,
+    /// Keyframes served from `cache` without compression.
+    cache_hits: u64 = 0,
+    /// Cache lookups that found nothing.
+    cache_misses: u64 = 0,
+    /// Frame bytes whose compression was skipped by cache hits.
+    cache_bytes_saved: u64 = 0,
+
+    /// Bump a counter. Atomic: a pipeline worker counts while the host
+    /// thread reads.
+    fn add(self: *Stats, comptime counter: std.meta.FieldEnum(Stats), n: u64) void {
+        _ = @atomicRmw(u64, &@field(self, @tagName(counter)), .Add, n, .monotonic);
+    }
+
+    /// Copy of the counters, safe to take while a worker is compressing.
+    pub fn snapshot(self: *const Stats) Stats {
+        var out: Stats = .{};
+        inline for (std.meta.fields(Stats)) |f| {
+            @field(out, f.name) = @atomicLoad(u64, &@field(self, f.name), .monotonic);
+        }
+        return out;
+    }
+};
+
+/// Number of bytes compared by `changeRatio`.
+pub const sample_points = 4096;
+
+/// Estimate the fraction of bytes that differ between `a` and `b` by
+/// comparing a sparse, evenly spaced grid of `sample_points` bytes.
+/// Frames shorter than `sample_points` are compared in full.
+pub fn changeRatio(a: []const u8, b: []const u8) f32 {
+    return sampledRatio(a, b, @min(a.len, b.len), .{});
+}
+
+/// What `sampledRatio` counts as a changed sample.
+const Sensitivity = struct {
+    /// Smallest channel distance (8-bit units) that counts; 0 counts any
+    /// change. Near-lossless mode passes its threshold, so the sensor noise
+    /// it discards does not look like motion.
+    threshold: u8 = 0,
+    /// Samples are RGB565 words, compared per channel.
+    rgb565: bool = false,
+};
+
+/// `changeRatio` over the first `len` bytes; `a` is a byte slice or anything
+/// with `byteAt` (a converting `ingest.Source`).
+fn sampledRatio(a: anytype, b: []const u8, len: usize, sense: Sensitivity) f32 {
+    if (len == 0) return 0;
+
+    // Odd stride so samples rotate through pixel channels instead of
+    // always landing on the same one.
+    const stride = (len / sample_points) | 1;
+    var changed: u32 = 0;
+    var total: u32 = 0;
+    var i: usize = stride / 2;
+    while (i < len) : (i += stride) {
+        changed += @intFromBool(sampleMoved(a, b, i, len, sense));
+        total += 1;
+    }
+    return @as(f32, @floatFromInt(changed)) / @as(f32, @floatFromInt(total));
+}
+
+fn sampleByte(a: anytype, i: usize) u8 {
+    return if (@TypeOf(a) == []const u8) a[i] else a.byteAt(i);
+}
+
+/// Whether the sample at byte `i` moved by at least `sense.threshold`.
+fn sampleMoved(a: anytype, b: []const u8, i: usize, len: usize, sense: Sensitivity) bool {
+    if (sense.threshold == 0) return sampleByte(a, i) != b[i];
+    if (sense.rgb565) {
+        const w = i & ~@as(usize, 1);
+        if (w + 2 > len) return false;
+        const s = @as(u16, sampleByte(a, w + 1)) << 8 | sampleByte(a, w);
+        const p = std.mem.readInt(u16, b[w..][0..2], .little);
+        // A channel that quantizes to the reference value has not moved
+        return quantizeChannel(s, p, 11, 5, sense.threshold) != (p & 0xF800) or
+            quantizeChannel(s, p, 5, 6, sense.threshold) != (p & 0x07E0) or
+            quantizeChannel(s, p, 0, 5, sense.threshold) != (p & 0x001F);
+    }
+    const x = sampleByte(a, i);
+    return @max(x, b[i]) - @min(x, b[i]) >= sense.threshold;
+}
+
 /// Return a `Connection.Compressor` backed by delta (wrapping subtract) + LZ4 compression.
 /// `state` holds the previous-frame and scratch buffers.
 /// `lz4_buf` must be at least `lz4.compressBound(frame_size)` bytes.
@@ -21,48 +172,513 @@ pub fn compressor(state: *DeltaState, lz4_buf: []u8) Connection.Compressor {
         .ctx = state,
         .buf = lz4_buf,
         .compressFn = &deltaCompress,
+        .compressSourceFn = &deltaCompressSource,
+        .compressOwnedFn = &deltaCompressOwned,
+        .requestKeyframeFn = &requestKeyframe,
     };
 }
 
+/// Make the next frame for `field` a keyframe. `ctx` is the `*DeltaState`.
+pub fn requestKeyframe(ctx: ?*anyopaque, field: u8) void {
+    const state: *DeltaState = @ptrCast(@alignCast(ctx orelse return));
+    state.force_keyframe[refIndex(state, field)].store(true, .release);
+}
+
+/// Reference slot for `field`. Progressive sessions only have field 0's
+/// reference, so frames tagged field 1 share it.
+fn refIndex(state: *const DeltaState, field: u8) usize {
+    return if (field != 0 and state.prev_frames[1].len > 0) 1 else 0;
+}
+
 fn deltaCompress(ctx: ?*anyopaque, src: []const u8, dst: []u8, field: u8) ?Connection.CompressResult {
     const state: *DeltaState = @ptrCast(@alignCast(ctx orelse return null));
-    const f: usize = @min(field, 1);
+    return encode(state, .{ .bytes = src }, dst, field);
+}
+
+/// `deltaCompress` for a frame in a host pixel format: each piece is
+/// converted as the delta pass reads it, so the converted frame is only
+/// ever written as the new reference.
+fn deltaCompressSource(ctx: ?*anyopaque, source: *const ingest.Source, dst: []u8, field: u8) ?Connection.CompressResult {
+    const state: *DeltaState = @ptrCast(@alignCast(ctx orelse return null));
+    if (source.contiguous()) |frame| return encode(state, .{ .bytes = frame }, dst, field);
+    return encode(state, .{ .source = source }, dst, field);
+}
+
+/// `deltaCompress` for a library-owned frame the size of the field's
+/// reference: it becomes the reference by exchanging buffers, and `frame` is
+/// left holding the old reference. Exact deltas skip the reference update,
+/// so the frame is read once and never copied. Near-lossless mode and the
+/// keyframe cache take the copying path.
+fn deltaCompressOwned(ctx: ?*anyopaque, frame: *[]u8, dst: []u8, field: u8) ?Connection.CompressResult {
+    const state: *DeltaState = @ptrCast(@alignCast(ctx orelse return null));
+    const f = refIndex(state, field);
+    const prev = state.prev_frames[f];
+    if (frame.len != prev.len or frame.len > state.delta_buf.len or state.lossy_threshold != 0 or state.cache != null) {
+        return encode(state, .{ .bytes = frame.* }, dst, field);
+    }
+
+    if (!state.has_prev[f]) {
+        state.has_prev[f] = true;
+        return ownedKeyframe(state, f, frame, dst, field);
+    }
+    state.frame_count[f] += 1;
+    if (keyframeDue(state, f, .{ .bytes = frame.* }, prev)) {
+        return ownedKeyframe(state, f, frame, dst, field);
+    }
+
+    const delta_out = state.delta_buf[0..prev.len];
+    subtractOnlyBands(state.pool, state.bands, delta_out, frame.*, prev);
+    adopt(state, f, frame);
+    const src = state.prev_frames[f];
+    if (state.pool) |pool| if (state.alt_buf) |alt_buf| if (!state.dual_over_budget) {
+        return dualCompress(state, pool, alt_buf, f, src, src, true, delta_out, dst, null);
+    };
+    const result = lz4.compress(null, delta_out, dst, field) orelse return null;
+    state.stats.add(.delta_frames, 1);
+    return .{ .data = result.data, .is_delta = true };
+}
+
+/// `keyframe` for an owned frame: adopted as the reference, then compressed.
+fn ownedKeyframe(state: *DeltaState, f: usize, frame: *[]u8, dst: []u8, field: u8) ?Connection.CompressResult {
+    state.frame_count[f] = 0;
+    state.lossy_count[f] = 0;
+    state.dual_over_budget = false;
+    adopt(state, f, frame);
+    const result = lz4.compress(null, state.prev_frames[f], dst, field) orelse return null;
+    state.stats.add(.keyframes, 1);
+    return .{ .data = result.data, .is_delta = false };
+}
+
+/// Make `frame` the field's reference and hand the old one back in `frame`.
+fn adopt(state: *DeltaState, f: usize, frame: *[]u8) void {
+    std.mem.swap([]u8, &state.prev_frames[f], frame);
+}
+
+/// Frame being encoded: wire-format bytes, or a source converted on read.
+const Input = union(enum) {
+    bytes: []const u8,
+    source: *const ingest.Source,
+
+    fn len(self: Input) usize {
+        return switch (self) {
+            .bytes => |b| b.len,
+            .source => |s| s.frameBytes(),
+        };
+    }
+
+    /// `changeRatio` of the frame against `prev`.
+    fn ratioAgainst(self: Input, prev: []const u8, sense: Sensitivity) f32 {
+        return switch (self) {
+            .bytes => |b| sampledRatio(b, prev, @min(b.len, prev.len), sense),
+            .source => |s| sampledRatio(s, prev, prev.len, sense),
+        };
+    }
+
+    fn digest(self: Input) FrameCache.Digest {
+        switch (self) {
+            .bytes => |b| return FrameCache.digest(b),
+            .source => |s| {
+                var hasher = std.crypto.hash.Blake3.init(.{});
+                var scratch: [source_scratch_bytes]u8 = undefined;
+                var off: usize = 0;
+                const total = s.frameBytes();
+                while (off < total) : (off += scratch.len) {
+                    const n = @min(scratch.len, total - off);
+                    s.read(off, scratch[0..n]);
+                    hasher.update(scratch[0..n]);
+                }
+                var out: FrameCache.Digest = undefined;
+                hasher.final(&out);
+                return out;
+            },
+        }
+    }
+
+    /// Write the frame into `out`.
+    fn copyTo(self: Input, out: []u8) void {
+        switch (self) {
+            .bytes => |b| @memcpy(out, b),
+            .source => |s| s.read(0, out),
+        }
+    }
+};
+
+fn encode(state: *DeltaState, input: Input, dst: []u8, field: u8) ?Connection.CompressResult {
+    const f = refIndex(state, field);
+    const len = input.len();
+    // Buffers are sized from the modeline; never slice past them
+    if (len > state.prev_frames[f].len or len > state.delta_buf.len) return null;
+
+    const prev = state.prev_frames[f][0..len];
 
     if (!state.has_prev[f]) {
         // First frame for this field: send full compressed frame, store as reference
-        @memcpy(state.prev_frames[f][0..src.len], src);
         state.has_prev[f] = true;
-        state.frame_count[f] = 0;
-        const result = lz4.compress(null, src, dst, field) orelse return null;
-        return .{ .data = result.data, .is_delta = false };
+        return cachedOrKeyframe(state, f, input, dst, field);
     }
 
     state.frame_count[f] += 1;
 
-    // Periodic keyframe: send a full (non-delta) frame so the FPGA can resync
-    if (state.keyframe_interval > 0 and state.frame_count[f] >= state.keyframe_interval) {
-        state.frame_count[f] = 0;
-        @memcpy(state.prev_frames[f][0..src.len], src);
-        const result = lz4.compress(null, src, dst, field) orelse return null;
-        return .{ .data = result.data, .is_delta = false };
+    // Keyframe on schedule or on a scene cut, so the FPGA can resync
+    if (keyframeDue(state, f, input, prev)) {
+        return cachedOrKeyframe(state, f, input, dst, field);
     }
 
-    // Wrapping-subtract src with prev_frame into delta_buf.
-    // The FPGA reconstructs via wrapping addition: output[i] = delta[i] + prev[i].
-    const prev = state.prev_frames[f][0..src.len];
-    const delta_out = state.delta_buf[0..src.len];
-    for (delta_out, src, prev) |*d, s, p| {
-        d.* = s -% p;
+    // Wrapping-subtract the frame from prev_frame into delta_buf and update
+    // the reference, one band per worker for large frames. In near-lossless
+    // mode small channel changes are dropped and the reference becomes what
+    // the FPGA will reconstruct rather than the frame.
+    const delta_out = state.delta_buf[0..len];
+    const exact = state.lossy_threshold == 0 or exactRefreshDue(state, f);
+    var pass: Pass = .{ .lossy = .{ .threshold = state.lossy_threshold, .rgb565 = state.rgb565 } };
+    if (exact) {
+        var kernel = isa.generic();
+        if (state.kernel) |k| if (k.fits(len)) {
+            kernel = k;
+        };
+        pass = .{ .exact = kernel };
+    } else {
+        state.stats.add(.near_lossless_frames, 1);
+    }
+    switch (input) {
+        .bytes => |src| switch (pass) {
+            .exact => |kernel| subtractBands(state.pool, state.bands, kernel, delta_out, src, prev),
+            .lossy => pass.apply(delta_out, src, prev),
+        },
+        .source => |source| sourceBands(state.pool, state.bands, pass, source, delta_out, prev),
     }
 
-    // Update prev_frame for next call
-    @memcpy(state.prev_frames[f][0..src.len], src);
+    // Keyframe candidate: the frame. A converted frame only exists as the
+    // reference, which matches it after an exact pass.
+    const frame: ?[]const u8 = switch (input) {
+        .bytes => |b| b,
+        .source => if (exact) prev else null,
+    };
+    if (state.pool) |pool| if (state.alt_buf) |alt_buf| if (!state.dual_over_budget) if (frame) |src| {
+        return dualCompress(state, pool, alt_buf, f, src, prev, exact, delta_out, dst, key);
+    };
 
     // LZ4 compress the delta
     const result = lz4.compress(null, delta_out, dst, field) orelse return null;
+    state.stats.add(.delta_frames, 1);
     return .{ .data = result.data, .is_delta = true };
 }
 
+/// Smallest band worth handing to another thread. Below this, scheduling
+/// overhead outweighs the memory bandwidth gained.
+pub const min_band_bytes = 64 * 1024;
+
+/// Wrapping-subtract `prev` from `src` into `delta_out`, then copy `src` into
+/// `prev`, in a single pass. The FPGA reconstructs via wrapping addition:
+/// output[i] = delta[i] + prev[i].
+pub const subtractUpdate = kernels.subtractUpdate;
+
+/// `kernel.subtractUpdate` split into up to `bands` contiguous bands, aligned
+/// to the kernel's row length, run concurrently on `pool`. Runs serially
+/// without a pool or when the frame is too small to split.
+pub fn subtractBands(pool: ?*std.Thread.Pool, bands: usize, kernel: kernels.Kernel, delta_out: []u8, src: []const u8, prev: []u8) void {
+    const n = @min(bands, src.len / min_band_bytes);
+    const p = pool orelse return kernel.subtractUpdate(delta_out, src, prev);
+    if (n <= 1) return kernel.subtractUpdate(delta_out, src, prev);
+
+    const band_len = bandLength(src.len, n, kernel.row_bytes);
+    var wg: std.Thread.WaitGroup = .{};
+    var start: usize = band_len;
+    while (start < src.len) : (start += band_len) {
+        const end = @min(start + band_len, src.len);
+        p.spawnWg(&wg, runKernel, .{ kernel, delta_out[start..end], src[start..end], prev[start..end] });
+    }
+    // First band on the calling thread, then help with the rest
+    const first = @min(band_len, src.len);
+    kernel.subtractUpdate(delta_out[0..first], src[0..first], prev[0..first]);
+    p.waitAndWork(&wg);
+}
+
+/// Length of each of `n` bands over `len` bytes: a whole number of `unit`s,
+/// which need not be a power of two (specialised kernels band on rows).
+fn bandLength(len: usize, n: usize, unit: usize) usize {
+    const per_band = std.math.divCeil(usize, len, n) catch unreachable;
+    return (std.math.divCeil(usize, per_band, unit) catch unreachable) * unit;
+}
+
+fn runKernel(kernel: kernels.Kernel, delta_out: []u8, src: []const u8, prev: []u8) void {
+    kernel.subtractUpdate(delta_out, src, prev);
+}
+
+/// Wrapping-subtract `prev` from `src` into `delta_out`, leaving `prev`
+/// untouched (for frames that replace the reference by exchange).
+pub fn subtractOnly(delta_out: []u8, src: []const u8, prev: []const u8) void {
+    const V = @Vector(vec_len, u8);
+    var i: usize = 0;
+    while (i + vec_len <= src.len) : (i += vec_len) {
+        const s: V = src[i..][0..vec_len].*;
+        const p: V = prev[i..][0..vec_len].*;
+        delta_out[i..][0..vec_len].* = s -% p;
+    }
+    for (delta_out[i..src.len], src[i..], prev[i..src.len]) |*d, s, p| d.* = s -% p;
+}
+
+/// `subtractOnly` split into bands like `subtractBands`, on cache lines.
+pub fn subtractOnlyBands(pool: ?*std.Thread.Pool, bands: usize, delta_out: []u8, src: []const u8, prev: []const u8) void {
+    const n = @min(bands, src.len / min_band_bytes);
+    const p = pool orelse return subtractOnly(delta_out, src, prev);
+    if (n <= 1) return subtractOnly(delta_out, src, prev);
+
+    const band_len = std.mem.alignForward(usize, std.math.divCeil(usize, src.len, n) catch unreachable, 64);
+    var wg: std.Thread.WaitGroup = .{};
+    var start: usize = band_len;
+    while (start < src.len) : (start += band_len) {
+        const end = @min(start + band_len, src.len);
+        p.spawnWg(&wg, subtractOnly, .{ delta_out[start..end], src[start..end], prev[start..end] });
+    }
+    const first = @min(band_len, src.len);
+    subtractOnly(delta_out[0..first], src[0..first], prev[0..first]);
+    p.waitAndWork(&wg);
+}
+
+/// How one frame's delta is produced.
+const Pass = union(enum) {
+    /// Exact subtract + reference update.
+    exact: kernels.Kernel,
+    /// Near-lossless (`quantizeUpdate`).
+    lossy: struct { threshold: u8, rgb565: bool },
+
+    /// Alignment of the pieces the pass may be split into.
+    fn granularity(self: Pass) usize {
+        return switch (self) {
+            .exact => |k| k.row_bytes,
+            .lossy => 64,
+        };
+    }
+
+    fn apply(self: Pass, delta_out: []u8, src: []const u8, prev: []u8) void {
+        switch (self) {
+            .exact => |k| k.subtractUpdate(delta_out, src, prev),
+            .lossy => |l| if (l.rgb565) {
+                quantizeUpdate565(delta_out, src, prev, l.threshold);
+            } else {
+                quantizeUpdate(delta_out, src, prev, l.threshold);
+            },
+        }
+    }
+};
+
+/// Converted bytes handled per step of a fused pass: small enough to stay
+/// in L1, and a whole number of rows for every specialised kernel.
+const source_scratch_bytes = 16 * 1024;
+
+/// Fused convert + delta: `pass` over `source`, split into bands like
+/// `subtractBands`. Each band converts a few rows at a time into an
+/// L1-resident scratch buffer and runs the pass on them straight away.
+fn sourceBands(pool: ?*std.Thread.Pool, bands: usize, pass: Pass, source: *const ingest.Source, delta_out: []u8, prev: []u8) void {
+    const total = delta_out.len;
+    const n = @min(bands, total / min_band_bytes);
+    const p = pool orelse return runSource(pass, source, 0, total, delta_out, prev);
+    if (n <= 1) return runSource(pass, source, 0, total, delta_out, prev);
+
+    const band_len = bandLength(total, n, pass.granularity());
+    var wg: std.Thread.WaitGroup = .{};
+    var start: usize = band_len;
+    while (start < total) : (start += band_len) {
+        p.spawnWg(&wg, runSource, .{ pass, source, start, @min(start + band_len, total), delta_out, prev });
+    }
+    runSource(pass, source, 0, @min(band_len, total), delta_out, prev);
+    p.waitAndWork(&wg);
+}
+
+/// `subtractBands` reading the frame through a converting `source`: the
+/// exact pass of `sourceBands`. `delta_out` and `prev` hold the converted frame.
+pub fn subtractSource(pool: ?*std.Thread.Pool, bands: usize, kernel: kernels.Kernel, source: *const ingest.Source, delta_out: []u8, prev: []u8) void {
+    sourceBands(pool, bands, .{ .exact = kernel }, source, delta_out, prev);
+}
+
+fn runSource(pass: Pass, source: *const ingest.Source, start: usize, end: usize, delta_out: []u8, prev: []u8) void {
+    var scratch: [source_scratch_bytes]u8 align(64) = undefined;
+    const unit = pass.granularity();
+    std.debug.assert(unit <= scratch.len);
+    const step = scratch.len / unit * unit;
+    var off = start;
+    while (off < end) : (off += step) {
+        const n = @min(step, end - off);
+        source.read(off, scratch[0..n]);
+        pass.apply(delta_out[off..][0..n], scratch[0..n], prev[off..][0..n]);
+    }
+}
+
+const vec_len = std.simd.suggestVectorLength(u8) orelse 16;
+
+/// Near-lossless `subtractUpdate` for 8-bit channels: bytes within
+/// `threshold` of `prev` get a zero delta and keep their `prev` value, the
+/// rest are coded exactly. Afterwards `prev` holds the FPGA's reconstruction
+/// (`prev +% delta_out`), which differs from `src` by less than `threshold`.
+pub fn quantizeUpdate(delta_out: []u8, src: []const u8, prev: []u8, threshold: u8) void {
+    const V = @Vector(vec_len, u8);
+    const t: V = @splat(threshold);
+    const zero: V = @splat(0);
+    var i: usize = 0;
+    while (i + vec_len <= src.len) : (i += vec_len) {
+        const s: V = src[i..][0..vec_len].*;
+        const p: V = prev[i..][0..vec_len].*;
+        // True distance, not the wrapped delta: 0xFF vs 0x00 is far apart
+        const small = @max(s, p) - @min(s, p) < t;
+        delta_out[i..][0..vec_len].* = @select(u8, small, zero, s -% p);
+        prev[i..][0..vec_len].* = @select(u8, small, p, s);
+    }
+    for (delta_out[i..src.len], src[i..], prev[i..src.len]) |*d, s, *p| {
+        const small = @max(s, p.*) - @min(s, p.*) < threshold;
+        d.* = if (small) 0 else s -% p.*;
+        if (!small) p.* = s;
+    }
+}
+
+/// `quantizeUpdate` for little-endian RGB565 pixels. Each 5/6-bit channel is
+/// compared in 8-bit units so the error bound matches the byte formats; the
+/// delta itself is still bytewise, as the FPGA adds it.
+pub fn quantizeUpdate565(delta_out: []u8, src: []const u8, prev: []u8, threshold: u8) void {
+    const whole = src.len & ~@as(usize, 1);
+    var i: usize = 0;
+    while (i < whole) : (i += 2) {
+        const s = std.mem.readInt(u16, src[i..][0..2], .little);
+        const p = std.mem.readInt(u16, prev[i..][0..2], .little);
+        const target = quantizeChannel(s, p, 11, 5, threshold) |
+            quantizeChannel(s, p, 5, 6, threshold) |
+            quantizeChannel(s, p, 0, 5, threshold);
+        var bytes: [2]u8 = undefined;
+        std.mem.writeInt(u16, &bytes, target, .little);
+        delta_out[i] = bytes[0] -% prev[i];
+        delta_out[i + 1] = bytes[1] -% prev[i + 1];
+        prev[i..][0..2].* = bytes;
+    }
+    // A trailing half pixel is coded exactly
+    subtractUpdate(delta_out[whole..src.len], src[whole..], prev[whole..src.len]);
+}
+
+fn quantizeChannel(s: u16, p: u16, comptime shift: u4, comptime bits: u4, threshold: u8) u16 {
+    const mask = (@as(u16, 1) << bits) - 1;
+    const sc = s >> shift & mask;
+    const pc = p >> shift & mask;
+    const dist = (@max(sc, pc) - @min(sc, pc)) << (8 - bits);
+    return (if (dist < threshold) pc else sc) << shift;
+}
+
+/// Count a near-lossless frame for field `f` and report whether it is due to
+/// be coded exactly.
+fn exactRefreshDue(state: *DeltaState, f: usize) bool {
+    state.lossy_count[f] += 1;
+    if (state.exact_refresh_interval == 0 or state.lossy_count[f] < state.exact_refresh_interval) return false;
+    state.lossy_count[f] = 0;
+    state.stats.add(.exact_refreshes, 1);
+    return true;
+}
+
+/// Compress the keyframe and delta candidates concurrently on the worker
+/// pool and return the smaller one. `prev` already holds the delta's
+/// reconstruction; it only needs replacing when a near-lossless delta loses
+/// to the (exact) keyframe.
+fn dualCompress(state: *DeltaState, pool: *std.Thread.Pool, alt_buf: []u8, f: usize, src: []const u8, prev: []u8, exact: bool, delta_out: []const u8, dst: []u8, key: ?FrameCache.Digest) ?Connection.CompressResult {
+    const start = clock.nowNs();
+    var key_data: ?[]const u8 = null;
+    var delta_data: ?[]const u8 = null;
+    var wg: std.Thread.WaitGroup = .{};
+    pool.spawnWg(&wg, encodeCandidate, .{ src, alt_buf, &key_data });
+    pool.spawnWg(&wg, encodeCandidate, .{ delta_out, dst, &delta_data });
+    pool.waitAndWork(&wg);
+
+    if (state.dual_budget_ns > 0 and clock.nowNs() -| start > state.dual_budget_ns) {
+        state.dual_over_budget = true;
+    }
+
+    const d = delta_data orelse return null;
+    if (key_data) |k| if (k.len < d.len) {
+        if (!exact) @memcpy(prev, src);
+        state.frame_count[f] = 0;
+        state.lossy_count[f] = 0;
+        state.dual_over_budget = false;
+        state.stats.add(.keyframes, 1);
+        state.stats.add(.dual_keyframe_wins, 1);
+        if (state.cache) |cache| cache.put(key orelse FrameCache.digest(src), k);
+        return .{ .data = k, .is_delta = false };
+    };
+    state.stats.add(.delta_frames, 1);
+    return .{ .data = d, .is_delta = true };
+}
+
+fn encodeCandidate(src: []const u8, out: []u8, result: *?[]const u8) void {
+    result.* = if (lz4.compress(null, src, out, 0)) |r| r.data else null;
+}
+
+/// Decide whether the current frame for field `f` should be a keyframe.
+/// Only samples the frame when scene-cut detection or keyframe deferral
+/// actually needs the change estimate.
+fn keyframeDue(state: *DeltaState, f: usize, input: Input, prev: []const u8) bool {
+    if (state.force_keyframe[f].swap(false, .acq_rel)) {
+        state.stats.add(.forced_keyframes, 1);
+        return true;
+    }
+
+    const count = state.frame_count[f];
+    const interval = state.keyframe_interval;
+    const max_interval = @max(state.keyframe_max_interval, interval);
+    const due = interval > 0 and count >= interval;
+
+    if (state.scene_cut_ratio <= 0 and (!due or max_interval == interval)) return due;
+    if (due and count >= max_interval) return true;
+
+    // In near-lossless mode only changes the pass would code count: noise
+    // below the threshold would otherwise turn every frame into a scene cut
+    const ratio = input.ratioAgainst(prev, .{ .threshold = state.lossy_threshold, .rgb565 = state.rgb565 });
+    if (state.scene_cut_ratio > 0 and ratio >= state.scene_cut_ratio) {
+        state.stats.add(.scene_cuts, 1);
+        return true;
+    }
+    // Deferred periodic keyframe: spend it on a frame that is changing anyway
+    return due and ratio >= state.refresh_ratio;
+}
+
+/// Send the frame as a full (non-delta) frame and make it the field's
+/// reference. `key` is the frame's digest when already computed.
+fn keyframe(state: *DeltaState, f: usize, input: Input, dst: []u8, field: u8, key: ?FrameCache.Digest) ?Connection.CompressResult {
+    // Compressed from the reference, where a converted frame now lives
+    const frame = resetReference(state, f, input);
+    const result = lz4.compress(null, frame, dst, field) orelse return null;
+    state.stats.add(.keyframes, 1);
+    if (state.cache) |cache| cache.put(key orelse FrameCache.digest(frame), result.data);
+    return .{ .data = result.data, .is_delta = false };
+}
+
+/// A keyframe, resent from the cache when the screen was seen before. Only
+/// frames that are keyframes anyway are looked up, so the digest is never
+/// wasted: `keyframe` files the frame under it.
+fn cachedOrKeyframe(state: *DeltaState, f: usize, input: Input, dst: []u8, field: u8) ?Connection.CompressResult {
+    const cache = state.cache orelse return keyframe(state, f, input, dst, field, null);
+    const key = input.digest();
+    if (cache.get(key)) |cached| return cachedKeyframe(state, f, input, cached);
+    state.stats.add(.cache_misses, 1);
+    return keyframe(state, f, input, dst, field, key);
+}
+
+/// Send the cached keyframe `data`, which decodes to the frame.
+fn cachedKeyframe(state: *DeltaState, f: usize, input: Input, data: []const u8) Connection.CompressResult {
+    const src = resetReference(state, f, input);
+    // Serves any pending keyframe request too
+    if (state.force_keyframe[f].swap(false, .acq_rel)) state.stats.add(.forced_keyframes, 1);
+    state.stats.add(.keyframes, 1);
+    state.stats.add(.cache_hits, 1);
+    state.stats.add(.cache_bytes_saved, src.len);
+    return .{ .data = data, .is_delta = false };
+}
+
+/// Make the frame the field's reference and restart keyframe scheduling.
+/// Returns the reference.
+fn resetReference(state: *DeltaState, f: usize, input: Input) []const u8 {
+    state.frame_count[f] = 0;
+    state.lossy_count[f] = 0;
+    state.dual_over_budget = false;
+    const prev = state.prev_frames[f][0..input.len()];
+    input.copyTo(prev);
+    return prev;
+}
+
 // --- Tests ---
 
 test "first frame compresses without delta (passthrough to LZ4)" {
@@ -382,3 +998,484 @@ test "interlaced round-trip: field 0 deltas use field 0 reference, not field 1"
         }
     }
 }
+
+test "changeRatio of identical and fully different buffers" {
+    var a: [10_000]u8 = undefined;
+    for (&a, 0..) |*b, i| b.* = @truncate(i);
+    var b = a;
+    try std.testing.expectEqual(@as(f32, 0), changeRatio(&a, &b));
+    for (&b) |*x| x.* +%= 1;
+    try std.testing.expectEqual(@as(f32, 1), changeRatio(&a, &b));
+    try std.testing.expectEqual(@as(f32, 0), changeRatio(&.{}, &.{}));
+}
+
+test "changeRatio estimates partial change on a sparse grid" {
+    const a = [_]u8{0} ** 100_000;
+    var b = a;
+    // Change the second half of the frame
+    @memset(b[50_000..], 0xFF);
+    try std.testing.expectApproxEqAbs(@as(f32, 0.5), changeRatio(&a, &b), 0.01);
+}
+
+test "scene cut forces a keyframe between periodic keyframes" {
+    const frame_size = 256;
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 128]u8 = undefined;
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+        .keyframe_interval = 100,
+        .scene_cut_ratio = 0.5,
+    };
+    const comp = compressor(&state, &lz4_buf);
+
+    var frame = [_]u8{0x10} ** frame_size;
+    _ = comp.compress(&frame, 0);
+
+    // Small change: delta
+    frame[0] = 0x11;
+    const r1 = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(r1.is_delta);
+
+    // Whole frame changes: scene cut
+    @memset(&frame, 0x80);
+    const r2 = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(!r2.is_delta);
+    try std.testing.expectEqual(@as(u64, 1), state.stats.scene_cuts);
+    try std.testing.expectEqual(@as(u32, 0), state.frame_count[0]);
+}
+
+test "periodic keyframe deferred through static content until change or max interval" {
+    const frame_size = 256;
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 128]u8 = undefined;
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+        .keyframe_interval = 2,
+        .keyframe_max_interval = 6,
+        .refresh_ratio = 0.05,
+    };
+    const comp = compressor(&state, &lz4_buf);
+
+    var frame = [_]u8{0x10} ** frame_size;
+    _ = comp.compress(&frame, 0);
+
+    // Static frames 1-4: keyframe is due at 2 but deferred
+    for (0..4) |_| {
+        const r = comp.compress(&frame, 0) orelse return error.CompressFailed;
+        try std.testing.expect(r.is_delta);
+    }
+
+    // Frame 5: content changes enough, deferred keyframe fires
+    @memset(frame[0..64], 0x20);
+    const r5 = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(!r5.is_delta);
+
+    // Static again: keyframe still fires once the max interval is reached
+    for (1..6) |_| {
+        const r = comp.compress(&frame, 0) orelse return error.CompressFailed;
+        try std.testing.expect(r.is_delta);
+    }
+    const r_max = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(!r_max.is_delta);
+}
+
+test "dual-candidate encoding sends the keyframe when the delta is larger" {
+    const frame_size = 1024;
+    const lz4_import = @import("lz4");
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 256]u8 = undefined;
+    var alt_buf: [frame_size + 256]u8 = undefined;
+
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = std.testing.allocator, .n_jobs = 2 });
+    defer pool.deinit();
+
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+        .pool = &pool,
+        .alt_buf = &alt_buf,
+    };
+    const comp = compressor(&state, &lz4_buf);
+
+    // Frame 0: noise (keyframe)
+    var prng = std.Random.DefaultPrng.init(42);
+    var frame: [frame_size]u8 = undefined;
+    prng.random().bytes(&frame);
+    _ = comp.compress(&frame, 0);
+
+    // Frame 1: flat fill. The delta is the negated noise, the keyframe is tiny.
+    @memset(&frame, 0);
+    const r1 = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(!r1.is_delta);
+    try std.testing.expectEqual(@as(u64, 1), state.stats.dual_keyframe_wins);
+    var decoded: [frame_size]u8 = undefined;
+    const n = lz4_import.decompressSafe(r1.data, &decoded) catch return error.DecompressFailed;
+    try std.testing.expectEqualSlices(u8, &frame, decoded[0..n]);
+
+    // Frame 2: one byte changes on top of frame 1. The delta wins.
+    frame[7] = 0x55;
+    const r2 = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(r2.is_delta);
+    try std.testing.expectEqualSlices(u8, &frame, prev_buf[0..frame_size]);
+}
+
+test "frames larger than the reference buffers fail instead of overrunning" {
+    var prev_buf: [64]u8 = undefined;
+    var delta_buf: [64]u8 = undefined;
+    var lz4_buf: [256]u8 = undefined;
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &.{} },
+        .delta_buf = &delta_buf,
+    };
+    const comp = compressor(&state, &lz4_buf);
+    const frame = [_]u8{0} ** 65;
+    try std.testing.expect(comp.compress(&frame, 0) == null);
+    // Progressive mode: no field-1 reference allocated
+    try std.testing.expect(comp.compress(frame[0..64], 1) == null);
+    try std.testing.expect(comp.compress(frame[0..64], 0) != null);
+}
+
+test "owned frames become the reference by exchange" {
+    const frame_size = 256;
+    const lz4_import = @import("lz4");
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 128]u8 = undefined;
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+    };
+    const comp = compressor(&state, &lz4_buf);
+
+    var slot: [frame_size]u8 = undefined;
+    for (&slot, 0..) |*b, i| b.* = @truncate(i);
+    var owned: []u8 = &slot;
+    const result1 = comp.compressOwnedFn.?(comp.ctx, &owned, comp.buf, 0) orelse return error.CompressFailed;
+    try std.testing.expect(!result1.is_delta);
+    try std.testing.expectEqual(@as([*]u8, &slot), state.prev_frames[0].ptr);
+    try std.testing.expectEqual(@as([*]u8, &prev_buf), owned.ptr);
+
+    // Second frame rendered into the returned buffer
+    for (owned, 0..) |*b, i| b.* = @truncate(i * 3);
+    var frame2: [frame_size]u8 = undefined;
+    @memcpy(&frame2, owned);
+    const result2 = comp.compressOwnedFn.?(comp.ctx, &owned, comp.buf, 0) orelse return error.CompressFailed;
+    try std.testing.expect(result2.is_delta);
+    try std.testing.expectEqual(@as([*]u8, &prev_buf), state.prev_frames[0].ptr);
+    try std.testing.expectEqual(@as([*]u8, &slot), owned.ptr);
+
+    // The old reference is untouched by the delta pass: reconstruct against it
+    var decoded: [frame_size]u8 = undefined;
+    const n = lz4_import.decompressSafe(result2.data, &decoded) catch return error.DecompressFailed;
+    for (decoded[0..n], slot) |*d, p| d.* +%= p;
+    try std.testing.expectEqualSlices(u8, &frame2, decoded[0..n]);
+}
+
+test "subtractBands matches the serial pass across band boundaries" {
+    const size = min_band_bytes * 3 + 4097;
+    const alloc = std.testing.allocator;
+    const src = try alloc.alloc(u8, size);
+    defer alloc.free(src);
+    const prev_a = try alloc.alloc(u8, size);
+    defer alloc.free(prev_a);
+    const prev_b = try alloc.alloc(u8, size);
+    defer alloc.free(prev_b);
+    const out_a = try alloc.alloc(u8, size);
+    defer alloc.free(out_a);
+    const out_b = try alloc.alloc(u8, size);
+    defer alloc.free(out_b);
+
+    var prng = std.Random.DefaultPrng.init(55);
+    prng.random().bytes(src);
+    prng.random().bytes(prev_a);
+    @memcpy(prev_b, prev_a);
+
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = alloc, .n_jobs = 3 });
+    defer pool.deinit();
+
+    subtractUpdate(out_a, src, prev_a);
+    subtractBands(&pool, 4, kernels.generic, out_b, src, prev_b);
+    try std.testing.expectEqualSlices(u8, out_a, out_b);
+    try std.testing.expectEqualSlices(u8, src, prev_b);
+}
+
+test "subtractBands splits specialised kernels on row boundaries" {
+    const kernel = kernels.select(640, 480, .bgr888);
+    const size = kernel.frame_bytes;
+    const alloc = std.testing.allocator;
+    const src = try alloc.alloc(u8, size);
+    defer alloc.free(src);
+    const prev_a = try alloc.alloc(u8, size);
+    defer alloc.free(prev_a);
+    const prev_b = try alloc.alloc(u8, size);
+    defer alloc.free(prev_b);
+    const out_a = try alloc.alloc(u8, size);
+    defer alloc.free(out_a);
+    const out_b = try alloc.alloc(u8, size);
+    defer alloc.free(out_b);
+
+    var prng = std.Random.DefaultPrng.init(5656);
+    prng.random().bytes(src);
+    prng.random().bytes(prev_a);
+    @memcpy(prev_b, prev_a);
+
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = alloc, .n_jobs = 2 });
+    defer pool.deinit();
+
+    subtractUpdate(out_a, src, prev_a);
+    subtractBands(&pool, 3, kernel, out_b, src, prev_b);
+    try std.testing.expectEqualSlices(u8, out_a, out_b);
+    try std.testing.expectEqualSlices(u8, prev_a, prev_b);
+}
+
+test "subtractSource bands specialised kernels on row boundaries" {
+    const kernel = kernels.select(640, 480, .bgr888);
+    const size = kernel.frame_bytes;
+    const alloc = std.testing.allocator;
+    // RGBA input, converted to bgr888 on read
+    const data = try alloc.alloc(u8, 640 * 480 * 4);
+    defer alloc.free(data);
+    const converted = try alloc.alloc(u8, size);
+    defer alloc.free(converted);
+    const prev_a = try alloc.alloc(u8, size);
+    defer alloc.free(prev_a);
+    const prev_b = try alloc.alloc(u8, size);
+    defer alloc.free(prev_b);
+    const out_a = try alloc.alloc(u8, size);
+    defer alloc.free(out_a);
+    const out_b = try alloc.alloc(u8, size);
+    defer alloc.free(out_b);
+
+    var prng = std.Random.DefaultPrng.init(6262);
+    prng.random().bytes(data);
+    prng.random().bytes(prev_a);
+    @memcpy(prev_b, prev_a);
+    const source = ingest.Source.init(data, .rgba8888, 640, .bgr888).?;
+    source.read(0, converted);
+
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{ .allocator = alloc, .n_jobs = 2 });
+    defer pool.deinit();
+
+    subtractUpdate(out_a, converted, prev_a);
+    subtractSource(&pool, 3, kernel, &source, out_b, prev_b);
+    try std.testing.expectEqualSlices(u8, out_a, out_b);
+    try std.testing.expectEqualSlices(u8, prev_a, prev_b);
+}
+
+test "band lengths are whole rows of any width" {
+    // 640x480 bgr888 rows are 1920 bytes: not a power of two
+    const len = bandLength(1920 * 480, 3, 1920);
+    try std.testing.expectEqual(@as(usize, 0), len % 1920);
+    try std.testing.expectEqual(@as(usize, 1920 * 160), len);
+    // 241 rows of 960 bytes in 3 bands: round up to 81 rows, not 80.33
+    try std.testing.expectEqual(@as(usize, 960 * 81), bandLength(960 * 241, 3, 960));
+    try std.testing.expectEqual(@as(usize, 128), bandLength(100, 1, 64));
+}
+
+test "requestKeyframe forces a keyframe on the requested field only" {
+    const frame_size = 64;
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 128]u8 = undefined;
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+    };
+    const comp = compressor(&state, &lz4_buf);
+    const frame = [_]u8{0x42} ** frame_size;
+    _ = comp.compress(&frame, 0);
+    _ = comp.compress(&frame, 1);
+
+    comp.requestKeyframe(1);
+    const r0 = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(r0.is_delta);
+    const r1 = comp.compress(&frame, 1) orelse return error.CompressFailed;
+    try std.testing.expect(!r1.is_delta);
+    try std.testing.expectEqual(@as(u64, 1), state.stats.forced_keyframes);
+
+    // One-shot: the following frame is a delta again
+    const r2 = comp.compress(&frame, 1) orelse return error.CompressFailed;
+    try std.testing.expect(r2.is_delta);
+}
+
+test "near-lossless deltas keep the reference equal to the FPGA reconstruction" {
+    const frame_size = 3000;
+    const lz4_import = @import("lz4");
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 256]u8 = undefined;
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+        .lossy_threshold = 4,
+    };
+    const comp = compressor(&state, &lz4_buf);
+
+    // A slow ramp plus sensor noise of +-3, wrapping through 0xFF/0x00
+    var prng = std.Random.DefaultPrng.init(60);
+    var fpga_prev: [frame_size]u8 = undefined;
+    var frame: [frame_size]u8 = undefined;
+    for (0..40) |n| {
+        for (&frame, 0..) |*b, i| {
+            const noise = prng.random().intRangeAtMost(i16, -3, 3);
+            b.* = @truncate(@as(u16, @bitCast(@as(i16, @intCast((i + n * 7) % 256)) + noise)));
+        }
+        const r = comp.compress(&frame, 0) orelse return error.CompressFailed;
+        var decoded: [frame_size]u8 = undefined;
+        const len = lz4_import.decompressSafe(r.data, &decoded) catch return error.DecompressFailed;
+        if (r.is_delta) {
+            for (fpga_prev[0..len], decoded[0..len]) |*p, d| p.* +%= d;
+        } else {
+            @memcpy(fpga_prev[0..len], decoded[0..len]);
+        }
+        try std.testing.expectEqualSlices(u8, &fpga_prev, &prev_buf);
+        // Error stays bounded by the threshold, frame after frame
+        for (frame, fpga_prev) |s, p| try std.testing.expect(@max(s, p) - @min(s, p) < 4);
+    }
+    try std.testing.expectEqual(@as(u64, 39), state.stats.near_lossless_frames);
+}
+
+test "near-lossless zeroes noise below the threshold and codes larger changes exactly" {
+    var delta_out: [70]u8 = undefined;
+    var src: [70]u8 = undefined;
+    var prev: [70]u8 = undefined;
+    for (&src, &prev, 0..) |*s, *p, i| {
+        p.* = @truncate(i * 3);
+        // Even bytes: +2 (noise), odd bytes: +40 (real change); 0xFF -> 0x01 is a real change too
+        s.* = p.* +% @as(u8, if (i % 2 == 0) 2 else 40);
+    }
+    prev[0] = 0xFF;
+    src[0] = 0x01;
+    const expected = src;
+    quantizeUpdate(&delta_out, &src, &prev, 3);
+    try std.testing.expectEqual(@as(u8, 2), delta_out[0]);
+    for (delta_out[1..], expected[1..], prev[1..], 1..) |d, s, p, i| {
+        if (i % 2 == 0) {
+            try std.testing.expectEqual(@as(u8, 0), d);
+            try std.testing.expectEqual(s -% 2, p);
+        } else {
+            try std.testing.expectEqual(@as(u8, 40), d);
+            try std.testing.expectEqual(s, p);
+        }
+    }
+}
+
+test "near-lossless RGB565 thresholds each channel" {
+    // r 10 -> 11 (8 units: kept), g 20 -> 30 (40 units: coded), b 5 -> 5
+    const p: u16 = 10 << 11 | 20 << 5 | 5;
+    const s: u16 = 11 << 11 | 30 << 5 | 5;
+    var prev: [3]u8 = undefined;
+    var src: [3]u8 = undefined;
+    std.mem.writeInt(u16, prev[0..2], p, .little);
+    std.mem.writeInt(u16, src[0..2], s, .little);
+    prev[2] = 1;
+    src[2] = 2;
+    const before = prev;
+    var delta_out: [3]u8 = undefined;
+    quantizeUpdate565(&delta_out, &src, &prev, 12);
+
+    const target: u16 = 10 << 11 | 30 << 5 | 5;
+    try std.testing.expectEqual(target, std.mem.readInt(u16, prev[0..2], .little));
+    for (delta_out, before, prev) |d, b, a| try std.testing.expectEqual(a, b +% d);
+    // The half pixel at the end is exact
+    try std.testing.expectEqual(@as(u8, 2), prev[2]);
+}
+
+test "exact refresh interval codes every Nth near-lossless frame exactly" {
+    const frame_size = 64;
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 128]u8 = undefined;
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+        .lossy_threshold = 8,
+        .exact_refresh_interval = 3,
+    };
+    const comp = compressor(&state, &lz4_buf);
+    var frame = [_]u8{0x40} ** frame_size;
+    _ = comp.compress(&frame, 0);
+
+    frame[5] = 0x42;
+    _ = comp.compress(&frame, 0);
+    _ = comp.compress(&frame, 0);
+    try std.testing.expectEqual(@as(u8, 0x40), prev_buf[5]);
+    // Third delta frame is the exact refresh
+    const r = comp.compress(&frame, 0) orelse return error.CompressFailed;
+    try std.testing.expect(r.is_delta);
+    try std.testing.expectEqual(@as(u8, 0x42), prev_buf[5]);
+    try std.testing.expectEqual(@as(u64, 2), state.stats.near_lossless_frames);
+    try std.testing.expectEqual(@as(u64, 1), state.stats.exact_refreshes);
+}
+
+test "recurring screens are served from the keyframe cache" {
+    const frame_size = 512;
+    const lz4_import = @import("lz4");
+    var prev_buf: [frame_size]u8 = undefined;
+    var prev_buf1: [frame_size]u8 = undefined;
+    var delta_buf: [frame_size]u8 = undefined;
+    var lz4_buf: [frame_size + 128]u8 = undefined;
+    var cache = FrameCache.init(std.testing.allocator, 64 * 1024);
+    defer cache.deinit();
+    var state = DeltaState{
+        .prev_frames = .{ &prev_buf, &prev_buf1 },
+        .delta_buf = &delta_buf,
+        .scene_cut_ratio = 0.5,
+        .cache = &cache,
+    };
+    const comp = compressor(&state, &lz4_buf);
+
+    var menu: [frame_size]u8 = undefined;
+    for (&menu, 0..) |*b, i| b.* = @truncate(i * 7);
+    const game = [_]u8{0x30} ** frame_size;
+
+    // First appearances are compressed: first frame, then a scene cut
+    _ = comp.compress(&menu, 0);
+    _ = comp.compress(&game, 0);
+    try std.testing.expectEqual(@as(usize, 2), cache.count());
+    try std.testing.expectEqual(@as(u64, 0), state.stats.cache_hits);
+
+    // The menu comes back: cached keyframe, reference reset to it
+    const r = comp.compress(&menu, 0) orelse return error.CompressFailed;
+    try std.testing.expect(!r.is_delta);
+    try std.testing.expectEqual(@as(u64, 1), state.stats.cache_hits);
+    try std.testing.expectEqual(@as(u64, frame_size), state.stats.cache_bytes_saved);
+    try std.testing.expectEqualSlices(u8, &menu, &prev_buf);
+    var decoded: [frame_size]u8 = undefined;
+    const n = lz4_import.decompressSafe(r.data, &decoded) catch return error.DecompressFailed;
+    try std.testing.expectEqualSlices(u8, &menu, decoded[0..n]);
+
+    // Static frames stay deltas and are not looked up
+    const still = comp.compress(&menu, 0) orelse return error.CompressFailed;
+    try std.testing.expect(still.is_delta);
+    try std.testing.expectEqual(@as(u64, 1), state.stats.cache_hits);
+
+    // Neither is motion short of a scene cut: no hash, no miss
+    var moving = menu;
+    for (moving[0 .. frame_size * 35 / 100]) |*b| b.* +%= 1;
+    const motion = comp.compress(&moving, 0) orelse return error.CompressFailed;
+    try std.testing.expect(motion.is_delta);
+    try std.testing.expectEqual(@as(u64, 2), state.stats.cache_misses);
+
+    // A keyframe request served from the cache still counts as forced
+    requestKeyframe(&state, 0);
+    _ = comp.compress(&menu, 0);
+    try std.testing.expectEqual(@as(u64, 2), state.stats.cache_hits);
+    try std.testing.expectEqual(@as(u64, 1), state.stats.forced_keyframes);
+}
@@ -0,0 +1,701 @@
+//! Frame ingest: reads host framebuffers in their own pixel format and
+//! produces the session's wire format (`protocol.RgbMode`) on the fly.
+//!
+//! A `Source` describes a submitted frame. Consumers pull converted bytes
+//! from it in whatever pieces they work in (a datagram, a delta row, a
+//! pipeline slot), so the converted frame never has to exist as a separate
+//! copy. Conversions between byte formats are vector shuffles; packing to
+//! RGB565 is vectorised too, optionally with ordered dithering. A source
+//! can also be scaled to the output size on the same read. The vector
+//! kernels are dispatched through `isa`, so x86_64 hosts run their AVX2 or
+//! AVX-512 builds.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const protocol = @import("protocol.zig");
+const isa = @import("isa.zig");
+
+/// Host pixel formats, named by byte order in memory. The first three match
+/// `protocol.RgbMode` and need no conversion when they equal the session's
+/// mode. Little-endian XRGB8888 framebuffers (DRM, Windows) are `bgra8888`.
+pub const PixelFormat = enum(u8) {
+    bgr888 = 0,
+    bgra8888 = 1,
+    /// Little-endian 5:6:5 words.
+    rgb565 = 2,
+    rgb888 = 3,
+    rgba8888 = 4,
+    argb8888 = 5,
+    abgr8888 = 6,
+
+    pub fn bytesPerPixel(self: PixelFormat) usize {
+        return switch (self) {
+            .rgb565 => 2,
+            .bgr888, .rgb888 => 3,
+            .bgra8888, .rgba8888, .argb8888, .abgr8888 => 4,
+        };
+    }
+
+    /// The wire format with the same layout.
+    pub fn fromRgbMode(mode: protocol.RgbMode) PixelFormat {
+        return @enumFromInt(@intFromEnum(mode));
+    }
+
+    /// Channel at each byte, for the 8-bit-per-channel formats.
+    fn layout(comptime self: PixelFormat) []const Channel {
+        return switch (self) {
+            .bgr888 => &.{ .b, .g, .r },
+            .bgra8888 => &.{ .b, .g, .r, .a },
+            .rgb888 => &.{ .r, .g, .b },
+            .rgba8888 => &.{ .r, .g, .b, .a },
+            .argb8888 => &.{ .a, .r, .g, .b },
+            .abgr8888 => &.{ .a, .b, .g, .r },
+            .rgb565 => unreachable,
+        };
+    }
+};
+
+const Channel = enum { r, g, b, a };
+
+/// Scaling filters from the source size to the output size.
+pub const Filter = enum(u8) {
+    /// Stretch to fill, nearest source pixel.
+    nearest = 1,
+    /// Largest whole-number magnification that fits (or the smallest
+    /// whole-number reduction), centred on black.
+    integer = 2,
+    /// Stretch to fill, averaging the source pixels under each output pixel.
+    box = 3,
+};
+
+/// Output size of a scaled source.
+pub const Scale = struct {
+    width: usize,
+    height: usize,
+    filter: Filter,
+};
+
+/// A submitted frame: `width` x `height` pixels of `format`, rows `pitch`
+/// bytes apart, to be sent as `target`.
+pub const Source = struct {
+    /// From the first pixel of the first row to the end of the last row.
+    data: []const u8,
+    format: PixelFormat,
+    width: usize,
+    height: usize,
+    /// Bytes from one row's start to the next; larger than the row for
+    /// padded framebuffers and crops.
+    pitch: usize,
+    target: protocol.RgbMode,
+    /// Ordered-dither 8-bit channels when the target is RGB565.
+    dither: bool = false,
+    /// Scale to this size on read; null sends `width` x `height` as is.
+    scale: ?Scale = null,
+
+    /// Source over `data`, split into rows of `width` pixels (0 = one row).
+    /// Null when `data` is not a whole number of rows.
+    pub fn init(data: []const u8, format: PixelFormat, width: usize, target: protocol.RgbMode) ?Source {
+        const bpp = format.bytesPerPixel();
+        if (data.len % bpp != 0) return null;
+        const pixels = data.len / bpp;
+        const w = if (width == 0) pixels else width;
+        if (w == 0 or pixels % w != 0) return null;
+        return .{ .data = data, .format = format, .width = w, .height = pixels / w, .pitch = w * bpp, .target = target };
+    }
+
+    /// Source over the `w` x `h` rectangle at column `x`, row `y` of a
+    /// framebuffer at `base` whose rows are `pitch` bytes apart. Nothing is
+    /// copied. Null for an empty rectangle or one that overruns its row.
+    pub fn initStrided(base: [*]const u8, pitch: usize, x: usize, y: usize, w: usize, h: usize, format: PixelFormat, target: protocol.RgbMode) ?Source {
+        const bpp = format.bytesPerPixel();
+        if (w == 0 or h == 0 or (x + w) * bpp > pitch) return null;
+        const len = (h - 1) * pitch + w * bpp;
+        return .{
+            .data = base[y * pitch + x * bpp ..][0..len],
+            .format = format,
+            .width = w,
+            .height = h,
+            .pitch = pitch,
+            .target = target,
+        };
+    }
+
+    /// Width of the frame as sent.
+    pub fn outWidth(self: *const Source) usize {
+        return if (self.scale) |s| s.width else self.width;
+    }
+
+    /// Height of the frame as sent.
+    pub fn outHeight(self: *const Source) usize {
+        return if (self.scale) |s| s.height else self.height;
+    }
+
+    /// Bytes of one converted row.
+    pub fn rowBytes(self: *const Source) usize {
+        return self.outWidth() * self.target.bytesPerPixel();
+    }
+
+    /// Bytes of the converted frame.
+    pub fn frameBytes(self: *const Source) usize {
+        return self.rowBytes() * self.outHeight();
+    }
+
+    /// Whether rows are sent as they are, without conversion or scaling.
+    pub fn passthrough(self: *const Source) bool {
+        return self.format == PixelFormat.fromRgbMode(self.target) and self.scale == null;
+    }
+
+    /// The frame itself when it is already in the target format and its
+    /// rows are packed without gaps.
+    pub fn contiguous(self: *const Source) ?[]const u8 {
+        if (!self.passthrough() or self.pitch != self.rowBytes()) return null;
+        return self.data[0..self.frameBytes()];
+    }
+
+    /// Row `y` as stored, in the source format.
+    pub fn row(self: *const Source, y: usize) []const u8 {
+        return self.data[y * self.pitch ..][0 .. self.width * self.format.bytesPerPixel()];
+    }
+
+    /// Convert `n` pixels of output row `y` starting at column `x` into `out`.
+    pub fn convertSpan(self: *const Source, x: usize, y: usize, n: usize, out: []u8) void {
+        if (self.scale == null) {
+            const in_bpp = self.format.bytesPerPixel();
+            self.emit(self.format, self.row(y)[x * in_bpp ..][0 .. n * in_bpp], out, x, y);
+            return;
+        }
+        const s = self.scale.?;
+        const out_bpp = self.target.bytesPerPixel();
+        // Keep a box chunk's source span within `box_span`
+        const chunk = if (s.filter == .box) @max(1, @min(scale_chunk, (box_span - 2) * s.width / self.width)) else scale_chunk;
+        var done: usize = 0;
+        while (done < n) {
+            const c = @min(n - done, chunk);
+            const dst = out[done * out_bpp ..][0 .. c * out_bpp];
+            if (s.filter == .box) {
+                self.boxChunk(x + done, y, c, dst);
+            } else {
+                self.sampleChunk(x + done, y, c, dst);
+            }
+            done += c;
+        }
+    }
+
+    /// Convert pixels of `from` at output position (`x`, `y`) to the target.
+    fn emit(self: *const Source, from: PixelFormat, src: []const u8, out: []u8, x: usize, y: usize) void {
+        const dst = out[0 .. src.len / from.bytesPerPixel() * self.target.bytesPerPixel()];
+        if (self.dither and self.target == .rgb565) {
+            convertDithered565(from, src, dst, x, y);
+        } else {
+            convert(from, self.target, src, dst);
+        }
+    }
+
+    /// Where the scaled image lands in the output: all of it, except for
+    /// `integer`, which keeps a whole-number ratio and centres the image.
+    fn region(self: *const Source) Region {
+        const s = self.scale.?;
+        if (s.filter != .integer) return .{ .x = 0, .y = 0, .w = s.width, .h = s.height };
+        const up = @min(s.width / self.width, s.height / self.height);
+        var w = self.width * up;
+        var h = self.height * up;
+        if (up == 0) {
+            const down = @max(std.math.divCeil(usize, self.width, s.width) catch unreachable, std.math.divCeil(usize, self.height, s.height) catch unreachable);
+            w = @max(1, self.width / down);
+            h = @max(1, self.height / down);
+        }
+        return .{ .x = (s.width - w) / 2, .y = (s.height - h) / 2, .w = w, .h = h };
+    }
+
+    /// `nearest` and `integer`: gather one source pixel per output pixel
+    /// (black outside the image), then convert the chunk in one pass.
+    fn sampleChunk(self: *const Source, x: usize, y: usize, n: usize, out: []u8) void {
+        const in_bpp = self.format.bytesPerPixel();
+        const r = self.region();
+        var tmp: [scale_chunk * 4]u8 align(64) = undefined;
+        var i: usize = 0;
+        if (y >= r.y and y < r.y + r.h) {
+            const src_row = self.row((y - r.y) * self.height / r.h);
+            i = @min(n, r.x -| x);
+            @memset(tmp[0 .. i * in_bpp], 0);
+            const end = @min(n, (r.x + r.w) -| x);
+            if (i < end) {
+                var walk = Walk.init(x + i - r.x, self.width, r.w);
+                switch (in_bpp) {
+                    inline 2, 3, 4 => |bpp| while (i < end) : (i += 1) {
+                        tmp[i * bpp ..][0..bpp].* = src_row[walk.q * bpp ..][0..bpp].*;
+                        walk.next();
+                    },
+                    else => unreachable,
+                }
+            }
+        }
+        @memset(tmp[i * in_bpp .. n * in_bpp], 0);
+        self.emit(self.format, tmp[0 .. n * in_bpp], out, x, y);
+    }
+
+    /// `box`: average the source pixels each output pixel covers. Source
+    /// rows are converted to BGRA a span at a time and summed per pixel in
+    /// four-lane vectors.
+    fn boxChunk(self: *const Source, x: usize, y: usize, n: usize, out: []u8) void {
+        const s = self.scale.?;
+        const in_bpp = self.format.bytesPerPixel();
+        const set = isa.kernelSet(isa.active());
+
+        // Column bounds of every output pixel, and the source span they cover
+        var lo: [scale_chunk + 1]usize = undefined;
+        var walk = Walk.init(x, self.width, s.width);
+        for (&lo) |*b| {
+            b.* = walk.q;
+            walk.next();
+        }
+        const first = lo[0];
+        const last = @min(self.width, @max(lo[n], lo[n - 1] + 1), first + box_span);
+        const y0 = y * self.height / s.height;
+        const y1 = @max(y0 + 1, (y + 1) * self.height / s.height);
+
+        var sums = [_]BoxSum{@splat(0)} ** scale_chunk;
+        var line: [box_span * 4]u8 align(64) = undefined;
+        for (y0..y1) |sy| {
+            const src = self.row(sy)[first * in_bpp .. last * in_bpp];
+            set.converter(self.format, .bgra8888)(src.ptr, &line, last - first);
+            set.box_sum(&sums, &line, &lo, n, first, last);
+        }
+
+        var tmp: [scale_chunk * 4]u8 align(64) = undefined;
+        for (sums[0..n], 0..) |sum, i| {
+            const cols = @min(last, @max(lo[i + 1], lo[i] + 1)) - lo[i];
+            const count: u32 = @intCast(cols * (y1 - y0));
+            const avg = (sum + @as(BoxSum, @splat(count / 2))) / @as(BoxSum, @splat(count));
+            tmp[i * 4 ..][0..4].* = @as(@Vector(4, u8), @intCast(avg));
+        }
+        self.emit(.bgra8888, tmp[0 .. n * 4], out, x, y);
+    }
+
+    /// Fill `out` with the converted frame's bytes starting at `offset`.
+    /// Pieces may start and end mid-pixel.
+    pub fn read(self: *const Source, offset: usize, out: []u8) void {
+        const bpp = self.target.bytesPerPixel();
+        const width = self.outWidth();
+        var pos = offset;
+        var o: usize = 0;
+        while (o < out.len) {
+            const px = pos / bpp;
+            const intra = pos % bpp;
+            const x = px % width;
+            const y = px / width;
+            if (intra != 0 or out.len - o < bpp) {
+                // Partial pixel at either end of the piece
+                var tmp: [4]u8 = undefined;
+                self.convertSpan(x, y, 1, &tmp);
+                const n = @min(bpp - intra, out.len - o);
+                @memcpy(out[o..][0..n], tmp[intra..][0..n]);
+                o += n;
+                pos += n;
+                continue;
+            }
+            const n_px = @min(width - x, (out.len - o) / bpp);
+            self.convertSpan(x, y, n_px, out[o..][0 .. n_px * bpp]);
+            o += n_px * bpp;
+            pos += n_px * bpp;
+        }
+    }
+
+    /// One byte of the converted frame, for sparse sampling.
+    pub fn byteAt(self: *const Source, i: usize) u8 {
+        var b: [1]u8 = undefined;
+        self.read(i, &b);
+        return b[0];
+    }
+};
+
+/// Per-channel sum of the BGRA pixels under one box-filter output pixel.
+pub const BoxSum = @Vector(4, u32);
+
+/// Add the pixels of `line`, a BGRA span starting at source column `first`
+/// and ending before `last`, to the sums of the output pixels whose columns
+/// start at `lo` (one more bound than `sums`). Every output pixel covers at
+/// least one column.
+pub fn boxAccumulate(sums: []BoxSum, line: []const u8, lo: []const usize, first: usize, last: usize) void {
+    for (sums, 0..) |*sum, i| {
+        const hi = @min(last, @max(lo[i + 1], lo[i] + 1));
+        for (lo[i]..hi) |sx| {
+            const px: @Vector(4, u8) = line[(sx - first) * 4 ..][0..4].*;
+            sum.* += @as(BoxSum, @intCast(px));
+        }
+    }
+}
+
+/// Output pixels scaled per step; bounds the stack scratch of a scaled read.
+const scale_chunk = 64;
+
+/// Source pixels a `box` chunk may span: enough for a 16x reduction.
+const box_span = scale_chunk * 16;
+
+const Region = struct { x: usize, y: usize, w: usize, h: usize };
+
+/// Walks `pos * num / den` over consecutive `pos` without dividing per step.
+const Walk = struct {
+    q: usize,
+    r: usize,
+    step_q: usize,
+    step_r: usize,
+    den: usize,
+
+    fn init(pos: usize, num: usize, den: usize) Walk {
+        const p = pos * num;
+        return .{ .q = p / den, .r = p % den, .step_q = num / den, .step_r = num % den, .den = den };
+    }
+
+    fn next(self: *Walk) void {
+        self.q += self.step_q;
+        self.r += self.step_r;
+        if (self.r >= self.den) {
+            self.r -= self.den;
+            self.q += 1;
+        }
+    }
+};
+
+/// Convert `src` pixels of `from` into `dst` as `to`. Lengths must match
+/// the same pixel count. Runs the active ISA variant's kernel.
+pub fn convert(from: PixelFormat, to: protocol.RgbMode, src: []const u8, dst: []u8) void {
+    const n = src.len / from.bytesPerPixel();
+    std.debug.assert(dst.len == n * to.bytesPerPixel());
+    isa.kernelSet(isa.active()).converter(from, to)(src.ptr, dst.ptr, n);
+}
+
+/// 4x4 Bayer matrix: thresholds 0..15 spread evenly over every 2x2 and 4x4 tile.
+const bayer4 = [4][4]u8{
+    .{ 0, 8, 2, 10 },
+    .{ 12, 4, 14, 6 },
+    .{ 3, 11, 1, 9 },
+    .{ 15, 7, 13, 5 },
+};
+
+/// Convert `src` pixels of `from` into RGB565 with 4x4 ordered dithering.
+/// The pixels are row `y` of the frame from column `x`. The pattern depends
+/// only on screen position, so static content dithers identically every
+/// frame and its deltas stay zero.
+pub fn convertDithered565(from: PixelFormat, src: []const u8, dst: []u8, x: usize, y: usize) void {
+    const n = src.len / from.bytesPerPixel();
+    std.debug.assert(dst.len == n * 2);
+    isa.kernelSet(isa.active()).ditherer(from)(src.ptr, dst.ptr, n, x, y);
+}
+
+/// Conversion between one pair of formats, specialised at comptime. The
+/// `kernels.KernelSet` of each ISA variant holds an instance of every pair.
+pub fn Converter(comptime from: PixelFormat, comptime to: protocol.RgbMode) type {
+    return struct {
+        const in_bpp = from.bytesPerPixel();
+        const out_bpp = to.bytesPerPixel();
+        /// Pixels per vector step: 16 pixels of at most 4 bytes fill a
+        /// 64-byte register on AVX-512 and split cleanly on narrower ones.
+        const block = 16;
+        const vectorised = from != .rgb565 and PixelFormat.fromRgbMode(to) != from;
+
+        pub fn run(src: [*]const u8, dst: [*]u8, n: usize) void {
+            if (comptime PixelFormat.fromRgbMode(to) == from) {
+                @memcpy(dst[0 .. n * out_bpp], src[0 .. n * in_bpp]);
+            } else {
+                var i: usize = 0;
+                if (vectorised) {
+                    while (i + block <= n) : (i += block) {
+                        const v: @Vector(block * in_bpp, u8) = src[i * in_bpp ..][0 .. block * in_bpp].*;
+                        dst[i * out_bpp ..][0 .. block * out_bpp].* = convertBlock(v);
+                    }
+                }
+                while (i < n) : (i += 1) {
+                    pack(unpack(src[i * in_bpp ..][0..in_bpp]), dst[i * out_bpp ..][0..out_bpp]);
+                }
+            }
+        }
+
+        /// `run` into RGB565 with the `bayer4` pattern for row `y`, column `x`.
+        pub fn runDithered(src: [*]const u8, dst: [*]u8, n: usize, x: usize, y: usize) void {
+            const row = bayer4[y % 4];
+            var i: usize = 0;
+            // The pattern repeats every 4 pixels, so one vector serves every block
+            var pattern: [block]u8 = undefined;
+            for (&pattern, 0..) |*t, p| t.* = row[(x + p) % 4];
+            while (i + block <= n) : (i += block) {
+                const v: @Vector(block * in_bpp, u8) = src[i * in_bpp ..][0 .. block * in_bpp].*;
+                dst[i * 2 ..][0 .. block * 2].* = pack565Block(v, pattern);
+            }
+            while (i < n) : (i += 1) {
+                const rgba = unpack(src[i * in_bpp ..][0..in_bpp]);
+                const t = row[(x + i) % 4];
+                pack(.{ rgba[0] +| t >> 1, rgba[1] +| t >> 2, rgba[2] +| t >> 1, rgba[3] }, dst[i * 2 ..][0..2]);
+            }
+        }
+
+        fn convertBlock(v: @Vector(block * in_bpp, u8)) @Vector(block * out_bpp, u8) {
+            if (to != .rgb565) {
+                // Missing alpha selects from this one-lane vector
+                const opaque_alpha: @Vector(1, u8) = .{0xFF};
+                return @shuffle(u8, v, opaque_alpha, comptime shuffleMask());
+            } else {
+                return pack565Block(v, @splat(0));
+            }
+        }
+
+        /// RGB565 words for one block. Each channel is first raised by its
+        /// share of `threshold` (0..15, a fraction of one output step), so
+        /// truncation rounds up for that fraction of pixels on average.
+        fn pack565Block(v: @Vector(block * in_bpp, u8), threshold: @Vector(block, u8)) @Vector(block * 2, u8) {
+            const W = @Vector(block, u16);
+            const Shift = @Vector(block, u4);
+            const Shift8 = @Vector(block, u3);
+            const t5 = threshold >> @as(Shift8, @splat(1));
+            const t6 = threshold >> @as(Shift8, @splat(2));
+            const r: W = @intCast(@shuffle(u8, v, undefined, comptime channelMask(.r)) +| t5);
+            const g: W = @intCast(@shuffle(u8, v, undefined, comptime channelMask(.g)) +| t6);
+            const b: W = @intCast(@shuffle(u8, v, undefined, comptime channelMask(.b)) +| t5);
+            const words = (r >> @as(Shift, @splat(3))) << @as(Shift, @splat(11)) |
+                (g >> @as(Shift, @splat(2))) << @as(Shift, @splat(5)) |
+                b >> @as(Shift, @splat(3));
+            const le = if (builtin.cpu.arch.endian() == .big) @byteSwap(words) else words;
+            return @bitCast(le);
+        }
+
+        fn shuffleMask() @Vector(block * out_bpp, i32) {
+            const out_layout = PixelFormat.fromRgbMode(to).layout();
+            var mask: [block * out_bpp]i32 = undefined;
+            for (0..block) |p| {
+                for (out_layout, 0..) |ch, k| {
+                    mask[p * out_bpp + k] = if (indexOf(ch)) |j| @intCast(p * in_bpp + j) else ~@as(i32, 0);
+                }
+            }
+            return mask;
+        }
+
+        fn channelMask(comptime ch: Channel) @Vector(block, i32) {
+            var mask: [block]i32 = undefined;
+            for (0..block) |p| mask[p] = @intCast(p * in_bpp + indexOf(ch).?);
+            return mask;
+        }
+
+        fn indexOf(comptime ch: Channel) ?usize {
+            for (from.layout(), 0..) |c, j| if (c == ch) return j;
+            return null;
+        }
+
+        fn unpack(px: *const [in_bpp]u8) [4]u8 {
+            if (from == .rgb565) {
+                const w = std.mem.readInt(u16, px, .little);
+                const r: u8 = @intCast(w >> 11);
+                const g: u8 = @intCast(w >> 5 & 0x3F);
+                const b: u8 = @intCast(w & 0x1F);
+                return .{ r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 0xFF };
+            } else {
+                var rgba = [4]u8{ 0, 0, 0, 0xFF };
+                inline for (comptime from.layout(), 0..) |ch, j| rgba[@intFromEnum(ch)] = px[j];
+                return rgba;
+            }
+        }
+
+        fn pack(rgba: [4]u8, out: *[out_bpp]u8) void {
+            if (to == .rgb565) {
+                const w = @as(u16, rgba[0] >> 3) << 11 | @as(u16, rgba[1] >> 2) << 5 | rgba[2] >> 3;
+                std.mem.writeInt(u16, out, w, .little);
+            } else {
+                inline for (comptime PixelFormat.fromRgbMode(to).layout(), 0..) |ch, k| out[k] = rgba[@intFromEnum(ch)];
+            }
+        }
+    };
+}
+
+// --- Tests ---
+
+/// Scalar reference: the pixel as r, g, b, a.
+fn referencePixel(format: PixelFormat, px: []const u8) [4]u8 {
+    return switch (format) {
+        .bgr888 => .{ px[2], px[1], px[0], 0xFF },
+        .bgra8888 => .{ px[2], px[1], px[0], px[3] },
+        .rgb888 => .{ px[0], px[1], px[2], 0xFF },
+        .rgba8888 => .{ px[0], px[1], px[2], px[3] },
+        .argb8888 => .{ px[1], px[2], px[3], px[0] },
+        .abgr8888 => .{ px[3], px[2], px[1], px[0] },
+        .rgb565 => unreachable,
+    };
+}
+
+test "every byte format converts to every wire format like the scalar reference" {
+    var prng = std.Random.DefaultPrng.init(62);
+    const n = 37; // two vector blocks plus a scalar tail
+    for ([_]PixelFormat{ .bgr888, .bgra8888, .rgb888, .rgba8888, .argb8888, .abgr8888 }) |from| {
+        var src: [n * 4]u8 = undefined;
+        prng.random().bytes(&src);
+        const in = src[0 .. n * from.bytesPerPixel()];
+        for ([_]protocol.RgbMode{ .bgr888, .bgra8888, .rgb565 }) |to| {
+            var dst: [n * 4]u8 = undefined;
+            const out = dst[0 .. n * to.bytesPerPixel()];
+            convert(from, to, in, out);
+            for (0..n) |i| {
+                const c = referencePixel(from, in[i * from.bytesPerPixel() ..]);
+                switch (to) {
+                    .bgr888 => try std.testing.expectEqualSlices(u8, &.{ c[2], c[1], c[0] }, out[i * 3 ..][0..3]),
+                    .bgra8888 => try std.testing.expectEqualSlices(u8, &.{ c[2], c[1], c[0], c[3] }, out[i * 4 ..][0..4]),
+                    .rgb565 => {
+                        const want = @as(u16, c[0] >> 3) << 11 | @as(u16, c[1] >> 2) << 5 | c[2] >> 3;
+                        try std.testing.expectEqual(want, std.mem.readInt(u16, out[i * 2 ..][0..2], .little));
+                    },
+                }
+            }
+        }
+    }
+}
+
+test "rgb565 expands to full-range 8-bit channels" {
+    var src: [2]u8 = undefined;
+    std.mem.writeInt(u16, &src, 0xFFFF, .little);
+    var out: [3]u8 = undefined;
+    convert(.rgb565, .bgr888, &src, &out);
+    try std.testing.expectEqualSlices(u8, &.{ 0xFF, 0xFF, 0xFF }, &out);
+}
+
+test "ordered dither averages to the 8-bit value over each 4x4 tile" {
+    // r = 132 lies halfway between 5-bit steps 16 and 17, g = 132 is exactly 6-bit step 33
+    const px = [_]u8{ 132, 132, 40, 0xFF } ** 4;
+    var hi: usize = 0;
+    for (0..4) |y| {
+        var out: [8]u8 = undefined;
+        convertDithered565(.rgba8888, &px, &out, 0, y);
+        for (0..4) |i| {
+            const w = std.mem.readInt(u16, out[i * 2 ..][0..2], .little);
+            try std.testing.expectEqual(@as(u16, 33), w >> 5 & 0x3F);
+            if (w >> 11 == 17) hi += 1 else try std.testing.expectEqual(@as(u16, 16), w >> 11);
+        }
+    }
+    try std.testing.expectEqual(@as(usize, 8), hi);
+    // Saturates instead of wrapping at full intensity
+    var white: [2]u8 = undefined;
+    convertDithered565(.bgr888, &.{ 0xFF, 0xFF, 0xFF }, &white, 3, 3);
+    try std.testing.expectEqual(@as(u16, 0xFFFF), std.mem.readInt(u16, &white, .little));
+}
+
+test "vector dither matches per-pixel dither at any phase" {
+    var prng = std.Random.DefaultPrng.init(63);
+    const n = 37;
+    var src: [n * 4]u8 = undefined;
+    prng.random().bytes(&src);
+    for (0..4) |x| {
+        var whole: [n * 2]u8 = undefined;
+        convertDithered565(.bgra8888, &src, &whole, x, 5);
+        for (0..n) |i| {
+            var one: [2]u8 = undefined;
+            convertDithered565(.bgra8888, src[i * 4 ..][0..4], &one, x + i, 5);
+            try std.testing.expectEqualSlices(u8, &one, whole[i * 2 ..][0..2]);
+        }
+    }
+}
+
+test "Source.read produces the converted frame from any offset" {
+    var data: [5 * 3 * 4]u8 = undefined;
+    for (&data, 0..) |*b, i| b.* = @truncate(i * 13);
+    const source = Source.init(&data, .rgba8888, 5, .bgr888).?;
+    try std.testing.expectEqual(@as(usize, 3), source.height);
+    try std.testing.expect(source.contiguous() == null);
+
+    var whole: [5 * 3 * 3]u8 = undefined;
+    for (0..3) |y| source.convertSpan(0, y, 5, whole[y * 15 ..][0..15]);
+    // Pieces that split pixels and rows
+    var pieced: [whole.len]u8 = undefined;
+    var off: usize = 0;
+    while (off < pieced.len) : (off += 7) {
+        const end = @min(off + 7, pieced.len);
+        source.read(off, pieced[off..end]);
+    }
+    try std.testing.expectEqualSlices(u8, &whole, &pieced);
+    try std.testing.expectEqual(whole[20], source.byteAt(20));
+}
+
+test "strided source reads a cropped rectangle row by row" {
+    // 6x4 bgra8888 framebuffer with 8 bytes of row padding; crop 3x2 at (2, 1)
+    const pitch = 6 * 4 + 8;
+    var fb: [4 * pitch]u8 = undefined;
+    for (&fb, 0..) |*b, i| b.* = @truncate(i);
+    const source = Source.initStrided(&fb, pitch, 2, 1, 3, 2, .bgra8888, .bgra8888).?;
+    try std.testing.expect(source.passthrough());
+    try std.testing.expect(source.contiguous() == null);
+    try std.testing.expectEqual(@as(usize, 3 * 2 * 4), source.frameBytes());
+
+    var out: [3 * 2 * 4]u8 = undefined;
+    source.read(0, &out);
+    try std.testing.expectEqualSlices(u8, fb[pitch + 8 ..][0..12], out[0..12]);
+    try std.testing.expectEqualSlices(u8, fb[2 * pitch + 8 ..][0..12], out[12..24]);
+
+    // The rectangle must fit inside the pitch
+    try std.testing.expect(Source.initStrided(&fb, pitch, 6, 0, 3, 1, .bgra8888, .bgra8888) == null);
+    try std.testing.expect(Source.initStrided(&fb, pitch, 0, 0, 0, 1, .bgra8888, .bgra8888) == null);
+}
+
+test "nearest scaling doubles pixels and rows" {
+    const data = [_]u8{ 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4 }; // 2x2 bgr888
+    var source = Source.init(&data, .bgr888, 2, .bgr888).?;
+    source.scale = .{ .width = 4, .height = 4, .filter = .nearest };
+    try std.testing.expect(!source.passthrough());
+    try std.testing.expectEqual(@as(usize, 4 * 4 * 3), source.frameBytes());
+    var out: [4 * 4 * 3]u8 = undefined;
+    source.read(0, &out);
+    const want = [_]u8{ 1, 1, 2, 2, 1, 1, 2, 2, 3, 3, 4, 4, 3, 3, 4, 4 };
+    for (want, 0..) |v, i| try std.testing.expectEqualSlices(u8, &.{ v, v, v }, out[i * 3 ..][0..3]);
+}
+
+test "integer scaling keeps whole ratios and centres on black" {
+    // 3x2 into 8x5: factor 2, image at (1, 0) in a 6x4 box, border below
+    var data: [3 * 2 * 4]u8 = undefined;
+    for (0..6) |i| data[i * 4 ..][0..4].* = .{ @intCast(10 + i), 0, 0, 0xFF };
+    var source = Source.init(&data, .rgba8888, 3, .bgra8888).?;
+    source.scale = .{ .width = 8, .height = 5, .filter = .integer };
+    var out: [8 * 5 * 4]u8 = undefined;
+    source.read(0, &out);
+    const red = struct {
+        fn at(o: []const u8, x: usize, y: usize) u8 {
+            return o[(y * 8 + x) * 4 + 2];
+        }
+    }.at;
+    try std.testing.expectEqual(@as(u8, 0), red(&out, 0, 0));
+    try std.testing.expectEqual(@as(u8, 10), red(&out, 1, 0));
+    try std.testing.expectEqual(@as(u8, 10), red(&out, 2, 1));
+    try std.testing.expectEqual(@as(u8, 12), red(&out, 6, 0));
+    try std.testing.expectEqual(@as(u8, 0), red(&out, 7, 0));
+    try std.testing.expectEqual(@as(u8, 15), red(&out, 6, 3));
+    try std.testing.expectEqual(@as(u8, 0), red(&out, 3, 4));
+
+    // Larger than the output: the smallest whole reduction
+    source.scale = .{ .width = 2, .height = 1, .filter = .integer };
+    try std.testing.expectEqual(Region{ .x = 0, .y = 0, .w = 1, .h = 1 }, source.region());
+}
+
+test "box scaling averages the covered pixels" {
+    // 4x2 grey levels down to 2x1: each output averages a 2x2 block
+    const data = [_]u8{ 0, 10, 20, 30, 40, 50, 60, 71 };
+    var wide: [data.len * 3]u8 = undefined;
+    for (data, 0..) |v, i| wide[i * 3 ..][0..3].* = .{ v, v, v };
+    var source = Source.init(&wide, .rgb888, 4, .bgr888).?;
+    source.scale = .{ .width = 2, .height = 1, .filter = .box };
+    var out: [2 * 3]u8 = undefined;
+    source.read(0, &out);
+    try std.testing.expectEqualSlices(u8, &.{ 25, 25, 25 }, out[0..3]);
+    // (20 + 30 + 60 + 71) / 4 = 45.25
+    try std.testing.expectEqualSlices(u8, &.{ 45, 45, 45 }, out[3..6]);
+
+    // Magnifying with a box filter repeats pixels like nearest
+    source.scale = .{ .width = 8, .height = 4, .filter = .box };
+    var big: [8 * 4 * 3]u8 = undefined;
+    source.read(0, &big);
+    var near = source;
+    near.scale.?.filter = .nearest;
+    var want: [big.len]u8 = undefined;
+    near.read(0, &want);
+    try std.testing.expectEqualSlices(u8, &want, &big);
+}
+
+test "Source.init rejects partial rows" {
+    const data = [_]u8{0} ** 10;
+    try std.testing.expect(Source.init(&data, .bgr888, 0, .bgr888) == null);
+    try std.testing.expect(Source.init(data[0..9], .bgr888, 2, .bgr888) == null);
+    try std.testing.expectEqual(@as(usize, 3), Source.init(data[0..9], .bgr888, 0, .bgr888).?.width);
+    try std.testing.expect(Source.init(data[0..9], .bgr888, 3, .bgr888).?.contiguous() != null);
+}
@@ -0,0 +1,220 @@
+//! Runtime CPU dispatch for the hot kernels (delta and pixel conversion).
+//! x86_64 builds link extra copies of `kernels.zig` compiled for x86-64-v3
+//! (AVX2) and x86-64-v4 (AVX-512); the widest one the host CPU supports is
+//! chosen on first use.
+//! Every other target, and CPUs without those extensions, use the kernels
+//! compiled for the build target.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const protocol = @import("protocol.zig");
+const kernels = @import("kernels.zig");
+const ingest = @import("ingest.zig");
+const build_isa = @import("isa_build");
+
+/// Kernel builds, narrowest first.
+pub const Variant = enum {
+    baseline,
+    x86_64_v3,
+    x86_64_v4,
+};
+
+const has_variants = build_isa.x86_variants and builtin.cpu.arch == .x86_64;
+
+const variant_sets = if (has_variants) struct {
+    extern const gmz_kernels_x86_64_v3: kernels.KernelSet;
+    extern const gmz_kernels_x86_64_v4: kernels.KernelSet;
+} else struct {};
+
+var detected: Variant = .baseline;
+var detect_once = std.once(detect);
+/// Test/benchmark override; see `force`.
+var forced: ?Variant = null;
+
+/// Whether `v` is linked into this build.
+pub fn built(v: Variant) bool {
+    return v == .baseline or has_variants;
+}
+
+/// Widest variant that is both built and supported by the host CPU.
+pub fn best() Variant {
+    detect_once.call();
+    return detected;
+}
+
+/// Variant the kernels currently come from.
+pub fn active() Variant {
+    return forced orelse best();
+}
+
+/// Use `v` instead of the detected variant, or restore detection with null.
+/// For tests and benchmarks only: forcing a variant the CPU can't run faults.
+/// Kernels already selected (e.g. at `gmz_set_modeline`) keep their variant;
+/// pixel conversions look the variant up on every call.
+pub fn force(v: ?Variant) void {
+    std.debug.assert(v == null or built(v.?));
+    forced = v;
+}
+
+/// Whether the host CPU can run `v` and it is built.
+pub fn supported(v: Variant) bool {
+    return built(v) and @intFromEnum(v) <= @intFromEnum(best());
+}
+
+/// Kernel set for `v`, which must be built.
+pub fn kernelSet(v: Variant) *const kernels.KernelSet {
+    if (has_variants) switch (v) {
+        .baseline => {},
+        .x86_64_v3 => return &variant_sets.gmz_kernels_x86_64_v3,
+        .x86_64_v4 => return &variant_sets.gmz_kernels_x86_64_v4,
+    };
+    return &kernels.native;
+}
+
+/// Generic kernel from the active variant.
+pub fn generic() kernels.Kernel {
+    return kernels.genericIn(kernelSet(active()));
+}
+
+/// `kernels.select` from the active variant.
+pub fn select(width: u16, rows: u16, mode: protocol.RgbMode) kernels.Kernel {
+    return kernels.selectIn(kernelSet(active()), width, rows, mode);
+}
+
+/// Kernel for the field geometry of a modeline, from the active variant.
+pub fn forModeline(m: protocol.Modeline, mode: protocol.RgbMode) kernels.Kernel {
+    return select(m.h_active, kernels.fieldRows(m), mode);
+}
+
+fn detect() void {
+    // Keeps the x86 asm out of other targets' analysis
+    if (has_variants) detectX86();
+}
+
+fn detectX86() void {
+    const max_leaf = cpuid(0, 0)[0];
+    if (max_leaf < 7) return;
+    const l1 = cpuid(1, 0);
+    const l7 = cpuid(7, 0);
+    const ext = cpuid(0x8000_0001, 0);
+    const bit = struct {
+        fn f(reg: u32, n: u5) bool {
+            return reg >> n & 1 != 0;
+        }
+    }.f;
+
+    // The OS must save the wide registers (XCR0), not just the CPU have them
+    if (!bit(l1[2], 27)) return; // OSXSAVE
+    const xcr0 = xgetbv();
+    const v3 = bit(l1[2], 12) and bit(l1[2], 22) and bit(l1[2], 28) and bit(l1[2], 29) and // FMA MOVBE AVX F16C
+        bit(l7[1], 3) and bit(l7[1], 5) and bit(l7[1], 8) and bit(ext[2], 5) and // BMI1 AVX2 BMI2 LZCNT
+        xcr0 & 0x6 == 0x6;
+    if (!v3) return;
+    detected = .x86_64_v3;
+    const v4 = bit(l7[1], 16) and bit(l7[1], 17) and bit(l7[1], 28) and bit(l7[1], 30) and bit(l7[1], 31) and // F DQ CD BW VL
+        xcr0 & 0xE0 == 0xE0;
+    if (v4) detected = .x86_64_v4;
+}
+
+fn cpuid(leaf: u32, subleaf: u32) [4]u32 {
+    var eax: u32 = undefined;
+    var ebx: u32 = undefined;
+    var ecx: u32 = undefined;
+    var edx: u32 = undefined;
+    asm volatile ("cpuid"
+        : [_] "={eax}" (eax),
+          [_] "={ebx}" (ebx),
+          [_] "={ecx}" (ecx),
+          [_] "={edx}" (edx),
+        : [_] "{eax}" (leaf),
+          [_] "{ecx}" (subleaf),
+    );
+    return .{ eax, ebx, ecx, edx };
+}
+
+fn xgetbv() u32 {
+    var eax: u32 = undefined;
+    var edx: u32 = undefined;
+    asm volatile ("xgetbv"
+        : [_] "={eax}" (eax),
+          [_] "={edx}" (edx),
+        : [_] "{ecx}" (@as(u32, 0)),
+    );
+    return eax;
+}
+
+// --- Tests ---
+
+test "baseline is always built and supported" {
+    try std.testing.expect(built(.baseline));
+    try std.testing.expect(supported(.baseline));
+    try std.testing.expectEqual(&kernels.native, kernelSet(.baseline));
+}
+
+test "force overrides the detected variant" {
+    defer force(null);
+    force(.baseline);
+    try std.testing.expectEqual(Variant.baseline, active());
+    force(null);
+    try std.testing.expectEqual(best(), active());
+}
+
+test "every supported variant matches the scalar reference" {
+    defer force(null);
+    const alloc = std.testing.allocator;
+    var prng = std.Random.DefaultPrng.init(59);
+
+    for (std.enums.values(Variant)) |v| {
+        if (!supported(v)) continue;
+        force(v);
+        var kernels_to_check: [kernels.specs.len + 1]kernels.Kernel = undefined;
+        kernels_to_check[0] = generic();
+        for (kernels.specs, 1..) |spec, i| kernels_to_check[i] = select(spec.geometry.width, spec.geometry.rows, spec.mode);
+
+        for (kernels_to_check) |kernel| {
+            // Odd length for the generic kernel exercises the vector tail
+            const len = if (kernel.frame_bytes > 0) kernel.frame_bytes else 100_003;
+            const buf = try alloc.alloc(u8, len * 5);
+            defer alloc.free(buf);
+            const src = buf[0..len];
+            const prev_a = buf[len..][0..len];
+            const prev_b = buf[2 * len ..][0..len];
+            const out_a = buf[3 * len ..][0..len];
+            const out_b = buf[4 * len ..][0..len];
+            prng.random().bytes(src);
+            prng.random().bytes(prev_a);
+            @memcpy(prev_b, prev_a);
+
+            kernels.subtractUpdate(out_a, src, prev_a);
+            kernel.subtractUpdate(out_b, src, prev_b);
+            try std.testing.expectEqualSlices(u8, out_a, out_b);
+            try std.testing.expectEqualSlices(u8, prev_a, prev_b);
+        }
+    }
+}
+
+test "every supported variant converts pixels like the baseline build" {
+    var prng = std.Random.DefaultPrng.init(62);
+    const n = 37; // two vector blocks plus a scalar tail
+    var src: [n * 4]u8 = undefined;
+    prng.random().bytes(&src);
+
+    for (std.enums.values(Variant)) |v| {
+        if (!supported(v)) continue;
+        const set = kernelSet(v);
+        for (std.enums.values(ingest.PixelFormat)) |from| {
+            for (std.enums.values(protocol.RgbMode)) |to| {
+                var want: [n * 4]u8 = undefined;
+                var got: [n * 4]u8 = undefined;
+                kernels.native.converter(from, to)(&src, &want, n);
+                set.converter(from, to)(&src, &got, n);
+                try std.testing.expectEqualSlices(u8, want[0 .. n * to.bytesPerPixel()], got[0 .. n * to.bytesPerPixel()]);
+            }
+            var want565: [n * 2]u8 = undefined;
+            var got565: [n * 2]u8 = undefined;
+            kernels.native.ditherer(from)(&src, &want565, n, 3, 1);
+            set.ditherer(from)(&src, &got565, n, 3, 1);
+            try std.testing.expectEqualSlices(u8, &want565, &got565);
+        }
+    }
+}
@@ -0,0 +1,12 @@
+//! Root of an ISA variant object (see `addIsaVariants` in build.zig): the
+//! kernels of `kernels.zig` compiled for a wider CPU model and exported as
+//! `gmz_kernels_<variant>` for `isa.zig` to pick at runtime.
+
+const kernels = @import("kernels.zig");
+const variant = @import("isa_variant").name;
+
+const set: kernels.KernelSet = kernels.native;
+
+comptime {
+    @export(&set, .{ .name = "gmz_kernels_" ++ variant });
+}
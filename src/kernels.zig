@@ -0,0 +1,307 @@
+//! Delta kernels specialised at comptime for the display geometries and
+//! pixel formats in common use. Each specialisation knows its row length, so
+//! the per-row loop has a fixed trip count and is fully unrolled into vector
+//! operations. `select` picks one from the active modeline; anything else
+//! falls back to the generic loop.
+//!
+//! All kernels of one build form a `KernelSet` with a C ABI, so the same
+//! source can also be compiled for wider ISAs and picked at runtime
+//! (see `isa.zig`). The set also carries the ingest kernels (pixel format
+//! conversion, dithered RGB565 packing, box-filter sums), which are vector
+//! code of the same kind.
+
+const std = @import("std");
+const protocol = @import("protocol.zig");
+const ingest = @import("ingest.zig");
+
+/// Wrapping subtract + reference update: `delta_out[i] = src[i] -% prev[i]`,
+/// then `prev[i] = src[i]`, for `len` bytes.
+pub const SubtractFn = *const fn (delta_out: [*]u8, src: [*]const u8, prev: [*]u8, len: usize) callconv(.c) void;
+
+/// A subtract + reference-update kernel bound to one geometry (or any).
+pub const Kernel = struct {
+    name: []const u8,
+    /// Band split granularity in bytes. For specialised kernels this is the
+    /// scanline length, and inputs must be a whole number of rows.
+    row_bytes: usize,
+    /// Frame size this kernel is specialised for, or 0 for any size.
+    frame_bytes: usize,
+    subtract: SubtractFn,
+
+    /// Whether this kernel can process a whole frame of `len` bytes.
+    pub fn fits(self: Kernel, len: usize) bool {
+        return self.frame_bytes == 0 or self.frame_bytes == len;
+    }
+
+    /// Write `src -% prev` into `delta_out` and copy `src` into `prev`.
+    pub fn subtractUpdate(self: Kernel, delta_out: []u8, src: []const u8, prev: []u8) void {
+        std.debug.assert(delta_out.len >= src.len and prev.len >= src.len);
+        self.subtract(delta_out.ptr, src.ptr, prev.ptr, src.len);
+    }
+};
+
+/// Convert `n` pixels from `src` into `dst` (see `ingest.convert`).
+pub const ConvertFn = *const fn (src: [*]const u8, dst: [*]u8, n: usize) callconv(.c) void;
+
+/// Convert `n` pixels into RGB565 with ordered dithering for row `y` from
+/// column `x` (see `ingest.convertDithered565`).
+pub const DitherFn = *const fn (src: [*]const u8, dst: [*]u8, n: usize, x: usize, y: usize) callconv(.c) void;
+
+/// Add the BGRA pixels under each of `n` box-filter output pixels to its
+/// sum (see `ingest.boxAccumulate`).
+pub const BoxSumFn = *const fn (sums: [*]ingest.BoxSum, line: [*]const u8, lo: [*]const usize, n: usize, first: usize, last: usize) callconv(.c) void;
+
+const pixel_formats = std.enums.values(ingest.PixelFormat);
+const wire_modes = std.enums.values(protocol.RgbMode);
+
+/// Every kernel of one compilation. Subtract kernels are indexed like
+/// `specs`, conversions by the enum values of their formats.
+pub const KernelSet = extern struct {
+    generic: SubtractFn,
+    specialised: [specs.len]SubtractFn,
+    /// `[from][to]`: `ingest.PixelFormat` to `protocol.RgbMode`.
+    convert: [pixel_formats.len][wire_modes.len]ConvertFn,
+    /// To RGB565 with ordered dithering, by `ingest.PixelFormat`.
+    dither565: [pixel_formats.len]DitherFn,
+    box_sum: BoxSumFn,
+
+    /// Conversion kernel from `from` to `to`.
+    pub fn converter(self: *const KernelSet, from: ingest.PixelFormat, to: protocol.RgbMode) ConvertFn {
+        return self.convert[@intFromEnum(from)][@intFromEnum(to)];
+    }
+
+    /// Dithering RGB565 kernel for `from`.
+    pub fn ditherer(self: *const KernelSet, from: ingest.PixelFormat) DitherFn {
+        return self.dither565[@intFromEnum(from)];
+    }
+};
+
+/// Kernels compiled for this build's target CPU.
+pub const native: KernelSet = blk: {
+    var set = KernelSet{
+        .generic = &genericSubtract,
+        .specialised = undefined,
+        .convert = undefined,
+        .dither565 = undefined,
+        .box_sum = &boxSum,
+    };
+    for (specs, 0..) |spec, i| {
+        set.specialised[i] = &Specialised(spec.geometry.width, spec.geometry.rows, spec.mode.bytesPerPixel()).subtract;
+    }
+    for (pixel_formats) |from| {
+        std.debug.assert(pixel_formats[@intFromEnum(from)] == from);
+        for (wire_modes) |to| {
+            std.debug.assert(wire_modes[@intFromEnum(to)] == to);
+            set.convert[@intFromEnum(from)][@intFromEnum(to)] = &Conversion(from, to).run;
+        }
+        set.dither565[@intFromEnum(from)] = &Conversion(from, .rgb565).runDithered;
+    }
+    break :blk set;
+};
+
+/// Generic kernel from this build, for any frame size.
+pub const generic = genericIn(&native);
+
+/// Generic wrapping subtract + reference update over arbitrary lengths.
+pub fn subtractUpdate(delta_out: []u8, src: []const u8, prev: []u8) void {
+    for (delta_out[0..src.len], src, prev[0..src.len]) |*d, s, *p| {
+        d.* = s -% p.*;
+        p.* = s;
+    }
+}
+
+fn genericSubtract(delta_out: [*]u8, src: [*]const u8, prev: [*]u8, len: usize) callconv(.c) void {
+    subtractUpdate(delta_out[0..len], src[0..len], prev[0..len]);
+}
+
+/// Geometry of one submitted field (progressive modes: one frame).
+pub const Geometry = struct {
+    width: u16,
+    rows: u16,
+};
+
+/// Specialised geometries: 320x240, 256x224, 640x480, and the fields of
+/// 720x480i and 720x576i.
+pub const geometries = [_]Geometry{
+    .{ .width = 320, .rows = 240 },
+    .{ .width = 256, .rows = 224 },
+    .{ .width = 640, .rows = 480 },
+    .{ .width = 720, .rows = 240 },
+    .{ .width = 720, .rows = 288 },
+};
+
+const modes = [_]protocol.RgbMode{ .bgr888, .bgra8888, .rgb565 };
+
+const Spec = struct {
+    geometry: Geometry,
+    mode: protocol.RgbMode,
+    name: []const u8,
+    row_bytes: usize,
+    frame_bytes: usize,
+};
+
+/// Every specialisation: each geometry in each pixel format.
+pub const specs = blk: {
+    var entries: [geometries.len * modes.len]Spec = undefined;
+    for (geometries, 0..) |g, gi| {
+        for (modes, 0..) |m, mi| {
+            const row_bytes = @as(usize, g.width) * m.bytesPerPixel();
+            entries[gi * modes.len + mi] = .{
+                .geometry = g,
+                .mode = m,
+                .name = std.fmt.comptimePrint("{d}x{d} {s}", .{ g.width, g.rows, @tagName(m) }),
+                .row_bytes = row_bytes,
+                .frame_bytes = row_bytes * g.rows,
+            };
+        }
+    }
+    break :blk entries;
+};
+
+/// Generic kernel from `set`. Bands split on cache lines.
+pub fn genericIn(set: *const KernelSet) Kernel {
+    return .{ .name = "generic", .row_bytes = 64, .frame_bytes = 0, .subtract = set.generic };
+}
+
+/// Pick the kernel in `set` for a field of `width` x `rows` pixels in
+/// `mode`, or its generic kernel when no specialisation exists.
+pub fn selectIn(set: *const KernelSet, width: u16, rows: u16, mode: protocol.RgbMode) Kernel {
+    for (specs, 0..) |spec, i| {
+        if (spec.geometry.width == width and spec.geometry.rows == rows and spec.mode == mode) return .{
+            .name = spec.name,
+            .row_bytes = spec.row_bytes,
+            .frame_bytes = spec.frame_bytes,
+            .subtract = set.specialised[i],
+        };
+    }
+    return genericIn(set);
+}
+
+/// `selectIn` for this build's kernels.
+pub fn select(width: u16, rows: u16, mode: protocol.RgbMode) Kernel {
+    return selectIn(&native, width, rows, mode);
+}
+
+/// Field rows for a modeline (the larger field, `(v_active + 1) / 2`, when interlaced).
+pub fn fieldRows(m: protocol.Modeline) u16 {
+    return if (m.interlaced) (m.v_active + 1) / 2 else m.v_active;
+}
+
+/// Kernel for the field geometry of a modeline, from this build's kernels.
+pub fn forModeline(m: protocol.Modeline, mode: protocol.RgbMode) Kernel {
+    return select(m.h_active, fieldRows(m), mode);
+}
+
+/// C ABI entry points for one `ingest.Converter`.
+fn Conversion(comptime from: ingest.PixelFormat, comptime to: protocol.RgbMode) type {
+    return struct {
+        fn run(src: [*]const u8, dst: [*]u8, n: usize) callconv(.c) void {
+            ingest.Converter(from, to).run(src, dst, n);
+        }
+
+        fn runDithered(src: [*]const u8, dst: [*]u8, n: usize, x: usize, y: usize) callconv(.c) void {
+            if (from == .rgb565) {
+                // Already RGB565: nothing to dither
+                @memcpy(dst[0 .. n * 2], src[0 .. n * 2]);
+            } else {
+                ingest.Converter(from, to).runDithered(src, dst, n, x, y);
+            }
+        }
+    };
+}
+
+fn boxSum(sums: [*]ingest.BoxSum, line: [*]const u8, lo: [*]const usize, n: usize, first: usize, last: usize) callconv(.c) void {
+    ingest.boxAccumulate(sums[0..n], line[0 .. (last - first) * 4], lo[0 .. n + 1], first, last);
+}
+
+fn Specialised(comptime width: usize, comptime rows: usize, comptime bpp: usize) type {
+    return struct {
+        const row_bytes = width * bpp;
+        const frame_bytes = row_bytes * rows;
+        // Widest vector the target handles natively: 16 (SSE2/NEON), 32 (AVX2), 64 (AVX-512)
+        const vec_len = std.simd.suggestVectorLength(u8) orelse 16;
+        const V = @Vector(vec_len, u8);
+        const full_vecs = row_bytes / vec_len;
+
+        fn subtract(delta_out: [*]u8, src: [*]const u8, prev: [*]u8, len: usize) callconv(.c) void {
+            std.debug.assert(len % row_bytes == 0 and len <= frame_bytes);
+            var off: usize = 0;
+            while (off < len) : (off += row_bytes) {
+                subtractRow(delta_out[off..][0..row_bytes], src[off..][0..row_bytes], prev[off..][0..row_bytes]);
+            }
+        }
+
+        inline fn subtractRow(d: *[row_bytes]u8, s: *const [row_bytes]u8, p: *[row_bytes]u8) void {
+            inline for (0..full_vecs) |i| {
+                const o = i * vec_len;
+                const sv: V = s[o..][0..vec_len].*;
+                const pv: V = p[o..][0..vec_len].*;
+                d[o..][0..vec_len].* = sv -% pv;
+                p[o..][0..vec_len].* = sv;
+            }
+            inline for (full_vecs * vec_len..row_bytes) |i| {
+                d[i] = s[i] -% p[i];
+                p[i] = s[i];
+            }
+        }
+    };
+}
+
+// --- Tests ---
+
+test "select returns specialisations for fleet geometries and generic otherwise" {
+    const k = select(320, 240, .bgr888);
+    try std.testing.expectEqual(@as(usize, 960), k.row_bytes);
+    try std.testing.expectEqual(@as(usize, 320 * 240 * 3), k.frame_bytes);
+    try std.testing.expectEqualStrings("320x240 bgr888", k.name);
+    try std.testing.expectEqualStrings("generic", select(321, 240, .bgr888).name);
+    try std.testing.expect(generic.fits(12345));
+    try std.testing.expect(!k.fits(12345));
+}
+
+test "forModeline uses the field height for interlaced modes" {
+    const m = protocol.Modeline{
+        .pixel_clock = 13.5,
+        .h_active = 720,
+        .h_begin = 732,
+        .h_end = 796,
+        .h_total = 864,
+        .v_active = 576,
+        .v_begin = 581,
+        .v_end = 586,
+        .v_total = 625,
+        .interlaced = true,
+    };
+    try std.testing.expectEqualStrings("720x288 bgra8888", forModeline(m, .bgra8888).name);
+    var odd = m;
+    odd.v_active = 575;
+    try std.testing.expectEqual(@as(u16, 288), fieldRows(odd));
+}
+
+test "every specialised kernel matches the generic kernel" {
+    const alloc = std.testing.allocator;
+    var prng = std.Random.DefaultPrng.init(56);
+    for (specs) |spec| {
+        const kernel = select(spec.geometry.width, spec.geometry.rows, spec.mode);
+        const len = kernel.frame_bytes;
+        const src = try alloc.alloc(u8, len);
+        defer alloc.free(src);
+        const prev_a = try alloc.alloc(u8, len);
+        defer alloc.free(prev_a);
+        const prev_b = try alloc.alloc(u8, len);
+        defer alloc.free(prev_b);
+        const out_a = try alloc.alloc(u8, len);
+        defer alloc.free(out_a);
+        const out_b = try alloc.alloc(u8, len);
+        defer alloc.free(out_b);
+
+        prng.random().bytes(src);
+        prng.random().bytes(prev_a);
+        @memcpy(prev_b, prev_a);
+
+        subtractUpdate(out_a, src, prev_a);
+        kernel.subtractUpdate(out_b, src, prev_b);
+        try std.testing.expectEqualSlices(u8, out_a, out_b);
+        try std.testing.expectEqualSlices(u8, prev_a, prev_b);
+    }
+}
@@ -3,7 +3,7 @@ const lz4 = @import("lz4");
 const Connection = @import("Connection.zig");
 
 /// Return a `Connection.Compressor` backed by LZ4 block compression.
-/// `buf` must be at least `compressBound(max_frame_size)` bytes.
+/// `buf` must be at least `compressBound(frame_size)` bytes.
 pub fn compressor(buf: []u8) Connection.Compressor {
     return .{
         .ctx = null,
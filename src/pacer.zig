@@ -13,6 +13,7 @@ const std = @import("std");
 const protocol = @import("protocol.zig");
 const sync = @import("sync.zig");
 const Connection = @import("Connection.zig");
+const clock = @import("clock.zig");
 
 /// Result of a beginFrame call.
 pub const PaceResult = enum(c_int) {
@@ -48,9 +49,11 @@ pub const PacerState = struct {
     // --- Timing ---
     /// Monotonic timestamp (ns) when last beginFrame returned to caller.
     last_pace_ns: u64 = 0,
+    /// Round trip of the last sync in ms (the whole wait when it timed out).
+    last_sync_ms: f64 = 0,
 
     // --- Drop tracking ---
-    /// Wall-clock time (ns) of last `.ready` return.
+    /// Monotonic time (ns) of last `.ready` return.
     last_ready_ns: u64 = 0,
     /// Monotonic counter of real frame-level drops (full frame periods lost).
     dropped_frames: u64 = 0,
@@ -76,9 +79,10 @@ pub const PacerState = struct {
         const timeout: i32 = if (in_settle) 50 else 16;
 
         // 1. Sync — send CMD_GET_STATUS and wait for ACK, measuring round-trip time
-        const sync_start = nowNs();
+        const sync_start = clock.nowNs();
         const synced = conn.waitSync(timeout);
-        const sync_elapsed_ns = nowNs() -| sync_start;
+        const sync_elapsed_ns = clock.nowNs() -| sync_start;
+        self.last_sync_ms = @as(f64, @floatFromInt(sync_elapsed_ns)) / 1_000_000.0;
 
         if (!synced) {
             self.consecutive_timeouts += 1;
@@ -114,7 +118,7 @@ pub const PacerState = struct {
 
         // 4. Track real dropped frames before sleeping.
         // If time since last .ready exceeds 1.5 frame periods, count missed frames.
-        const now = nowNs();
+        const now = clock.nowNs();
         if (self.last_ready_ns > 0 and self.frame_time_ns > 0) {
             const gap = now -| self.last_ready_ns;
             const threshold = self.frame_time_ns + (self.frame_time_ns / 2); // 1.5x
@@ -128,7 +132,7 @@ pub const PacerState = struct {
 
         // 5. Sleep until target
         self.sleepForDuration(paced_ns);
-        self.last_ready_ns = nowNs();
+        self.last_ready_ns = clock.nowNs();
         self.client_frame +%= 1;
         return .ready;
     }
@@ -165,7 +169,7 @@ pub const PacerState = struct {
     /// Uses coarse sleep (nanosleep) leaving a 2ms margin, then spin-waits
     /// for the remainder to hit the target precisely.
     fn sleepForDuration(self: *PacerState, duration_ns: u64) void {
-        const now = nowNs();
+        const now = clock.nowNs();
 
         // First call: set anchor and return immediately.
         if (self.last_pace_ns == 0) {
@@ -181,11 +185,11 @@ pub const PacerState = struct {
                 std.Thread.sleep(remaining - margin);
             }
             // Spin-wait for remaining time
-            while (nowNs() < target) {
+            while (clock.nowNs() < target) {
                 std.atomic.spinLoopHint();
             }
         }
-        self.last_pace_ns = nowNs();
+        self.last_pace_ns = clock.nowNs();
     }
 
     /// Reset tracking state on connect/reconnect.
@@ -207,12 +211,6 @@ pub const PacerState = struct {
     }
 };
 
-/// Monotonic nanosecond timestamp.
-fn nowNs() u64 {
-    const ts = std.time.nanoTimestamp();
-    return @intCast(if (ts < 0) 0 else ts);
-}
-
 // --- Tests ---
 
 test "PacerState defaults" {
@@ -0,0 +1,310 @@
+//! Audio ingest: reads host PCM in its own sample format and layout and
+//! produces the wire format (interleaved s16le at the session's channel
+//! count) straight into the audio ring.
+//!
+//! A `Source` describes the submitted samples: s16, s32 or f32, one or two
+//! channels, interleaved or in separate planes. `convert` works eight frames
+//! at a time in vector registers: one contiguous load per block (split into
+//! channels with shuffles when interleaved), scale to 16-bit, add TPDF dither
+//! when the source has more than 16 bits, round and saturate, then shuffle
+//! the channels back together and store the block at once. Mono sources are
+//! duplicated to stereo sessions and stereo sources averaged to mono ones.
+
+const std = @import("std");
+const builtin = @import("builtin");
+
+/// Host sample formats (little-endian). Floats are full scale at +-1.0.
+pub const SampleFormat = enum(u8) {
+    s16 = 0,
+    s32 = 1,
+    f32 = 2,
+
+    pub fn bytesPerSample(self: SampleFormat) usize {
+        return switch (self) {
+            .s16 => 2,
+            .s32, .f32 => 4,
+        };
+    }
+};
+
+pub const max_channels = 2;
+
+const lanes = 8;
+const V = @Vector(lanes, f32);
+const Out = @Vector(lanes, i16);
+
+/// Submitted audio: `frames` frames of `channels` channels of `format`.
+pub const Source = struct {
+    format: SampleFormat,
+    channels: usize,
+    frames: usize,
+    /// First sample of each channel; both point into one buffer when
+    /// interleaved.
+    planes: [max_channels][*]const u8,
+    /// Bytes from one sample of a channel to its next.
+    stride: usize,
+
+    /// Source over interleaved samples. Null for an unsupported channel count.
+    pub fn interleaved(data: [*]const u8, format: SampleFormat, channels: usize, frames: usize) ?Source {
+        if (channels == 0 or channels > max_channels) return null;
+        const bps = format.bytesPerSample();
+        return .{
+            .format = format,
+            .channels = channels,
+            .frames = frames,
+            .planes = .{ data, data + bps * (channels - 1) },
+            .stride = bps * channels,
+        };
+    }
+
+    /// Source over one buffer per channel. Null for an unsupported channel
+    /// count or a missing plane.
+    pub fn planar(planes: []const ?[*]const u8, format: SampleFormat, frames: usize) ?Source {
+        if (planes.len == 0 or planes.len > max_channels) return null;
+        var p: [max_channels][*]const u8 = undefined;
+        for (planes, 0..) |plane, c| p[c] = plane orelse return null;
+        if (planes.len == 1) p[1] = p[0];
+        return .{ .format = format, .channels = planes.len, .frames = frames, .planes = p, .stride = format.bytesPerSample() };
+    }
+
+    /// Sample `frame` of channel `c`, scaled so 16-bit full scale is 32768.
+    fn sample(self: *const Source, c: usize, frame: usize) f32 {
+        const at = self.planes[c] + frame * self.stride;
+        return switch (self.format) {
+            .s16 => @floatFromInt(std.mem.readInt(i16, at[0..2], .little)),
+            .s32 => @as(f32, @floatFromInt(std.mem.readInt(i32, at[0..4], .little))) * (1.0 / 65536.0),
+            .f32 => @as(f32, @bitCast(std.mem.readInt(u32, at[0..4], .little))) * 32768.0,
+        };
+    }
+
+    /// `lanes` frames of every channel starting at `frame`, scaled like
+    /// `sample`, from contiguous vector loads.
+    fn loadBlock(self: *const Source, frame: usize) [max_channels]V {
+        return switch (self.format) {
+            inline else => |format| self.loadBlockAs(format, frame),
+        };
+    }
+
+    fn loadBlockAs(self: *const Source, comptime format: SampleFormat, frame: usize) [max_channels]V {
+        // f32 samples are loaded as bits and reinterpreted after the swizzle
+        const T = switch (format) {
+            .s16 => i16,
+            .s32 => i32,
+            .f32 => u32,
+        };
+        var out: [max_channels]V = undefined;
+        if (self.channels == 2 and self.stride == 2 * @sizeOf(T)) {
+            // Interleaved stereo: both channels in one load, split by lane parity
+            const both = loadLittle(T, 2 * lanes, self.planes[0] + frame * self.stride);
+            out[0] = scale(format, @shuffle(T, both, undefined, comptime strideMask(0)));
+            out[1] = scale(format, @shuffle(T, both, undefined, comptime strideMask(1)));
+        } else {
+            for (0..self.channels) |c| out[c] = scale(format, loadLittle(T, lanes, self.planes[c] + frame * self.stride));
+        }
+        return out;
+    }
+
+    /// Up to `lanes` frames of output channel `oc` for a session with
+    /// `out_channels`, starting at `frame`, one sample at a time (block tails).
+    fn load(self: *const Source, oc: usize, out_channels: usize, frame: usize, n: usize) V {
+        var a: [lanes]f32 = .{0} ** lanes;
+        if (self.channels > out_channels) {
+            for (a[0..n], 0..) |*s, i| s.* = (self.sample(0, frame + i) + self.sample(1, frame + i)) * 0.5;
+        } else {
+            const c = @min(oc, self.channels - 1);
+            for (a[0..n], 0..) |*s, i| s.* = self.sample(c, frame + i);
+        }
+        return a;
+    }
+};
+
+/// `n` consecutive little-endian `T`s at `p`.
+fn loadLittle(comptime T: type, comptime n: usize, p: [*]const u8) @Vector(n, T) {
+    const v: @Vector(n, T) = @bitCast(p[0 .. n * @sizeOf(T)].*);
+    return if (builtin.cpu.arch.endian() == .big) @byteSwap(v) else v;
+}
+
+/// Raw samples of `format` scaled so 16-bit full scale is 32768.
+fn scale(comptime format: SampleFormat, v: anytype) V {
+    return switch (format) {
+        .s16 => @floatFromInt(v),
+        .s32 => @as(V, @floatFromInt(v)) * @as(V, @splat(1.0 / 65536.0)),
+        .f32 => @as(V, @bitCast(v)) * @as(V, @splat(32768.0)),
+    };
+}
+
+/// Lanes `first`, `first + 2`, ... of a two-channel block.
+fn strideMask(first: i32) @Vector(lanes, i32) {
+    var mask: [lanes]i32 = undefined;
+    for (&mask, 0..) |*m, i| m.* = first + 2 * @as(i32, @intCast(i));
+    return mask;
+}
+
+/// Alternate lanes of two vectors: left, right, left, right, ...
+const interleave_mask = blk: {
+    var mask: [2 * lanes]i32 = undefined;
+    for (0..lanes) |i| {
+        mask[2 * i] = i;
+        mask[2 * i + 1] = ~@as(i32, i);
+    }
+    break :blk mask;
+};
+
+/// Round, saturate and narrow to s16.
+fn quantize(v: V) Out {
+    const clamped = @max(@min(@round(v), @as(V, @splat(32767))), @as(V, @splat(-32768)));
+    return @intCast(@as(@Vector(lanes, i32), @intFromFloat(clamped)));
+}
+
+/// Store a block of `out_channels` channels as interleaved s16le.
+fn storeBlock(dst: []u8, s: [max_channels]Out, out_channels: usize) void {
+    if (out_channels == 2) {
+        const pairs = @shuffle(i16, s[0], s[1], interleave_mask);
+        const le = if (builtin.cpu.arch.endian() == .big) @byteSwap(pairs) else pairs;
+        dst[0 .. 4 * lanes].* = @bitCast(le);
+    } else {
+        const le = if (builtin.cpu.arch.endian() == .big) @byteSwap(s[0]) else s[0];
+        dst[0 .. 2 * lanes].* = @bitCast(le);
+    }
+}
+
+/// Triangular-PDF dither, +-1 LSB: the difference of two uniform draws from
+/// a per-lane xorshift generator.
+pub const Dither = struct {
+    state: @Vector(lanes, u32) = .{ 0x9E3779B9, 0x7F4A7C15, 0x85EBCA6B, 0xC2B2AE35, 0x27D4EB2F, 0x165667B1, 0xD3A2646C, 0xFD7046C5 },
+
+    fn uniform(self: *Dither) V {
+        const Shift = @Vector(lanes, u5);
+        var x = self.state;
+        x ^= x << @as(Shift, @splat(13));
+        x ^= x >> @as(Shift, @splat(17));
+        x ^= x << @as(Shift, @splat(5));
+        self.state = x;
+        const top = x >> @as(Shift, @splat(8));
+        return @as(V, @floatFromInt(top)) * @as(V, @splat(1.0 / 16777216.0));
+    }
+
+    pub fn next(self: *Dither) V {
+        return self.uniform() - self.uniform();
+    }
+};
+
+/// Convert frames `first..first + frames` of `src` into `dst` as s16le with
+/// `out_channels` interleaved channels. `dither` applies to s32 and f32
+/// sources only; 16-bit sources are already exact.
+pub fn convert(src: *const Source, first: usize, frames: usize, out_channels: usize, dst: []u8, dither: ?*Dither) void {
+    std.debug.assert(dst.len >= frames * 2 * out_channels);
+    const dither_on = dither != null and src.format != .s16;
+    const frame_bytes = 2 * out_channels;
+    var f: usize = 0;
+    while (f + lanes <= frames) : (f += lanes) {
+        const in = src.loadBlock(first + f);
+        var out: [max_channels]Out = undefined;
+        for (out[0..out_channels], 0..) |*o, oc| {
+            var v = if (src.channels > out_channels) (in[0] + in[1]) * @as(V, @splat(0.5)) else in[@min(oc, src.channels - 1)];
+            if (dither_on) v += dither.?.next();
+            o.* = quantize(v);
+        }
+        storeBlock(dst[f * frame_bytes ..], out, out_channels);
+    }
+    if (f == frames) return;
+
+    // Fewer than `lanes` frames left: gather and write them one at a time
+    const n = frames - f;
+    for (0..out_channels) |oc| {
+        var v = src.load(oc, out_channels, first + f, n);
+        if (dither_on) v += dither.?.next();
+        const s: [lanes]i16 = quantize(v);
+        for (0..n) |i| {
+            std.mem.writeInt(i16, dst[(f + i) * frame_bytes + oc * 2 ..][0..2], s[i], .little);
+        }
+    }
+}
+
+// --- Tests ---
+
+fn readOut(dst: []const u8, i: usize) i16 {
+    return std.mem.readInt(i16, dst[i * 2 ..][0..2], .little);
+}
+
+test "f32 converts with saturation" {
+    const in = [_]f32{ 0.0, 0.5, -0.5, 1.0, -1.0, 2.0, -3.0, 0.25, 0.001, -0.001 };
+    const src = Source.interleaved(std.mem.sliceAsBytes(&in).ptr, .f32, 1, in.len).?;
+    var out: [in.len * 2]u8 = undefined;
+    convert(&src, 0, in.len, 1, &out, null);
+    const want = [_]i16{ 0, 16384, -16384, 32767, -32768, 32767, -32768, 8192, 33, -33 };
+    for (want, 0..) |w, i| try std.testing.expectEqual(w, readOut(&out, i));
+}
+
+test "s32 planar stereo interleaves and keeps the top 16 bits" {
+    const left = [_]i32{ 0x12340000, -0x10000, 0x7FFFFFFF };
+    const right = [_]i32{ -0x12340000, 0x20000, std.math.minInt(i32) };
+    const planes = [_]?[*]const u8{ std.mem.sliceAsBytes(&left).ptr, std.mem.sliceAsBytes(&right).ptr };
+    const src = Source.planar(&planes, .s32, 3).?;
+    var out: [3 * 4]u8 = undefined;
+    convert(&src, 0, 3, 2, &out, null);
+    const want = [_]i16{ 0x1234, -0x1234, -1, 2, 32767, -32768 };
+    for (want, 0..) |w, i| try std.testing.expectEqual(w, readOut(&out, i));
+}
+
+test "channel count mismatch duplicates mono and averages stereo" {
+    const mono = [_]i16{ 100, -200 };
+    const src_mono = Source.interleaved(std.mem.sliceAsBytes(&mono).ptr, .s16, 1, 2).?;
+    var out: [8]u8 = undefined;
+    convert(&src_mono, 0, 2, 2, &out, null);
+    for ([_]i16{ 100, 100, -200, -200 }, 0..) |w, i| try std.testing.expectEqual(w, readOut(&out, i));
+
+    const stereo = [_]i16{ 100, 300, -1000, 1000 };
+    const src_stereo = Source.interleaved(std.mem.sliceAsBytes(&stereo).ptr, .s16, 2, 2).?;
+    convert(&src_stereo, 0, 2, 1, out[0..4], null);
+    for ([_]i16{ 200, 0 }, 0..) |w, i| try std.testing.expectEqual(w, readOut(&out, i));
+}
+
+test "vector blocks match per-sample conversion in every layout" {
+    var prng = std.Random.DefaultPrng.init(72);
+    const frames = 21; // two blocks plus a tail
+    var data: [2 * frames * 4]u8 align(4) = undefined;
+    for (std.enums.values(SampleFormat)) |format| {
+        prng.random().bytes(&data);
+        if (format == .f32) {
+            // Keep floats finite and mostly in range
+            const floats = std.mem.bytesAsSlice(f32, &data);
+            for (floats) |*x| x.* = (prng.random().float(f32) - 0.5) * 2.2;
+        }
+        const bps = format.bytesPerSample();
+        const sources = [_]Source{
+            Source.interleaved(&data, format, 1, frames).?,
+            Source.interleaved(&data, format, 2, frames).?,
+            Source.planar(&.{ &data, @as([*]const u8, &data) + frames * bps }, format, frames).?,
+        };
+        for (sources) |src| {
+            for (1..max_channels + 1) |out_channels| {
+                var out: [frames * 4]u8 = undefined;
+                convert(&src, 0, frames, out_channels, &out, null);
+                for (0..frames) |f| {
+                    for (0..out_channels) |oc| {
+                        const v = src.load(oc, out_channels, f, 1)[0];
+                        const want: i16 = @intFromFloat(std.math.clamp(@round(v), -32768, 32767));
+                        try std.testing.expectEqual(want, readOut(&out, f * out_channels + oc));
+                    }
+                }
+            }
+        }
+    }
+}
+
+test "TPDF dither stays within one LSB and averages out" {
+    var in: [4096]f32 = undefined;
+    for (&in) |*s| s.* = 1000.25 / 32768.0;
+    const src = Source.interleaved(std.mem.sliceAsBytes(&in).ptr, .f32, 1, in.len).?;
+    var out: [in.len * 2]u8 = undefined;
+    var dither = Dither{};
+    convert(&src, 0, in.len, 1, &out, &dither);
+    var sum: f64 = 0;
+    for (0..in.len) |i| {
+        const s = readOut(&out, i);
+        try std.testing.expect(s >= 999 and s <= 1002);
+        sum += @floatFromInt(s);
+    }
+    try std.testing.expectApproxEqAbs(@as(f64, 1000.25), sum / in.len, 0.05);
+}
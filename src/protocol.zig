@@ -20,6 +20,15 @@ pub const RgbMode = enum(u8) {
     bgr888 = 0,
     bgra8888 = 1,
     rgb565 = 2,
+
+    /// Bytes per pixel in frame data.
+    pub fn bytesPerPixel(self: RgbMode) usize {
+        return switch (self) {
+            .bgr888 => 3,
+            .bgra8888 => 4,
+            .rgb565 => 2,
+        };
+    }
 };
 
 /// LZ4 compression mode. FPGA only distinguishes off (0) vs on (non-zero).
@@ -48,6 +57,17 @@ pub const SoundChannels = enum(u8) {
     stereo = 2,
 };
 
+/// Bytes of 16-bit PCM the FPGA plays per second (0 when audio is off).
+pub fn audioByteRate(rate: SoundRate, channels: SoundChannels) u64 {
+    const hz: u64 = switch (rate) {
+        .off => 0,
+        .rate_22050 => 22050,
+        .rate_44100 => 44100,
+        .rate_48000 => 48000,
+    };
+    return hz * 2 * @intFromEnum(channels);
+}
+
 // --- Modeline ---
 
 /// CRT display timing parameters for CMD_SWITCHRES.
@@ -237,6 +257,12 @@ test "parseAck all bits set" {
     try std.testing.expect(s.vram_queue);
 }
 
+test "RgbMode bytesPerPixel" {
+    try std.testing.expectEqual(@as(usize, 3), RgbMode.bgr888.bytesPerPixel());
+    try std.testing.expectEqual(@as(usize, 4), RgbMode.bgra8888.bytesPerPixel());
+    try std.testing.expectEqual(@as(usize, 2), RgbMode.rgb565.bytesPerPixel());
+}
+
 test "buildInitPacket format" {
     var buf: [5]u8 = undefined;
     buildInitPacket(&buf, .off, .rate_48000, .stereo, .bgr888);
@@ -480,6 +506,13 @@ test "buildInitPacket encodes audio parameters" {
     try std.testing.expectEqual(@as(u8, 0), buf[3]); // off
 }
 
+test "audioByteRate covers the session formats" {
+    try std.testing.expectEqual(@as(u64, 192000), audioByteRate(.rate_48000, .stereo));
+    try std.testing.expectEqual(@as(u64, 44100), audioByteRate(.rate_22050, .mono));
+    try std.testing.expectEqual(@as(u64, 0), audioByteRate(.off, .stereo));
+    try std.testing.expectEqual(@as(u64, 0), audioByteRate(.rate_44100, .off));
+}
+
 test "parseAck audio_active bit" {
     // bit 6 (0x40) = audio_active
     var buf: [ack_size]u8 = [_]u8{0} ** ack_size;
@@ -5,15 +5,51 @@
 //!
 //! ## Modules
 //! - `protocol`: Packet formats, command codes, FPGA status parsing
+//! - `clock`: Monotonic nanosecond clock for all timing
 //! - `Connection`: Non-blocking UDP socket, frame chunking, sync polling
 //! - `Input`: FPGA input reception: joystick/keyboard/mouse over UDP port 32101
 //! - `Health`: Rolling-window metrics (sync wait, VRAM ready rate)
+//! - `LossDetector`: ACK-driven loss detection for delta keyframe resync
+//! - `Pipeline`: Overlaps frame compression (worker thread) with sending
+//! - `Slab`: Pre-faulted, huge-page backed arena for per-connection frame buffers
+//! - `FrameCache`: Compressed-keyframe LRU for recurring static screens
+//! - `ingest`: Host pixel format conversion, fused into the frame path
+//! - `FormatPolicy`: Bandwidth-driven fallback to RGB565 and back
+//! - `AudioRing`: Lock-free PCM ring drained at the session's sound rate
+//! - `AudioMeter`: Audio buffer-level estimate, underruns, latency histogram
+//! - `pcm`: Host audio sample formats and SIMD conversion to wire PCM
+//! - `Resampler`: Audio drift compensation: fractional resampling steered by ring fill
+//! - `ShmRing`: Shared-memory frame/audio ring between host processes and `gmz-daemon`
 //! - `c_api`: C-exported functions (`gmz_connect`, `gmz_submit`, etc.)
 
 /// UDP protocol: command codes, packet builders, ACK parsing, modeline/status types.
 pub const protocol = @import("protocol.zig");
+/// Monotonic nanosecond clock shared by pacing, audio, health and input timestamps.
+pub const clock = @import("clock.zig");
 /// Rolling-window health metrics: sync wait timing, VRAM ready rate, stall detection.
 pub const Health = @import("Health.zig");
+/// ACK-driven loss detection: flags fields whose delta reference needs a resync keyframe.
+pub const LossDetector = @import("LossDetector.zig");
+/// Compression pipeline: compresses the next frame on a worker while the previous one is sent.
+pub const Pipeline = @import("Pipeline.zig");
+/// Single-allocation frame buffer arena: huge pages, pre-faulted, or embedder memory.
+pub const Slab = @import("Slab.zig");
+/// LRU cache of compressed keyframes for recurring screens.
+pub const FrameCache = @import("FrameCache.zig");
+/// Host pixel formats and SIMD conversion to the wire format on read.
+pub const ingest = @import("ingest.zig");
+/// Bandwidth fallback policy: when to drop to RGB565 and when to step back up.
+pub const FormatPolicy = @import("FormatPolicy.zig");
+/// Lock-free PCM ring: host writes any amount, frame thread sends it paced to the sound rate.
+pub const AudioRing = @import("AudioRing.zig");
+/// Audio downstream estimate from bytes sent and `audio_active`: latency, underruns, histogram.
+pub const AudioMeter = @import("AudioMeter.zig");
+/// Host audio formats (s16/s32/f32, interleaved or planar) and vectorised conversion to wire PCM.
+pub const pcm = @import("pcm.zig");
+/// Windowed-sinc PCM resampler and the ring-fill controller that drives its ratio.
+pub const Resampler = @import("Resampler.zig");
+/// Shared-memory triple buffer and audio ring handed from a host to `gmz-daemon` (Linux).
+pub const ShmRing = @import("ShmRing.zig");
 /// Non-blocking UDP connection: socket lifecycle, frame chunking, sync polling.
 pub const Connection = @import("Connection.zig");
 /// FPGA input reception: joystick, PS/2 keyboard, and mouse over UDP port 32101.
@@ -22,6 +58,10 @@ pub const Input = @import("Input.zig");
 pub const lz4 = @import("lz4.zig");
 /// Delta frame encoding: XOR successive frames for bandwidth reduction.
 pub const delta = @import("delta.zig");
+/// Delta kernels specialised at comptime per geometry and pixel format.
+pub const kernels = @import("kernels.zig");
+/// Runtime CPU dispatch: picks the widest ISA variant of the kernels the host supports.
+pub const isa = @import("isa.zig");
 /// Library version from build.zig.zon.
 pub const version = @import("version.zig");
 /// CRT sync primitives: frame timing, raster offset, vsync line computation.
@@ -39,30 +79,81 @@ comptime {
     _ = &c_api.gmz_tick;
     _ = &c_api.gmz_set_modeline;
     _ = &c_api.gmz_submit;
+    _ = &c_api.gmz_submit_format;
+    _ = &c_api.gmz_submit_strided;
+    _ = &c_api.gmz_submit_iov;
+    _ = &c_api.gmz_acquire_frame;
+    _ = &c_api.gmz_commit_frame;
+    _ = &c_api.gmz_set_scaler;
+    _ = &c_api.gmz_set_dither;
+    _ = &c_api.gmz_set_format_policy;
+    _ = &c_api.gmz_poll_format_event;
     _ = &c_api.gmz_submit_audio;
+    _ = &c_api.gmz_audio_write;
+    _ = &c_api.gmz_audio_fill;
+    _ = &c_api.gmz_audio_write_format;
+    _ = &c_api.gmz_audio_write_planar;
+    _ = &c_api.gmz_set_audio_dither;
+    _ = &c_api.gmz_audio_stats;
+    _ = &c_api.gmz_set_audio_resample;
+    _ = &c_api.gmz_audio_ratio;
     _ = &c_api.gmz_wait_sync;
     _ = &c_api.gmz_version;
     _ = &c_api.gmz_version_major;
     _ = &c_api.gmz_version_minor;
     _ = &c_api.gmz_version_patch;
+    _ = &c_api.gmz_kernel_variant;
     _ = &c_api.gmz_raster_offset_ns;
     _ = &c_api.gmz_calc_vsync;
     _ = &c_api.gmz_frame_time_ns;
     _ = &c_api.gmz_begin_frame;
+    _ = &c_api.gmz_set_allocator;
+    _ = &c_api.gmz_set_keyframe_policy;
+    _ = &c_api.gmz_set_dual_encode;
+    _ = &c_api.gmz_set_near_lossless;
+    _ = &c_api.gmz_set_frame_cache;
+    _ = &c_api.gmz_set_workers;
+    _ = &c_api.gmz_force_keyframe;
+    _ = &c_api.gmz_compress_stats;
+    _ = &c_api.gmz_set_pipeline;
+    _ = &c_api.gmz_pipeline_stats;
+    _ = &c_api.gmz_shm_open;
+    _ = &c_api.gmz_shm_close;
+    _ = &c_api.gmz_shm_set_modeline;
+    _ = &c_api.gmz_shm_acquire_frame;
+    _ = &c_api.gmz_shm_commit_frame;
+    _ = &c_api.gmz_shm_write_audio;
     _ = &c_api.gmz_input_bind;
     _ = &c_api.gmz_input_close;
+    _ = &c_api.gmz_input_start_thread;
     _ = &c_api.gmz_input_poll;
     _ = &c_api.gmz_input_joy;
     _ = &c_api.gmz_input_ps2;
+    _ = &c_api.gmz_input_events;
+    _ = &c_api.gmz_input_events_dropped;
 }
 
 test {
     _ = protocol;
+    _ = clock;
     _ = Health;
+    _ = LossDetector;
+    _ = Pipeline;
+    _ = Slab;
+    _ = FrameCache;
+    _ = ingest;
+    _ = FormatPolicy;
+    _ = AudioRing;
+    _ = AudioMeter;
+    _ = pcm;
+    _ = Resampler;
+    _ = ShmRing;
     _ = Connection;
     _ = Input;
     _ = lz4;
     _ = delta;
+    _ = kernels;
+    _ = isa;
     _ = version;
     _ = sync;
     _ = pacer;